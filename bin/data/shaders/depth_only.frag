@@ -0,0 +1,7 @@
+#version 410
+
+// Used for the terrain's depth pre-pass: the color writes are masked off, so the only output is the depth of the fragment.
+// Everything expensive (normal mapping, lighting, fog) happens afterwards in terrain.frag, once per visible pixel.
+void main()
+{
+}
@@ -0,0 +1,44 @@
+#version 410
+
+// The distant terrain and water captured around a point, premultiplied by alpha (see FarImpostor).
+uniform samplerCube impostorColor;
+
+// The depth of every texel of the capture.
+uniform samplerCube impostorDepth;
+
+// The camera's position relative to the point the impostor was captured from.
+uniform vec3 cameraOffset;
+
+// The clipping planes the impostor was captured with.
+uniform float nearPlane;
+uniform float farPlane;
+
+// Untransformed, local-space position of the cube (the view direction).
+in vec3 fragPos;
+
+out vec4 outColor;
+
+// Gets the distance from the capture point to the captured surface in a particular (normalized) direction.
+float capturedDistance(vec3 dir)
+{
+    // Undo the projection to get the depth along the face's axis, then convert it to a distance along the direction.
+    float depth = texture(impostorDepth, dir).r;
+    float axisDepth = nearPlane * farPlane / (farPlane - depth * (farPlane - nearPlane));
+    vec3 absDir = abs(dir);
+    return axisDepth / max(absDir.x, max(absDir.y, absDir.z));
+}
+
+void main()
+{
+    vec3 viewDir = normalize(fragPos);
+
+    // Look up the point the camera sees rather than the direction it's looking in, since the camera has moved since the capture.
+    // The distance to that point is found with a couple of fixed-point iterations, starting from the view direction itself.
+    vec3 lookupDir = viewDir;
+    for (int i = 0; i < 2; i++)
+    {
+        lookupDir = normalize(cameraOffset + viewDir * capturedDistance(lookupDir));
+    }
+
+    outColor = texture(impostorColor, lookupDir);
+}
@@ -0,0 +1,22 @@
+#version 410
+
+#pragma include "uniform_blocks.glsl"
+
+layout (location = 0) in vec3 position;
+layout (location = 2) in vec3 normal;
+layout (location = 3) in vec2 uv;
+
+// The transform from model space to world space; one per instance (takes locations 4 through 7).
+layout (location = 4) in mat4 instanceTransform;
+
+out vec3 fragNormal;
+out vec2 fragUV;
+
+void main()
+{
+    gl_Position = mvp * instanceTransform * vec4(position, 1.0);
+
+    // Instances are only rotated and uniformly scaled, so the upper 3x3 of the transform works for normals (they're renormalized later).
+    fragNormal = mat3(normalMatrix) * mat3(instanceTransform) * normal;
+    fragUV = 4 * uv;
+}
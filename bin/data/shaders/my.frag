@@ -1,12 +1,12 @@
 #version 410
 
+#pragma include "uniform_blocks.glsl"
+
 in vec3 fragNormal;
 in vec2 fragUV;
 
 out vec4 outColor;
 
-uniform vec3 lightDir;
-uniform vec3 lightColor;
 //uniform vec3 meshColor;
 
 uniform sampler2D tex;
@@ -1,5 +1,7 @@
 #version 410
 
+#pragma include "uniform_blocks.glsl"
+
 layout (location = 0) in vec3 position;
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec2 uv;
@@ -7,12 +9,9 @@ layout (location = 3) in vec2 uv;
 out vec3 fragNormal;
 out vec2 fragUV;
 
-uniform mat3 normalMatrix;
-uniform mat4 mvp; 
-
 void main()
 {
     gl_Position = mvp * vec4(position, 1.0);
-    fragNormal = normalMatrix * normal;
+    fragNormal = mat3(normalMatrix) * normal;
     fragUV = 4 * uv;
 }
@@ -1,9 +1,8 @@
 #version 410
 
-layout (location = 0) in vec3 position;
+#pragma include "uniform_blocks.glsl"
 
-// model - view - projection
-uniform mat4 mvp; 
+layout (location = 0) in vec3 position;
 
 // Untransformed, local-space position
 out vec3 fragPos;
@@ -13,5 +12,6 @@ void main()
     fragPos = position;
 
     // Hack for putting the skybox a the far clipping plane
-    gl_Position = (mvp * vec4(position, 1.0)).xyww;
+    // Only the rotation of the view applies, so the skybox stays centered on the camera.
+    gl_Position = (projection * mat4(mat3(modelView)) * vec4(position, 1.0)).xyww;
 }
\ No newline at end of file
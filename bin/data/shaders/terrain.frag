@@ -1,26 +1,10 @@
 #version 410
 
-// The direction of the sun
-uniform vec3 lightDir;
-
-// The color of the sun
-uniform vec3 lightColor;
-
-// The ambient light color.
-uniform vec3 ambientColor;
+#pragma include "uniform_blocks.glsl"
 
 // The color of the robot
 uniform vec3 meshColor;
 
-// 1/gamma; used for gamma correction
-uniform float gammaInv;
-
-// The distance at which the robot should start to fade away
-uniform float startFade;
-
-// The distance at which the robot should be completely invisible
-uniform float endFade;
-
 // Input surface normal
 in vec3 fragNormal;
 
@@ -36,18 +20,29 @@ in mat3 TBN;
 uniform sampler2D diffuseTex;
 uniform sampler2D normalTex;
 
+// The baked sun visibility (red) and ambient occlusion (green) across the whole terrain (see TerrainOcclusion).
+uniform sampler2D occlusionTex;
+
+// Converts heightmap pixel coordinates (as in fragUV) to occlusion map coordinates: one over the heightmap size minus one.
+uniform vec2 occlusionUVScale;
+
 void main()
 {
     // Re-normalize the normal vector after rasterization.
     // vec3 normal = normalize(fragNormal);
     vec3 diffuseColor = pow(texture(diffuseTex, fragUV  * 0.05).rgb, vec3(2.2)); // = normalize(fragNormal);
 
-    vec3 tsNormal = texture(normalTex, fragUV * 0.05).xyz * 2 - 1;
+    // The normal map only stores x and y (BC5); z is always positive in tangent space.
+    vec2 tsNormalXY = texture(normalTex, fragUV * 0.05).rg * 2 - 1;
+    vec3 tsNormal = vec3(tsNormalXY, sqrt(max(0.0, 1.0 - dot(tsNormalXY, tsNormalXY))));
     vec3 wsNormal = TBN * tsNormal;
 
-    // Calculate diffuse lighting.
-    float lightAmount = max(0.0, dot(wsNormal, lightDir));
-    vec3 fragLight = lightColor * lightAmount + ambientColor;
+    // Look up how much of the sun and sky this point can see past the surrounding hills.
+    vec2 occlusion = texture(occlusionTex, vec2(fragUV.x, 1 - fragUV.y) * occlusionUVScale).rg;
+
+    // Calculate diffuse lighting, shadowed by the terrain.
+    float lightAmount = max(0.0, dot(wsNormal, lightDir)) * occlusion.r;
+    vec3 fragLight = lightColor * lightAmount + ambientColor * occlusion.g;
     
     // Calculate fade-out.
     float alpha = clamp((endFade - length(fragCamSpacePos)) / (endFade - startFade), 0.0, 1.0);
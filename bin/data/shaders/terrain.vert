@@ -1,29 +1,32 @@
 #version 410
 
+#pragma include "uniform_blocks.glsl"
+
 layout (location = 0) in vec3 position;
 layout (location = 1) in vec3 tangent;
 layout (location = 2) in vec3 normal;
 layout (location = 3) in vec2 uv;
 
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-uniform vec3 meshColor;
+// The depth pre-pass and the shaded pass must produce exactly the same depth for the GL_LEQUAL test to pass.
+invariant gl_Position;
 
 out mat3 TBN;
 out vec2 fragUV;
 
-uniform mat3 normalMatrix;
-uniform mat4 mvp; 
+// For level-of-detail transition fade
+out vec3 fragCamSpacePos;
 
 void main()
 {
-    gl_Position = mvp * vec4(position, 1.0);
-    // fragNormal = normalMatrix * normal;
+    vec4 worldPosition = vec4(position, 1.0);
+    gl_Position = mvp * worldPosition;
+    fragCamSpacePos = (modelView * worldPosition).xyz;
+    // fragNormal = mat3(normalMatrix) * normal;
     fragUV = vec2(uv.x, 1 - uv.y);
 
-    vec3 T = normalize(normalMatrix * tangent.xyz);
-    vec3 B = normalize(normalMatrix * cross(tangent.xyz, normal));
-    vec3 N = normalize(normalMatrix * normal);
+    vec3 T = normalize(mat3(normalMatrix) * tangent.xyz);
+    vec3 B = normalize(mat3(normalMatrix) * cross(tangent.xyz, normal));
+    vec3 N = normalize(mat3(normalMatrix) * normal);
 
     TBN = mat3(T, B, N);
 }
@@ -0,0 +1,88 @@
+#version 410
+
+#pragma include "uniform_blocks.glsl"
+
+// The position of the vertex within the level's grid, in vertices (the y-component is always zero).
+layout (location = 0) in vec3 position;
+
+// The level's heights, indexed toroidally by grid coordinates.
+uniform sampler2D heightmapTex;
+
+// The grid coordinates of the level's first vertex.
+uniform ivec2 levelOrigin;
+
+// The distance between vertices in this level, in heightmap pixels.
+uniform int levelSpacing;
+
+// The number of quads in each row and column of the level.
+uniform int levelSize;
+
+// True for every level except the coarsest.
+uniform bool hasCoarserLevel;
+
+// Converts heightmap pixel coordinates and normalized heights to world space.
+uniform vec3 scale;
+
+out mat3 TBN;
+out vec2 fragUV;
+
+// For level-of-detail transition fade
+out vec3 fragCamSpacePos;
+
+// Fetches the normalized height at a pair of grid coordinates.
+float heightAt(ivec2 grid)
+{
+    ivec2 size = textureSize(heightmapTex, 0);
+    ivec2 texel = grid - size * ivec2(floor(vec2(grid) / vec2(size)));
+    return texelFetch(heightmapTex, texel, 0).r;
+}
+
+void main()
+{
+    ivec2 local = ivec2(position.xz);
+    ivec2 grid = levelOrigin + local;
+    float height = heightAt(grid);
+
+    // The coarser level only has every other vertex along this level's outer edge;
+    // put the ones in between on the line joining their neighbors so that the edges match exactly.
+    if (hasCoarserLevel)
+    {
+        if ((local.x == 0 || local.x == levelSize) && (local.y & 1) != 0)
+        {
+            height = 0.5 * (heightAt(grid - ivec2(0, 1)) + heightAt(grid + ivec2(0, 1)));
+        }
+        else if ((local.y == 0 || local.y == levelSize) && (local.x & 1) != 0)
+        {
+            height = 0.5 * (heightAt(grid - ivec2(1, 0)) + heightAt(grid + ivec2(1, 0)));
+        }
+    }
+
+    vec2 pixel = vec2(grid * levelSpacing);
+
+    vec4 worldPosition = vec4(scale * vec3(pixel.x, height, pixel.y), 1.0);
+    gl_Position = mvp * worldPosition;
+    fragCamSpacePos = (modelView * worldPosition).xyz;
+    fragUV = vec2(pixel.x, 1 - pixel.y);
+
+    // Calculate the normal from the neighboring vertices, as buildTerrainMesh() does with neighboring pixels.
+    ivec2 grid1 = levelOrigin + max(local - 1, ivec2(0));
+    ivec2 grid2 = levelOrigin + min(local + 1, ivec2(levelSize));
+
+    // Generate vectors roughly parallel to the ground
+    vec3 v1 = scale * vec3((grid.x - grid1.x) * levelSpacing, height - heightAt(ivec2(grid1.x, grid.y)), 0);
+    vec3 v2 = scale * vec3((grid2.x - grid.x) * levelSpacing, heightAt(ivec2(grid2.x, grid.y)) - height, 0);
+    vec3 w1 = scale * vec3(0, heightAt(ivec2(grid.x, grid1.y)) - height, (grid1.y - grid.y) * levelSpacing);
+    vec3 w2 = scale * vec3(0, height - heightAt(ivec2(grid.x, grid2.y)), (grid.y - grid2.y) * levelSpacing);
+
+    vec3 normal = normalize(cross(normalize(w1 + w2), normalize(v1 + v2)));
+
+    // The texture coordinates increase along x, so the tangent follows the slope in x, made perpendicular to the normal.
+    vec3 tangent = normalize(v1 + v2);
+    tangent = normalize(tangent - normal * dot(normal, tangent));
+
+    vec3 T = normalize(mat3(normalMatrix) * tangent);
+    vec3 B = normalize(mat3(normalMatrix) * cross(tangent, normal));
+    vec3 N = normalize(mat3(normalMatrix) * normal);
+
+    TBN = mat3(T, B, N);
+}
@@ -0,0 +1,73 @@
+#version 410
+
+#pragma include "uniform_blocks.glsl"
+
+// The position of the vertex within the shared patch, in heightmap pixels (the y-component is always zero).
+layout (location = 0) in vec3 position;
+
+// The position of the patch's first vertex in the heightmap, in pixels; one per instance.
+layout (location = 4) in vec2 cellOffset;
+
+// The window of the heightmap around the player.
+uniform sampler2D heightmapTex;
+
+// The pixel coordinates (in the full heightmap) of the window's first texel.
+uniform ivec2 textureOrigin;
+
+// The coordinates of the last pixel in the full heightmap.
+uniform ivec2 heightmapMax;
+
+// Converts heightmap pixel coordinates and normalized heights to world space.
+uniform vec3 scale;
+
+// The depth pre-pass and the shaded pass must produce exactly the same depth for the GL_LEQUAL test to pass.
+invariant gl_Position;
+
+out mat3 TBN;
+out vec2 fragUV;
+
+// For level-of-detail transition fade
+out vec3 fragCamSpacePos;
+
+// Fetches the normalized height at a pixel of the full heightmap.
+float heightAt(ivec2 pixel)
+{
+    ivec2 texel = clamp(clamp(pixel, ivec2(0), heightmapMax) - textureOrigin, ivec2(0), textureSize(heightmapTex, 0) - 1);
+    return texelFetch(heightmapTex, texel, 0).r;
+}
+
+void main()
+{
+    // Vertices past the edge of the heightmap are pulled back onto the edge.
+    ivec2 pixel = clamp(ivec2(cellOffset + position.xz), ivec2(0), heightmapMax);
+    float height = heightAt(pixel);
+
+    vec4 worldPosition = vec4(scale * vec3(pixel.x, height, pixel.y), 1.0);
+    gl_Position = mvp * worldPosition;
+    fragCamSpacePos = (modelView * worldPosition).xyz;
+    fragUV = vec2(pixel.x, 1 - pixel.y);
+
+    // Calculate the normal the same way as buildTerrainMesh(), from the neighboring pixels.
+    int x1 = max(pixel.x - 1, 0);
+    int x2 = min(pixel.x + 1, heightmapMax.x);
+    int y1 = max(pixel.y - 1, 0);
+    int y2 = min(pixel.y + 1, heightmapMax.y);
+
+    // Generate vectors roughly parallel to the ground
+    vec3 v1 = scale * vec3(pixel.x - x1, height - heightAt(ivec2(x1, pixel.y)), 0);
+    vec3 v2 = scale * vec3(x2 - pixel.x, heightAt(ivec2(x2, pixel.y)) - height, 0);
+    vec3 w1 = scale * vec3(0, heightAt(ivec2(pixel.x, y1)) - height, y1 - pixel.y);
+    vec3 w2 = scale * vec3(0, height - heightAt(ivec2(pixel.x, y2)), pixel.y - y2);
+
+    vec3 normal = normalize(cross(normalize(w1 + w2), normalize(v1 + v2)));
+
+    // The texture coordinates increase along x, so the tangent follows the slope in x, made perpendicular to the normal.
+    vec3 tangent = normalize(v1 + v2);
+    tangent = normalize(tangent - normal * dot(normal, tangent));
+
+    vec3 T = normalize(mat3(normalMatrix) * tangent);
+    vec3 B = normalize(mat3(normalMatrix) * cross(tangent, normal));
+    vec3 N = normalize(mat3(normalMatrix) * normal);
+
+    TBN = mat3(T, B, N);
+}
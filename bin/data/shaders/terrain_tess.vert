@@ -0,0 +1,19 @@
+#version 410
+
+// The position of a patch corner within a cell, in heightmap pixels (the y-component is always zero).
+layout (location = 0) in vec3 position;
+
+// The position of the cell's first vertex in the heightmap, in pixels; one per instance.
+layout (location = 4) in vec2 cellOffset;
+
+// The coordinates of the last pixel in the full heightmap.
+uniform ivec2 heightmapMax;
+
+// The patch corner in pixel coordinates of the full heightmap.
+out vec2 vertPixel;
+
+void main()
+{
+    // Corners past the edge of the heightmap are pulled back onto the edge.
+    vertPixel = clamp(cellOffset + position.xz, vec2(0), vec2(heightmapMax));
+}
@@ -0,0 +1,43 @@
+// Uniform blocks shared by every program; written once per pass by ShaderUniforms (see ShaderUniforms.h for the matching C++ layouts).
+
+// The camera for the current pass.
+layout (std140) uniform Camera
+{
+    // Model-view-projection.
+    mat4 mvp;
+
+    // Model-view; used for level-of-detail transition fade.
+    mat4 modelView;
+
+    // Projection alone; the skybox combines it with just the rotation of the view.
+    mat4 projection;
+
+    // Transforms normals to world space (only the upper 3x3 is used).
+    mat4 normalMatrix;
+};
+
+// The sun and ambient light.
+layout (std140) uniform Lighting
+{
+    // The direction of the sun
+    vec3 lightDir;
+
+    // 1/gamma; used for gamma correction
+    float gammaInv;
+
+    // The color of the sun
+    vec3 lightColor;
+
+    // The ambient light color.
+    vec3 ambientColor;
+};
+
+// The level-of-detail transition fade for the current pass.
+layout (std140) uniform Fade
+{
+    // The distance at which things start to fade away
+    float startFade;
+
+    // The distance at which things are completely invisible
+    float endFade;
+};
@@ -1,14 +1,10 @@
 #version 410
 
+#pragma include "uniform_blocks.glsl"
+
 // The water color.
 uniform vec3 meshColor;
 
-// The distance at which the water starts to disappear / blend into distant water and terrain.
-uniform float startFade;
-
-// THe distance at which the water is completely invisible.
-uniform float endFade;
-
 // Input position in camera space (use for calculating level-of-detail transition fade).
 in vec3 fragCamSpacePos;
 
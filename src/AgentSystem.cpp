@@ -0,0 +1,219 @@
+#include "AgentSystem.h"
+
+using namespace glm;
+
+AgentSystem::AgentSystem(const World& world, JobSystem& jobSystem, float broadphaseCellSize)
+    : world { world }, jobSystem { jobSystem }, broadphase { broadphaseCellSize }
+{
+}
+
+size_t AgentSystem::addAgent(const vec3& position, float characterHeight, float radius)
+{
+    positionX.push_back(position.x);
+    positionY.push_back(position.y);
+    positionZ.push_back(position.z);
+    prevVelocityX.push_back(0);
+    prevVelocityY.push_back(0);
+    prevVelocityZ.push_back(0);
+    desiredVelocityX.push_back(0);
+    desiredVelocityZ.push_back(0);
+    this->characterHeight.push_back(characterHeight);
+    this->radius.push_back(radius);
+    swimmingHeight.push_back(0.1f * characterHeight);
+    inAir.push_back(0);
+    terrainHeight.push_back(0);
+    separationX.push_back(0);
+    separationZ.push_back(0);
+
+    size_t agent { positionX.size() - 1 };
+    broadphase.update(agent, getCapsule(agent));
+    return agent;
+}
+
+void AgentSystem::clear()
+{
+    for (std::vector<float>* array : { &positionX, &positionY, &positionZ, &prevVelocityX, &prevVelocityY, &prevVelocityZ,
+        &desiredVelocityX, &desiredVelocityZ, &characterHeight, &radius, &swimmingHeight, &terrainHeight, &separationX, &separationZ })
+    {
+        array->clear();
+    }
+
+    inAir.clear();
+    broadphase.clear();
+}
+
+size_t AgentSystem::getAgentCount() const
+{
+    return positionX.size();
+}
+
+vec3 AgentSystem::getPosition(size_t agent) const
+{
+    return vec3(positionX[agent], positionY[agent], positionZ[agent]);
+}
+
+void AgentSystem::setDesiredVelocity(size_t agent, const vec3& velocity)
+{
+    desiredVelocityX[agent] = velocity.x;
+    desiredVelocityZ[agent] = velocity.z;
+}
+
+void AgentSystem::jump(size_t agent, float speed)
+{
+    if (!inAir[agent]) // No double jump
+    {
+        prevVelocityY[agent] = speed;
+        inAir[agent] = 1;
+    }
+}
+
+Capsule AgentSystem::getCapsule(size_t agent) const
+{
+    return Capsule { getPosition(agent), characterHeight[agent], radius[agent] };
+}
+
+void AgentSystem::setObstacles(const SpatialHash* obstacles)
+{
+    this->obstacles = obstacles;
+}
+
+const SpatialHash& AgentSystem::getBroadphase() const
+{
+    return broadphase;
+}
+
+void AgentSystem::update(float dt)
+{
+    // Move every agent.
+    jobSystem.parallelFor(getAgentCount(), BATCH_SIZE, [&](size_t begin, size_t end) { updateBatch(begin, end, dt); });
+
+    // Move agents into their new broadphase cells; most agents stay in the same cell, so this rarely touches the hash table.
+    for (size_t agent { 0 }; agent < getAgentCount(); agent++)
+    {
+        broadphase.update(agent, getCapsule(agent));
+    }
+
+    // Find how far each agent needs to be pushed, reading only the positions from this step so the batches are independent...
+    jobSystem.parallelFor(getAgentCount(), BATCH_SIZE, [&](size_t begin, size_t end) { separateBatch(begin, end); });
+
+    // ...then push them all at once.
+    for (size_t agent { 0 }; agent < getAgentCount(); agent++)
+    {
+        positionX[agent] += separationX[agent];
+        positionZ[agent] += separationZ[agent];
+    }
+}
+
+void AgentSystem::updateBatch(size_t begin, size_t end, float dt)
+{
+    float* px { positionX.data() };
+    float* py { positionY.data() };
+    float* pz { positionZ.data() };
+    float* vx { prevVelocityX.data() };
+    float* vy { prevVelocityY.data() };
+    float* vz { prevVelocityZ.data() };
+    const float* dx { desiredVelocityX.data() };
+    const float* dz { desiredVelocityZ.data() };
+    const float* height { characterHeight.data() };
+    const float* swim { swimmingHeight.data() };
+    uint8_t* air { inAir.data() };
+    float* terrain { terrainHeight.data() };
+
+    float gravity { world.gravity };
+    float waterHeight { world.waterHeight };
+    float groundTolerance { std::abs(gravity) * 0.001f };
+
+    // The previous height and horizontal distance travelled are needed for the slope rule; keep them on the stack for the batch.
+    float prevY[BATCH_SIZE];
+    float horizontalDistance[BATCH_SIZE];
+    float newVelocityY[BATCH_SIZE];
+
+    size_t count { end - begin };
+
+    // Pass 1: integrate velocities and positions.
+    for (size_t k { 0 }; k < count; k++)
+    {
+        size_t i { begin + k };
+
+        // On the ground, move at the desired velocity; in the air, keep the previous horizontal velocity.
+        float newVX { air[i] ? vx[i] : dx[i] };
+        float newVZ { air[i] ? vz[i] : dz[i] };
+        float newVY { vy[i] + gravity * dt };
+
+        // Trapezoidal approximation
+        float stepX { (vx[i] + newVX) * 0.5f * dt };
+        float stepZ { (vz[i] + newVZ) * 0.5f * dt };
+
+        prevY[k] = py[i];
+        px[i] += stepX;
+        py[i] += (vy[i] + newVY) * 0.5f * dt;
+        pz[i] += stepZ;
+
+        horizontalDistance[k] = std::sqrt(stepX * stepX + stepZ * stepZ);
+        newVelocityY[k] = newVY;
+        vx[i] = newVX;
+        vz[i] = newVZ;
+    }
+
+    // Pass 2: sample the terrain under every agent in the batch at once.
+    world.getTerrainHeightsAtPositions(px + begin, pz + begin, terrain + begin, count);
+
+    // Pass 3: keep the agents above the ground and water, and decide whether they've landed.
+    for (size_t k { 0 }; k < count; k++)
+    {
+        size_t i { begin + k };
+
+        float heightFromTerrain { std::max(swim[i] + waterHeight, height[i] + terrain[i]) };
+        float y { std::max(py[i], heightFromTerrain) };
+        float newVY { newVelocityY[k] };
+
+        if (std::abs(y - heightFromTerrain) < groundTolerance)
+        {
+            // Jump ended
+            newVY = 0;
+            air[i] = 0;
+        }
+        else if (!air[i] && prevY[k] - heightFromTerrain < horizontalDistance[k])
+        {
+            // Allow agents to run down slopes up to 45 degrees without falling
+            y = heightFromTerrain;
+        }
+
+        py[i] = y;
+        vy[i] = newVY;
+    }
+}
+
+void AgentSystem::separateBatch(size_t begin, size_t end)
+{
+    for (size_t agent { begin }; agent < end; agent++)
+    {
+        Capsule capsule { getCapsule(agent) };
+        vec3 totalSeparation { 0 };
+        vec3 separation {};
+
+        // Each agent in an overlapping pair moves half of the way; the other agent handles the other half.
+        broadphase.forEachInRadius(capsule.top, capsule.radius, [&](size_t other, const Capsule& otherCapsule)
+        {
+            if (other != agent && separateCapsules(capsule, otherCapsule, separation))
+            {
+                totalSeparation += separation * 0.5f;
+            }
+        });
+
+        // Obstacles don't move, so agents move all the way out of them.
+        if (obstacles)
+        {
+            obstacles->forEachInRadius(capsule.top, capsule.radius, [&](size_t, const Capsule& obstacleCapsule)
+            {
+                if (separateCapsules(capsule, obstacleCapsule, separation))
+                {
+                    totalSeparation += separation;
+                }
+            });
+        }
+
+        separationX[agent] = totalSeparation.x;
+        separationZ[agent] = totalSeparation.z;
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "SpatialHash.h"
+#include "JobSystem.h"
+
+// A system for simulating many characters affected by gravity at once.
+// Applies the same rules as CharacterPhysics (trapezoidal integration, snapping to the ground, and running down slopes without falling),
+// but stores each property of the agents in its own array so that every step of the update is a simple loop over contiguous data
+// that the compiler can vectorize, and so that large numbers of agents can be split into batches that run as jobs.
+// Agents are kept in a spatial hash broadphase so that they can be pushed apart from each other (and from static obstacles)
+// without checking every pair.
+class AgentSystem
+{
+public:
+    // Initializes an empty system of agents that live in a particular world, updated using a particular job system.
+    // "broadphaseCellSize" is the size (in world space) of the broadphase grid cells; it's usually the size of a terrain cell.
+    AgentSystem(const World& world, JobSystem& jobSystem, float broadphaseCellSize);
+
+    // Don't support copy constructor or copy assignment operator.
+    AgentSystem(const AgentSystem& a) = delete;
+    AgentSystem& operator= (const AgentSystem& a) = delete;
+
+    // Adds an agent with its head at a particular position, and returns its index.
+    // "characterHeight" is the distance from the agent's head to their feet, and "radius" is the radius of their collision capsule.
+    size_t addAgent(const glm::vec3& position, float characterHeight, float radius);
+
+    // Removes every agent.
+    void clear();
+
+    // Gets the number of agents.
+    size_t getAgentCount() const;
+
+    // Gets the position of an agent's head.
+    glm::vec3 getPosition(size_t agent) const;
+
+    // Sets an agent's intended velocity in world space (the y-component is ignored).
+    void setDesiredVelocity(size_t agent, const glm::vec3& velocity);
+
+    // If the agent is on the ground, this function increases their y-velocity so that they jump into the air.
+    // If the agent is not on the ground, this function does nothing (no double-jumping).
+    void jump(size_t agent, float speed);
+
+    // Gets the collision capsule of an agent.
+    Capsule getCapsule(size_t agent) const;
+
+    // Sets a broadphase containing static obstacles (such as props) that agents should be pushed out of, or nullptr for none.
+    void setObstacles(const SpatialHash* obstacles);
+
+    // Gets the broadphase containing every agent, indexed by agent index; it's up to date as of the end of the last update.
+    const SpatialHash& getBroadphase() const;
+
+    // Advances time by dt for every agent, updating their velocities and positions appropriately, 
+    // and then pushes apart any agents that overlap each other or an obstacle.
+    // Agents are updated in batches, which run as jobs when there are enough agents.
+    void update(float dt);
+
+private:
+    // The number of agents updated together in a single batch.
+    const static size_t BATCH_SIZE { 1024 };
+
+    // The world the agents live in.
+    const World& world;
+
+    // The job system that runs the batches.
+    JobSystem& jobSystem;
+
+    // The position of each agent's head.
+    std::vector<float> positionX {};
+    std::vector<float> positionY {};
+    std::vector<float> positionZ {};
+
+    // The velocity of each agent as of the end of the previous update.
+    std::vector<float> prevVelocityX {};
+    std::vector<float> prevVelocityY {};
+    std::vector<float> prevVelocityZ {};
+
+    // The horizontal velocity each agent wants to move at while on the ground.
+    std::vector<float> desiredVelocityX {};
+    std::vector<float> desiredVelocityZ {};
+
+    // The distance from each agent's head to their feet.
+    std::vector<float> characterHeight {};
+
+    // The radius of each agent's collision capsule.
+    std::vector<float> radius {};
+
+    // The height each agent's head floats above the water when swimming.
+    std::vector<float> swimmingHeight {};
+
+    // Nonzero while an agent is in the air.
+    std::vector<uint8_t> inAir {};
+
+    // Scratch space for the terrain height under each agent.
+    std::vector<float> terrainHeight {};
+
+    // Scratch space for the horizontal distance each agent is pushed by collisions.
+    std::vector<float> separationX {};
+    std::vector<float> separationZ {};
+
+    // The broadphase containing every agent.
+    SpatialHash broadphase;
+
+    // The broadphase containing static obstacles, if any.
+    const SpatialHash* obstacles { nullptr };
+
+    // Updates the agents in the range [begin, end).
+    void updateBatch(size_t begin, size_t end, float dt);
+
+    // Calculates how far each agent in the range [begin, end) needs to be pushed to stop overlapping other agents and obstacles.
+    void separateBatch(size_t begin, size_t end);
+};
@@ -0,0 +1,249 @@
+#include "Benchmarks.h"
+#include "AgentSystem.h"
+#include "CharacterPhysics.h"
+#include "SpatialHash.h"
+#include "GPUTerrain.h"
+#include <random>
+
+using namespace glm;
+
+// The number of simulation steps timed for each benchmark.
+static const unsigned int BENCHMARK_STEPS { 100 };
+
+// The time step used for each simulation step.
+static const float BENCHMARK_DT { 1.0f / 60.0f };
+
+// The number of frames drawn for each rendering benchmark.
+static const unsigned int BENCHMARK_FRAMES { 20 };
+
+// The number of agents simulated for the job system scaling benchmark.
+static const size_t SCALING_AGENT_COUNT { 100000 };
+
+// Times a function over a number of iterations and returns the average time per iteration, in milliseconds.
+template<typename Function>
+static double timeIterations(unsigned int iterations, Function function)
+{
+    auto start { std::chrono::steady_clock::now() };
+    for (unsigned int i { 0 }; i < iterations; i++)
+    {
+        function();
+    }
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / iterations;
+}
+
+void benchmarkAgentSystem(const World& world, JobSystem& jobSystem, float characterHeight, float broadphaseCellSize)
+{
+    cout << "Agent physics benchmark (" << BENCHMARK_STEPS << " steps, " << jobSystem.getThreadCount() << " threads):" << endl;
+
+    for (size_t agentCount : { 1000, 10000, 100000 })
+    {
+        // Use the same random agents for both implementations.
+        std::mt19937 random { 343 };
+        std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+        std::vector<vec3> positions(agentCount);
+        std::vector<vec3> velocities(agentCount);
+        for (size_t i { 0 }; i < agentCount; i++)
+        {
+            positions[i] = vec3(unit(random), 1, unit(random)) * world.dimensions;
+            float angle { unit(random) * 2 * pi<float>() };
+            velocities[i] = vec3(cos(angle), 0, sin(angle)) * 10.0f * characterHeight;
+        }
+
+        AgentSystem agents { world, jobSystem, broadphaseCellSize };
+        std::vector<CharacterPhysics> characters {};
+        characters.reserve(agentCount);
+        for (size_t i { 0 }; i < agentCount; i++)
+        {
+            agents.addAgent(positions[i], characterHeight, 0.25f * characterHeight);
+            agents.setDesiredVelocity(i, velocities[i]);
+
+            characters.emplace_back(world);
+            characters.back().setCharacterHeight(characterHeight);
+            characters.back().setPosition(positions[i]);
+            characters.back().setDesiredVelocity(velocities[i]);
+        }
+
+        double agentSystemTime { timeIterations(BENCHMARK_STEPS, [&]() { agents.update(BENCHMARK_DT); }) };
+        double characterPhysicsTime { timeIterations(BENCHMARK_STEPS, [&]()
+        {
+            for (CharacterPhysics& character : characters)
+            {
+                character.update(BENCHMARK_DT);
+            }
+        }) };
+
+        cout << "  " << agentCount << " agents: AgentSystem " << agentSystemTime << " ms/step, CharacterPhysics "
+            << characterPhysicsTime << " ms/step (" << characterPhysicsTime / agentSystemTime << "x)" << endl;
+    }
+}
+
+void benchmarkBroadphase(float characterHeight, float broadphaseCellSize)
+{
+    cout << "Broadphase benchmark:" << endl;
+
+    float radius { 0.25f * characterHeight };
+
+    for (size_t bodyCount : { 1000, 10000, 100000 })
+    {
+        // Pack the capsules so that each one overlaps a few others on average, like a crowd.
+        float areaSize { sqrt(static_cast<float>(bodyCount)) * 4 * radius };
+        std::mt19937 random { 343 };
+        std::uniform_real_distribution<float> unit { 0.0f, areaSize };
+        std::vector<Capsule> capsules(bodyCount);
+        for (Capsule& capsule : capsules)
+        {
+            capsule = Capsule { vec3(unit(random), characterHeight, unit(random)), characterHeight, radius };
+        }
+
+        SpatialHash broadphase { broadphaseCellSize };
+        size_t hashPairs { 0 };
+        double hashTime { timeIterations(1, [&]()
+        {
+            for (size_t i { 0 }; i < bodyCount; i++)
+            {
+                broadphase.update(i, capsules[i]);
+            }
+
+            vec3 separation {};
+            for (size_t i { 0 }; i < bodyCount; i++)
+            {
+                broadphase.forEachInRadius(capsules[i].top, radius, [&](size_t j, const Capsule& other)
+                {
+                    hashPairs += j > i && separateCapsules(capsules[i], other, separation);
+                });
+            }
+        }) };
+
+        cout << "  " << bodyCount << " capsules: SpatialHash " << hashTime << " ms (" << hashPairs << " pairs)";
+
+        // Checking every pair is quadratic, so skip it when it would take too long.
+        if (bodyCount <= 10000)
+        {
+            size_t bruteForcePairs { 0 };
+            double bruteForceTime { timeIterations(1, [&]()
+            {
+                vec3 separation {};
+                for (size_t i { 0 }; i < bodyCount; i++)
+                {
+                    for (size_t j { i + 1 }; j < bodyCount; j++)
+                    {
+                        bruteForcePairs += separateCapsules(capsules[i], capsules[j], separation);
+                    }
+                }
+            }) };
+
+            cout << ", all pairs " << bruteForceTime << " ms (" << bruteForcePairs << " pairs, " << bruteForceTime / hashTime << "x)";
+        }
+
+        cout << endl;
+    }
+}
+
+void benchmarkJobSystemScaling(const World& world, float characterHeight, float broadphaseCellSize)
+{
+    cout << "Job system scaling benchmark (" << SCALING_AGENT_COUNT << " agents, " << BENCHMARK_STEPS << " steps):" << endl;
+
+    // Use the same random agents for every thread count.
+    std::mt19937 random { 343 };
+    std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+    std::vector<vec3> positions(SCALING_AGENT_COUNT);
+    std::vector<vec3> velocities(SCALING_AGENT_COUNT);
+    for (size_t i { 0 }; i < SCALING_AGENT_COUNT; i++)
+    {
+        positions[i] = vec3(unit(random), 1, unit(random)) * world.dimensions;
+        float angle { unit(random) * 2 * pi<float>() };
+        velocities[i] = vec3(cos(angle), 0, sin(angle)) * 10.0f * characterHeight;
+    }
+
+    double singleThreadTime { 0 };
+
+    for (unsigned int threadCount { 1 }; threadCount <= std::max(1u, std::thread::hardware_concurrency()); threadCount++)
+    {
+        JobSystem jobSystem { threadCount };
+        AgentSystem agents { world, jobSystem, broadphaseCellSize };
+        for (size_t i { 0 }; i < SCALING_AGENT_COUNT; i++)
+        {
+            agents.addAgent(positions[i], characterHeight, 0.25f * characterHeight);
+            agents.setDesiredVelocity(i, velocities[i]);
+        }
+
+        double time { timeIterations(BENCHMARK_STEPS, [&]() { agents.update(BENCHMARK_DT); }) };
+        if (threadCount == 1)
+        {
+            singleThreadTime = time;
+        }
+
+        cout << "  " << threadCount << " threads: " << time << " ms/step (" << singleThreadTime / time << "x)" << endl;
+    }
+}
+
+void benchmarkTerrainRendering(const World& world, JobSystem& jobSystem, vec3 position, unsigned int cellSize, unsigned int cellPairsPerDimension,
+    ShaderProgram& cpuShader, ShaderProgram& gpuShader)
+{
+    cout << "Terrain rendering benchmark (" << glGetString(GL_RENDERER) << ", " << BENCHMARK_FRAMES << " frames):" << endl;
+
+    // The cells of the window around the position, as in CellManager.
+    unsigned int cellsPerDimension { 2 * cellPairsPerDimension };
+    uvec2 heightmapSize { world.getHeightmapSize() };
+    vec2 scaledCellSize { vec2(world.dimensions.x, world.dimensions.z) * static_cast<float>(cellSize) / vec2(heightmapSize - 1u) };
+    ivec2 windowStartCell { ivec2(round(vec2(position.x, position.z) / scaledCellSize)) - ivec2(cellPairsPerDimension) };
+
+    // CPU path: build a mesh for every cell.
+    std::vector<ofMesh> meshes(cellsPerDimension * cellsPerDimension);
+    double cpuSetupTime { timeIterations(1, [&]()
+    {
+        jobSystem.parallelFor(meshes.size(), 1, [&](size_t begin, size_t end)
+        {
+            for (size_t i { begin }; i < end; i++)
+            {
+                ivec2 cellStart { (windowStartCell + ivec2(i / cellsPerDimension, i % cellsPerDimension)) * static_cast<int>(cellSize) };
+                if (all(greaterThanEqual(cellStart, ivec2(0))))
+                {
+                    world.buildMeshForTerrainCell(meshes[i], uvec2(cellStart), uvec2(cellSize));
+                }
+            }
+        });
+    }) };
+
+    size_t cpuGeometryBytes { 0 };
+    for (const ofMesh& mesh : meshes)
+    {
+        cpuGeometryBytes += mesh.getNumVertices() * sizeof(vec3) + mesh.getNumNormals() * sizeof(vec3) + mesh.getNumTexCoords() * sizeof(vec2)
+            + mesh.getNumColors() * sizeof(ofFloatColor) + mesh.getNumIndices() * sizeof(ofIndexType);
+    }
+
+    cpuShader.begin();
+    glFinish();
+    double cpuDrawTime { timeIterations(BENCHMARK_FRAMES, [&]()
+    {
+        for (ofMesh& mesh : meshes)
+        {
+            mesh.draw();
+        }
+
+        glFinish();
+    }) };
+    cpuShader.end();
+
+    // GPU path: upload the window of the heightmap and instance a single patch.
+    GPUTerrain gpuTerrain { world, cellSize, cellPairsPerDimension };
+    double gpuSetupTime { timeIterations(1, [&]()
+    {
+        gpuTerrain.initializeForPosition(position);
+        glFinish();
+    }) };
+
+    gpuShader.begin();
+    glFinish();
+    double gpuDrawTime { timeIterations(BENCHMARK_FRAMES, [&]()
+    {
+        gpuTerrain.draw(gpuShader, 2);
+        glFinish();
+    }) };
+    gpuShader.end();
+
+    cout << "  CPU meshes: " << cpuSetupTime << " ms to build, " << cpuGeometryBytes / (1024.0 * 1024.0) << " MB of geometry, "
+        << cpuDrawTime << " ms/frame" << endl;
+    cout << "  GPU patch: " << gpuSetupTime << " ms to upload, " << gpuTerrain.getGeometryBytes() / (1024.0 * 1024.0) << " MB of geometry + "
+        << gpuTerrain.getTextureBytes() / (1024.0 * 1024.0) << " MB of heightmap texture, " << gpuDrawTime << " ms/frame" << endl;
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "JobSystem.h"
+#include "ShaderProgram.h"
+
+// Times AgentSystem::update() at 1k, 10k and 100k agents scattered across the world,
+// alongside the same number of individual CharacterPhysics objects for comparison, and prints the results.
+// "broadphaseCellSize" is the size of the agents' broadphase grid cells (usually the size of a terrain cell).
+void benchmarkAgentSystem(const World& world, JobSystem& jobSystem, float characterHeight, float broadphaseCellSize);
+
+// Times finding every overlapping pair among 1k, 10k and 100k capsules packed into a small area, 
+// using a SpatialHash and (for the smaller counts) by checking every pair, and prints the results.
+void benchmarkBroadphase(float characterHeight, float broadphaseCellSize);
+
+// Times AgentSystem::update() with 100k agents using job systems with 1 to N threads (where N is the number of hardware threads),
+// and prints the speedup over a single thread.
+void benchmarkJobSystemScaling(const World& world, float characterHeight, float broadphaseCellSize);
+
+// Compares the CPU-meshed terrain path (building and drawing a mesh per cell) with GPUTerrain (one displaced, instanced patch)
+// for a window of (2 * cellPairsPerDimension)^2 cells around a position: setup time, geometry memory, and draw time.
+// Must be called with a GL context; each shader should have its uniforms (other than the heightmap) already set.
+// To benchmark without a GPU, run the application under Mesa's software renderer (e.g. with LIBGL_ALWAYS_SOFTWARE=1 for llvmpipe).
+void benchmarkTerrainRendering(const World& world, JobSystem& jobSystem, glm::vec3 position, unsigned int cellSize, unsigned int cellPairsPerDimension,
+    ShaderProgram& cpuShader, ShaderProgram& gpuShader);
@@ -0,0 +1,35 @@
+#include "Capsule.h"
+
+using namespace glm;
+
+bool separateCapsules(const Capsule& a, const Capsule& b, vec3& separation)
+{
+    // The core segment of each capsule runs vertically from (top - height + radius) to (top - radius).
+    float aMin { a.top.y - a.height + a.radius };
+    float aMax { max(aMin, a.top.y - a.radius) };
+    float bMin { b.top.y - b.height + b.radius };
+    float bMax { max(bMin, b.top.y - b.radius) };
+
+    // Vertical gap between the two core segments (zero if they overlap vertically).
+    float verticalGap { max(0.0f, max(aMin - bMax, bMin - aMax)) };
+
+    vec2 horizontalOffset { a.top.x - b.top.x, a.top.z - b.top.z };
+    float horizontalDistance { length(horizontalOffset) };
+    float radiusSum { a.radius + b.radius };
+
+    // The closest distance between two vertical segments combines the horizontal and vertical gaps.
+    if (horizontalDistance * horizontalDistance + verticalGap * verticalGap >= radiusSum * radiusSum)
+    {
+        return false;
+    }
+
+    // Push apart horizontally far enough that the capsules just touch.
+    float requiredDistance { sqrt(radiusSum * radiusSum - verticalGap * verticalGap) };
+
+    // If the capsules are exactly on top of each other, pick an arbitrary direction.
+    vec2 direction { horizontalDistance > 0.0f ? horizontalOffset / horizontalDistance : vec2(1, 0) };
+    vec2 push { direction * (requiredDistance - horizontalDistance) };
+
+    separation = vec3(push.x, 0, push.y);
+    return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "ofMain.h"
+
+// An upright capsule used as the collision shape for characters and props.
+struct Capsule
+{
+    // The position of the top of the capsule (for a character, the position of their head).
+    glm::vec3 top {};
+
+    // The distance from the top of the capsule to the bottom.
+    float height { 1.0f };
+
+    // The radius of the capsule.
+    float radius { 0.25f };
+};
+
+// Calculates how far capsule "a" needs to move horizontally to stop overlapping capsule "b".
+// Returns false (leaving "separation" untouched) if the capsules don't overlap.
+// Only horizontal separation is returned, so that collisions never fight with the characters' ground snapping.
+bool separateCapsules(const Capsule& a, const Capsule& b, glm::vec3& separation);
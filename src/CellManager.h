@@ -2,22 +2,53 @@
 #include "ofMain.h"
 #include "World.h"
 #include"calcTangents.h"
+#include "CellMeshCache.h"
+#include "JobSystem.h"
+#include "Tracer.h"
 
 // A struct for maintaining the state of a single cell.
 struct Cell
 {
 public:
-    // The mesh containing the terrain geometry for the cell.
+    // The number of quads in each row and column of a cell's occluder.
+    const static unsigned int OCCLUDER_RESOLUTION { 8 };
+
+    // The terrain geometry for the cell, on the GPU.
+    ofVbo vbo {};
+
+    // The number of indices in the vbo.
+    int indexCount { 0 };
+
+    // The terrain geometry built for the cell, waiting to be uploaded (when it wasn't in the mesh cache).
     ofMesh terrainMesh {};
 
+    // The terrain geometry loaded from the mesh cache, mapped in place until it's uploaded straight from the mapping.
+    CellMeshCache::MappedMesh cachedMesh {};
+
+    // Set to true when the geometry has been built or loaded, until drawCells() uploads it (which needs the GL context).
+    // Only written while the cell is loading, or on the main thread once it's live.
+    bool needsUpload { false };
+
     // The corner defining the mesh's location in world space.
     glm::vec2 startPos {};
 
+    // The bounding box of the mesh in world space.
+    glm::vec3 boundsMin {};
+    glm::vec3 boundsMax {};
+
+    // A coarse grid of heights spanning the bounding box, (OCCLUDER_RESOLUTION + 1) squared of them in rows along z,
+    // that never rises above the terrain, for software occlusion culling (see OcclusionCuller).  Empty if the mesh is.
+    std::vector<float> occluderHeights {};
+
     // Set to true while the mesh is loading so that it's not rendered mid-load.
-    bool loading { false };
+    // Cells are built by background jobs, so this is atomic; the mesh may only be read once it's false.
+    std::atomic<bool> loading { false };
 
     // Set to false while the cell is inactive so that it's not rendered.
-    bool live { false };
+    std::atomic<bool> live { false };
+
+    // The frame in which the cell was last deactivated (see CellManager::processLoadQueue()).
+    uint64_t releaseFrame { 0 };
 };
 
 // A template class for managing partial terrain meshes, 
@@ -35,9 +66,27 @@ public:
     CellManager(const CellManager& c) = delete;
     CellManager& operator= (const CellManager& c) = delete;
 
+    // Sets an on-disk cache to load cell meshes from instead of building them, and to store newly built meshes in.
+    // Pass nullptr to always build meshes from the heightmap.
+    void setMeshCache(CellMeshCache* cache)
+    {
+        meshCache = cache;
+    }
+
+    // Sets functions to call with a cell's start position and size (in world space) when the cell has been built and when it's evicted,
+    // so that other per-cell data (such as props) can be loaded and unloaded along with the terrain.
+    // The load callback is called from whichever thread built the cell; the unload callback is called from processLoadQueue().
+    void setCellCallbacks(std::function<void(glm::vec2, glm::vec2)> onCellLoaded, std::function<void(glm::vec2, glm::vec2)> onCellUnloaded)
+    {
+        this->onCellLoaded = std::move(onCellLoaded);
+        this->onCellUnloaded = std::move(onCellUnloaded);
+    }
+
     // This function should be called in your ofApp::setup() function.  
     // Pass in whatever position you want the loaded terrain to be centered around.
-    void initializeForPosition(glm::vec3 position)
+    // The cells are built in parallel as jobs; if a progress callback is provided,
+    // it is called (from whichever thread finished the cell, one call at a time) with the number of cells built so far and the total number of cells.
+    void initializeForPosition(glm::vec3 position, JobSystem& jobSystem, const std::function<void(unsigned int, unsigned int)>& progressCallback = {})
     {
         // Calculate the size of a cell in world coordinates.
         glm::vec2 scaledCellSize { getScaledCellSize() };
@@ -48,16 +97,38 @@ public:
         // Calculate the actual start position of the first cell in the loaded grid.
         cellGridStartPos = (cellGridMidIndices - glm::vec2(CELL_PAIRS_PER_DIMENSION)) * scaledCellSize;
 
-        // Load each cell.
+        // Let the world know which part of the heightmap will be needed.
+        updateWorkingSet();
+
+        // Assign each cell in the buffer its position in the grid.
         unsigned int bufferIndex { 0 };
         for (unsigned int i { 0 }; i < 2 * CELL_PAIRS_PER_DIMENSION; i++)
         {
             for (unsigned int j { 0 }; j < 2 * CELL_PAIRS_PER_DIMENSION; j++)
             {
-                initCell(cellBuffer[bufferIndex], (cellGridStartPos + glm::vec2(i, j) * scaledCellSize));
+                beginCell(cellBuffer[bufferIndex], (cellGridStartPos + glm::vec2(i, j) * scaledCellSize));
                 bufferIndex++;
             }
         }
+
+        // Each cell is built into its own mesh, so no two jobs ever touch the same buffer.
+        unsigned int builtCells { 0 };
+        std::mutex progressMutex {};
+
+        jobSystem.parallelFor(CELL_BUFFER_SIZE, 1, [&](size_t begin, size_t end)
+        {
+            for (size_t index { begin }; index < end; index++)
+            {
+                buildCell(cellBuffer[index]);
+
+                std::lock_guard<std::mutex> lock { progressMutex };
+                builtCells++;
+                if (progressCallback)
+                {
+                    progressCallback(builtCells, CELL_BUFFER_SIZE);
+                }
+            }
+        });
     }
 
     // This function should be called in your ofApp::update() function to unload cells that have gotten to be far away
@@ -65,6 +136,8 @@ public:
     // call processLoadQueue to actually load the meshes.
     void optimizeForPosition(glm::vec3 position)
     {
+        TRACE_SCOPE("optimizeForPosition", { { "cellSize", cellSize } });
+
         // Calculate the size of a cell in world coordinates.
         glm::vec2 scaledCellSize { getScaledCellSize() };
 
@@ -148,35 +221,54 @@ public:
 
             // Update the starting coordinates of the new grid of loaded cells.
             cellGridStartPos = newGridStartPos;
+
+            // Let the world know that the part of the heightmap in use has moved.
+            updateWorkingSet();
         }
     }
 
     // This function would also be called in your ofApp::update() function.  
-    // This function is where the terrain meshes actually get created.
-    void processLoadQueue()
+    // This function is where the terrain meshes actually get created.  Requested cells are built by background jobs, 
+    // so this returns right away; each cell is drawn once it's finished.  At most "buildBudget" cells are started,
+    // and the budget is reduced by the number started, so several cell managers can share one budget.
+    // If the cells are drawn on another thread, from lists gathered in earlier frames, pass the number of the current frame
+    // and of the oldest frame that may still be drawing: a cell deactivated in a given frame is left out of that frame's list
+    // and every later one, but its mesh isn't rebuilt until every list from before that frame has been drawn.
+    void processLoadQueue(JobSystem& jobSystem, unsigned int& buildBudget, uint64_t frame = 0, uint64_t oldestFrameInUse = UINT64_MAX)
     {
-        if (!cellLoadQueue.empty())
-        {
-            // Calculate the size of a cell in world coordinates.
-            glm::vec2 scaledCellSize { getScaledCellSize() };
+        TRACE_SCOPE("processLoadQueue", { { "cellSize", cellSize }, { "queued", cellLoadQueue.size() } });
+
+        // Calculate the size of a cell in world coordinates.
+        glm::vec2 scaledCellSize { getScaledCellSize() };
 
-            // Deactivate cells that are now out of range.
-            //cout << "Active cells: " << endl;
-            for (Cell& cell : cellBuffer)
+        // Deactivate cells that are now out of range, whether or not anything new was requested, so that a cell whose build
+        // finished after the player moved on doesn't stay live (and keep its slot) until the next request.
+        // Cells that are still being built are left to a later call.
+        for (Cell& cell : cellBuffer)
+        {
+            if (cell.live && !cell.loading && isCellDistant(cell.startPos))
             {
-                if (isCellDistant(cell.startPos))
+                cell.live = false;
+                cell.releaseFrame = frame;
+
+                if (onCellUnloaded)
                 {
-                    cell.live = false;
+                    onCellUnloaded(cell.startPos, scaledCellSize);
                 }
             }
+        }
 
+        if (!cellLoadQueue.empty() && buildBudget > 0)
+        {
             unsigned int bufferIndex { 0 };
 
-            // Keep processing until there aren't any available cells in the buffer, or there are not cell requests left to process.
-            while (bufferIndex < CELL_BUFFER_SIZE && !cellLoadQueue.empty())
+            // Keep processing until there aren't any available cells in the buffer, there are not cell requests left to process,
+            // or the budget has been used up.
+            while (bufferIndex < CELL_BUFFER_SIZE && !cellLoadQueue.empty() && buildBudget > 0)
             {
-                // Find the next unused cell in the buffer.
-                while (bufferIndex < CELL_BUFFER_SIZE && (cellBuffer[bufferIndex].live || cellBuffer[bufferIndex].loading))
+                // Find the next unused cell in the buffer that nothing is still drawing.
+                while (bufferIndex < CELL_BUFFER_SIZE && (cellBuffer[bufferIndex].live || cellBuffer[bufferIndex].loading
+                    || cellBuffer[bufferIndex].releaseFrame > oldestFrameInUse))
                 {
                     bufferIndex++;
                 }
@@ -186,8 +278,17 @@ public:
                     if (!isCellDistant(cellLoadQueue.front())
                         && !isCellDuplicate(cellLoadQueue.front(), glm::min(scaledCellSize.x, scaledCellSize.y) * 0.125f)) // Make sure we still want the cell
                     {
-                        // Load the next requested cell.
-                        initCell(cellBuffer[bufferIndex], cellLoadQueue.front());
+                        // Load the next requested cell in the background.
+                        Cell& cell { cellBuffer[bufferIndex] };
+                        beginCell(cell, cellLoadQueue.front());
+                        pendingCells++;
+                        buildBudget--;
+
+                        jobSystem.runInBackground([this, &cell]()
+                        {
+                            buildCell(cell);
+                            pendingCells--;
+                        });
                     }
 
                     cellLoadQueue.pop();
@@ -196,10 +297,23 @@ public:
         }
     }
 
-    // This function iterates over all the available cells and draws all of them that are within the draw 
-    // distance from the current camera position. This should be called from your ofApp::draw() function.  
-    // The draw distance should be the same as the far plane from your projection matrix.
-    void drawActiveCells(glm::vec3 camPosition, float drawDistance)
+    // Gets the number of cells currently being built in the background.
+    unsigned int getPendingCellCount() const
+    {
+        return pendingCells;
+    }
+
+    // Gets the total time spent building cells, on whichever threads built them, since the last call, in milliseconds.
+    double takeBuildMilliseconds()
+    {
+        return buildNanoseconds.exchange(0) * 1.0e-6;
+    }
+
+    // Finds every live cell within the draw distance from the current camera position, sorted front to back
+    // so that nearer hills fill the depth buffer first and hidden fragments behind them are rejected before shading.
+    // Only reads the cells (it just reuses its own sort scratch space), so it can run as a job alongside other work;
+    // the cells are drawn with drawCells().  The draw distance should be the same as the far plane from your projection matrix.
+    void gatherVisibleCells(glm::vec3 camPosition, float drawDistance, std::vector<Cell*>& visibleCells)
     {
         // Calculate the size of a cell in world coordinates.
         glm::vec2 scaledCellSize { getScaledCellSize() };
@@ -207,17 +321,64 @@ public:
         // Calculate an appropriate threshold for deciding if cells are too far away to draw.
         float threshold = drawDistance + glm::max(scaledCellSize.x, scaledCellSize.y) * glm::sqrt(0.5f);
 
+        glm::vec2 camPosition2D { camPosition.x, camPosition.z };
+
+        visibleCells.clear();
+        sortKeys.clear();
+
         for (Cell& cell : cellBuffer)
         {
             // Make sure the cell is live/active and check the distance from the cell center to the camera position
-            if (cell.live && distance(glm::vec2(camPosition.x, camPosition.z), cell.startPos + scaledCellSize * 0.5f) < threshold)
+            float cellDistance { distance(camPosition2D, cell.startPos + scaledCellSize * 0.5f) };
+            if (cell.live && !cell.loading && cellDistance < threshold)
+            {
+                sortKeys.push_back(std::make_pair(cellDistance, &cell));
+            }
+        }
+
+        // Nearest cells first.
+        std::sort(sortKeys.begin(), sortKeys.end(),
+            [](const std::pair<float, Cell*>& a, const std::pair<float, Cell*>& b) { return a.first < b.first; });
+
+        for (const std::pair<float, Cell*>& key : sortKeys)
+        {
+            visibleCells.push_back(key.second);
+        }
+    }
+
+    // Draws cells found by gatherVisibleCells().  This should be called from your ofApp::draw() function.
+    void drawCells(const std::vector<Cell*>& visibleCells)
+    {
+        TRACE_SCOPE("drawCells", { { "cellSize", cellSize }, { "cells", visibleCells.size() } });
+
+        for (Cell* cell : visibleCells)
+        {
+            if (cell->needsUpload)
+            {
+                uploadCell(*cell);
+            }
+
+            // Draw the cell.
+            if (cell->indexCount > 0)
             {
-                // Draw the cell.
-                cell.terrainMesh.draw();
+                cell->vbo.drawElements(GL_TRIANGLES, cell->indexCount);
             }
         }
     }
 
+    // Gets the size of each cell in world coordinates.
+    glm::vec2 getScaledCellSize() const
+    {
+        // The dimensions (in pixels) of the heightmap.
+        glm::vec2 heightmapSize { world.getHeightmapSize() - 1u };
+
+        // The specified size of the heightmap (in world coordinates).
+        glm::vec2 worldHeightmapScale { glm::vec2(world.dimensions.x, world.dimensions.z) };
+
+        // Convert the cell size (defined in terms of heightmap pixels) to world coordinates.
+        return worldHeightmapScale * cellSize / heightmapSize;
+    }
+
 private:
     // The maximum number of cells that can be currently loaded at once.
     const static unsigned int CELL_BUFFER_SIZE { 4 * CELL_PAIRS_PER_DIMENSION * CELL_PAIRS_PER_DIMENSION };
@@ -237,16 +398,28 @@ private:
     // A queue containing the corners of cells that need to be loaded.
     std::queue<glm::vec2> cellLoadQueue {};
 
-    glm::vec2 getScaledCellSize() const
-    {
-        // The dimensions (in pixels) of the heightmap.
-        glm::vec2 heightmapSize { world.heightmap->getWidth() - 1, world.heightmap->getHeight() - 1 };
+    // The on-disk cache of cell meshes, if any.
+    CellMeshCache* meshCache { nullptr };
 
-        // The specified size of the heightmap (in world coordinates).
-        glm::vec2 worldHeightmapScale { glm::vec2(world.dimensions.x, world.dimensions.z) };
+    // The number of cells currently being built in the background.
+    std::atomic<unsigned int> pendingCells { 0 };
 
-        // Convert the cell size (defined in terms of heightmap pixels) to world coordinates.
-        return worldHeightmapScale * cellSize / heightmapSize;
+    // The time spent building cells since it was last taken, in nanoseconds, summed over every thread.
+    std::atomic<uint64_t> buildNanoseconds { 0 };
+
+    // Called when a cell has been built, if set.
+    std::function<void(glm::vec2, glm::vec2)> onCellLoaded {};
+
+    // Called when a cell is evicted, if set.
+    std::function<void(glm::vec2, glm::vec2)> onCellUnloaded {};
+
+    // Scratch space for sorting the visible cells by distance, kept between frames to avoid reallocating.
+    std::vector<std::pair<float, Cell*>> sortKeys {};
+
+    void updateWorkingSet()
+    {
+        // The working set is the rectangle covered by the grid of loaded cells.
+        world.setWorkingSet(cellGridStartPos, cellGridStartPos + getScaledCellSize() * glm::vec2(2 * CELL_PAIRS_PER_DIMENSION));
     }
 
     bool isCellDistant(glm::vec2 cellStartPos)
@@ -265,7 +438,8 @@ private:
         for (Cell& otherCell : cellBuffer)
         {
             // If two cells' start position is within a certain tolerance, they are considered duplicates.
-            if (distance(otherCell.startPos, cellStartPos) < tolerance)
+            // Inactive cells don't count, so a cell that was unloaded can be loaded again when the player comes back.
+            if ((otherCell.live || otherCell.loading) && distance(otherCell.startPos, cellStartPos) < tolerance)
             {
                 return true;
             }
@@ -274,27 +448,137 @@ private:
         return false;
     }
     
-    void initCell(Cell& cell, glm::vec2 startPos)
+    void beginCell(Cell& cell, glm::vec2 startPos)
     {
         // Set cell's starting position, it is current loading and not yet live.
         cell.startPos = startPos;
         cell.live = false;
         cell.loading = true;
+    }
+
+    void buildCell(Cell& cell)
+    {
+        std::chrono::steady_clock::time_point buildStart { std::chrono::steady_clock::now() };
 
         // After unscaling, should range between (0, 0, 0) and (1, 1, 1)
-        glm::vec3 unscaledStartPos { glm::vec3(startPos.x, 0, startPos.y) / world.dimensions };
+        glm::vec3 unscaledStartPos { glm::vec3(cell.startPos.x, 0, cell.startPos.y) / world.dimensions };
 
         // Remap to the resolution of the heightmap and round to the nearest integer
-        glm::uvec2 startIndices { round(glm::vec2(
-            unscaledStartPos.x * (world.heightmap->getWidth() - 1), 
-            unscaledStartPos.z * (world.heightmap->getHeight() - 1))) };
+        glm::uvec2 startIndices { round(glm::vec2(unscaledStartPos.x, unscaledStartPos.z) * glm::vec2(world.getHeightmapSize() - 1u)) };
+
+        // The cell size tells the near and far levels of detail apart.
+        TRACE_SCOPE("buildCell", { { "x", startIndices.x }, { "y", startIndices.y }, { "cellSize", cellSize } });
 
-        // Clear the old terrain mesh and rebuild it for the current cell.
+        // Clear the old terrain mesh (in case it was never uploaded) and map it from the cache, or rebuild it for the current cell if it isn't cached.
         cell.terrainMesh.clear();
-        world.buildMeshForTerrainCell(cell.terrainMesh, startIndices, glm::uvec2(cellSize, cellSize));
+        cell.cachedMesh.close();
+        if (meshCache && meshCache->load(startIndices, cellSize, cell.cachedMesh))
+        {
+            buildOccluder(cell, cell.cachedMesh.vertices, cell.cachedMesh.vertexCount);
+        }
+        else
+        {
+            TRACE_SCOPE("buildMeshForTerrainCell", { { "x", startIndices.x }, { "y", startIndices.y }, { "cellSize", cellSize } });
+
+            world.buildMeshForTerrainCell(cell.terrainMesh, startIndices, glm::uvec2(cellSize, cellSize));
+
+            if (meshCache)
+            {
+                meshCache->store(startIndices, cellSize, cell.terrainMesh);
+            }
+
+            buildOccluder(cell, cell.terrainMesh.getVerticesPointer(), cell.terrainMesh.getNumVertices());
+        }
+
+        cell.needsUpload = true;
+
+        if (onCellLoaded)
+        {
+            onCellLoaded(cell.startPos, getScaledCellSize());
+        }
+
+        buildNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - buildStart).count();
 
         // Once the cell has been successfully loaded, make it live.
         cell.loading = false;
         cell.live = true;
     }
+
+    // Uploads a cell's new geometry to its vbo.  Must be called with the GL context, once the cell has finished loading.
+    void uploadCell(Cell& cell)
+    {
+        TRACE_SCOPE("uploadCell", { { "cellSize", cellSize } });
+
+        if (cell.cachedMesh.isOpen())
+        {
+            // Upload straight from the file mapping.
+            const CellMeshCache::MappedMesh& mesh { cell.cachedMesh };
+            int vertexCount { static_cast<int>(mesh.vertexCount) };
+            cell.vbo.setVertexData(mesh.vertices, vertexCount, GL_STATIC_DRAW);
+            cell.vbo.setNormalData(mesh.normals, vertexCount, GL_STATIC_DRAW);
+            cell.vbo.setTexCoordData(mesh.texCoords, vertexCount, GL_STATIC_DRAW);
+            cell.vbo.setColorData(mesh.colors, vertexCount, GL_STATIC_DRAW);
+            cell.vbo.setIndexData(mesh.indices, static_cast<int>(mesh.indexCount), GL_STATIC_DRAW);
+            cell.indexCount = static_cast<int>(mesh.indexCount);
+
+            cell.cachedMesh.close();
+        }
+        else
+        {
+            cell.vbo.setMesh(cell.terrainMesh, GL_STATIC_DRAW);
+            cell.indexCount = static_cast<int>(cell.terrainMesh.getNumIndices());
+
+            // Keep the mesh's storage to build the next cell into.
+            cell.terrainMesh.clear();
+        }
+
+        cell.needsUpload = false;
+    }
+
+    void buildOccluder(Cell& cell, const glm::vec3* vertices, size_t vertexCount)
+    {
+        if (vertexCount == 0)
+        {
+            cell.boundsMin = glm::vec3(cell.startPos.x, 0, cell.startPos.y);
+            cell.boundsMax = cell.boundsMin;
+            cell.occluderHeights.clear();
+            return;
+        }
+
+        cell.boundsMin = glm::vec3(std::numeric_limits<float>::max());
+        cell.boundsMax = glm::vec3(std::numeric_limits<float>::lowest());
+        for (size_t i { 0 }; i < vertexCount; i++)
+        {
+            const glm::vec3& vertex { vertices[i] };
+            cell.boundsMin = glm::min(cell.boundsMin, vertex);
+            cell.boundsMax = glm::max(cell.boundsMax, vertex);
+        }
+
+        // Each occluder height is the lowest vertex within one occluder quad of it in each direction, so the occluder's triangles
+        // (which only interpolate between heights no higher than any vertex in their quad) never rise above the terrain.
+        const unsigned int resolution { Cell::OCCLUDER_RESOLUTION };
+        cell.occluderHeights.assign((resolution + 1) * (resolution + 1), std::numeric_limits<float>::max());
+
+        glm::vec2 boundsStart { cell.boundsMin.x, cell.boundsMin.z };
+        glm::vec2 boundsSize { glm::max(glm::vec2(cell.boundsMax.x, cell.boundsMax.z) - boundsStart, glm::vec2(1e-6f)) };
+
+        for (size_t i { 0 }; i < vertexCount; i++)
+        {
+            const glm::vec3& vertex { vertices[i] };
+
+            // The vertex's position in occluder quads; a little slack makes sure vertices on a quad's edge count for both sides.
+            glm::vec2 occluderPos { (glm::vec2(vertex.x, vertex.z) - boundsStart) / boundsSize * static_cast<float>(resolution) };
+            glm::ivec2 first { glm::max(glm::ceil(occluderPos - 1.001f), glm::vec2(0)) };
+            glm::ivec2 last { glm::min(glm::floor(occluderPos + 1.001f), glm::vec2(resolution)) };
+
+            for (int z { first.y }; z <= last.y; z++)
+            {
+                for (int x { first.x }; x <= last.x; x++)
+                {
+                    float& height { cell.occluderHeights[z * (resolution + 1) + x] };
+                    height = glm::min(height, vertex.y);
+                }
+            }
+        }
+    }
 };
@@ -0,0 +1,223 @@
+#include "CellMeshCache.h"
+
+using namespace glm;
+
+// Identifies a cell cache file.
+static const uint32_t CELL_FILE_MAGIC { 0x4C4C4543 }; // "CELL"
+
+// Increment whenever the layout of a cell file or the mesh produced by buildTerrainMesh() changes.
+static const uint32_t CELL_FILE_VERSION { 1 };
+
+// The header at the start of every cell file.
+// It's followed by the positions, normals, texture coordinates, tangents (stored as colors), and indices of the mesh.
+struct CellFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t terrainHash;
+    uint32_t cellX;
+    uint32_t cellY;
+    uint32_t cellSize;
+    uint32_t lod;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+};
+
+CellMeshCache::~CellMeshCache()
+{
+    close();
+}
+
+void CellMeshCache::open(const std::filesystem::path& directory, uint64_t terrainHash, unsigned int lod)
+{
+    close();
+
+    // Keep each terrain's cells in a separate directory so that stale cells are easy to delete.
+    std::ostringstream hashString {};
+    hashString << std::hex << std::setw(16) << std::setfill('0') << terrainHash;
+    this->directory = ofToDataPath(directory / hashString.str(), true);
+    this->terrainHash = terrainHash;
+    this->lod = lod;
+
+    std::error_code error {};
+    std::filesystem::create_directories(this->directory, error);
+
+    closing = false;
+    writerThread = std::thread { [this]()
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        while (true)
+        {
+            condition.wait(lock, [this]() { return closing || !pendingCells.empty(); });
+
+            if (pendingCells.empty())
+            {
+                // Closing and nothing left to write.
+                break;
+            }
+
+            PendingCell cell { std::move(pendingCells.front()) };
+            pendingCells.pop();
+
+            // Don't hold the lock while writing, so that other threads can keep queuing cells.
+            lock.unlock();
+            write(cell);
+            lock.lock();
+        }
+    } };
+}
+
+bool CellMeshCache::MappedMesh::isOpen() const
+{
+    return vertices != nullptr;
+}
+
+void CellMeshCache::MappedMesh::close()
+{
+    file.close();
+    vertices = nullptr;
+    normals = nullptr;
+    texCoords = nullptr;
+    colors = nullptr;
+    indices = nullptr;
+    vertexCount = 0;
+    indexCount = 0;
+}
+
+bool CellMeshCache::load(uvec2 cellIndices, unsigned int cellSize, MappedMesh& mesh) const
+{
+    mesh.close();
+
+    MappedFile& file { mesh.file };
+    if (!file.open(getCellPath(cellIndices, cellSize)) || file.getSize() < sizeof(CellFileHeader))
+    {
+        file.close();
+        return false;
+    }
+
+    CellFileHeader header {};
+    std::memcpy(&header, file.getData(), sizeof(header));
+
+    size_t expectedSize { sizeof(CellFileHeader)
+        + header.vertexCount * (2 * sizeof(vec3) + sizeof(vec2) + sizeof(ofFloatColor))
+        + header.indexCount * sizeof(ofIndexType) };
+
+    // Reject files that were written by another version or for another cell.
+    if (header.magic != CELL_FILE_MAGIC || header.version != CELL_FILE_VERSION || header.terrainHash != terrainHash
+        || header.cellX != cellIndices.x || header.cellY != cellIndices.y || header.cellSize != cellSize || header.lod != lod
+        || file.getSize() != expectedSize)
+    {
+        file.close();
+        return false;
+    }
+
+    // Point straight into the mapping, which is page-aligned; every array starts at a multiple of 4 bytes, so the floats and indices are aligned.
+    const uint8_t* data { file.getData() + sizeof(CellFileHeader) };
+
+    mesh.vertices = reinterpret_cast<const vec3*>(data);
+    data += header.vertexCount * sizeof(vec3);
+    mesh.normals = reinterpret_cast<const vec3*>(data);
+    data += header.vertexCount * sizeof(vec3);
+    mesh.texCoords = reinterpret_cast<const vec2*>(data);
+    data += header.vertexCount * sizeof(vec2);
+    mesh.colors = reinterpret_cast<const ofFloatColor*>(data);
+    data += header.vertexCount * sizeof(ofFloatColor);
+    mesh.indices = reinterpret_cast<const ofIndexType*>(data);
+    mesh.vertexCount = header.vertexCount;
+    mesh.indexCount = header.indexCount;
+
+    return true;
+}
+
+void CellMeshCache::store(uvec2 cellIndices, unsigned int cellSize, const ofMesh& terrainMesh)
+{
+    {
+        std::lock_guard<std::mutex> lock { mutex };
+        if (!writerThread.joinable())
+        {
+            // The cache isn't open.
+            return;
+        }
+
+        if (pendingCells.size() >= MAX_PENDING_CELLS)
+        {
+            // The writer is behind; don't hold yet another copy of a mesh.
+            return;
+        }
+
+        pendingCells.push(PendingCell { cellIndices, cellSize, terrainMesh });
+    }
+
+    condition.notify_one();
+}
+
+void CellMeshCache::close()
+{
+    if (writerThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            closing = true;
+        }
+
+        condition.notify_one();
+        writerThread.join();
+    }
+}
+
+std::filesystem::path CellMeshCache::getCellPath(uvec2 cellIndices, unsigned int cellSize) const
+{
+    return directory / ("lod" + ofToString(lod) + "_" + ofToString(cellSize) + "_" + ofToString(cellIndices.x) + "_" + ofToString(cellIndices.y) + ".cell");
+}
+
+void CellMeshCache::write(const PendingCell& cell) const
+{
+    const ofMesh& mesh { cell.terrainMesh };
+
+    // Only cache complete meshes, as produced by buildTerrainMesh().
+    size_t vertexCount { mesh.getNumVertices() };
+    if (vertexCount == 0 || mesh.getNumNormals() != vertexCount || mesh.getNumTexCoords() != vertexCount || mesh.getNumColors() != vertexCount)
+    {
+        return;
+    }
+
+    CellFileHeader header {};
+    header.magic = CELL_FILE_MAGIC;
+    header.version = CELL_FILE_VERSION;
+    header.terrainHash = terrainHash;
+    header.cellX = cell.cellIndices.x;
+    header.cellY = cell.cellIndices.y;
+    header.cellSize = cell.cellSize;
+    header.lod = lod;
+    header.vertexCount = static_cast<uint32_t>(vertexCount);
+    header.indexCount = static_cast<uint32_t>(mesh.getNumIndices());
+
+    // Write to a temporary file and rename it once complete, so that a reader never maps a partially written cell.
+    std::filesystem::path path { getCellPath(cell.cellIndices, cell.cellSize) };
+    std::filesystem::path tempPath { path };
+    tempPath += ".tmp";
+
+    {
+        std::ofstream stream { tempPath, std::ios::binary | std::ios::trunc };
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(mesh.getVerticesPointer()), vertexCount * sizeof(vec3));
+        stream.write(reinterpret_cast<const char*>(mesh.getNormalsPointer()), vertexCount * sizeof(vec3));
+        stream.write(reinterpret_cast<const char*>(mesh.getTexCoordsPointer()), vertexCount * sizeof(vec2));
+        stream.write(reinterpret_cast<const char*>(mesh.getColorsPointer()), vertexCount * sizeof(ofFloatColor));
+        stream.write(reinterpret_cast<const char*>(mesh.getIndexPointer()), header.indexCount * sizeof(ofIndexType));
+
+        if (!stream)
+        {
+            ofLogWarning("CellMeshCache") << "Failed to write " << tempPath;
+            return;
+        }
+    }
+
+    std::error_code error {};
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+    {
+        ofLogWarning("CellMeshCache") << "Failed to write " << path << ": " << error.message();
+        std::filesystem::remove(tempPath, error);
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "ofMain.h"
+#include "MappedFile.h"
+#include <condition_variable>
+
+// A persistent on-disk cache of built terrain cell meshes.
+// Each cell is stored in its own versioned binary file, keyed by the terrain hash, the cell's coordinates, the cell size and the level of detail.
+// Cached cells are read through a memory mapping; new cells are written by a background thread so that storing never stalls cell loading.
+class CellMeshCache
+{
+public:
+    // The most cells that can wait to be written at once; cells stored while the queue is full aren't cached.
+    const static size_t MAX_PENDING_CELLS { 64 };
+
+    // A cached cell mesh, read in place from its memory-mapped cache file, so that it can be uploaded without copying it first.
+    // The arrays stay valid until the mesh is closed (or loaded again).
+    struct MappedMesh
+    {
+        MappedFile file {};
+        const glm::vec3* vertices { nullptr };
+        const glm::vec3* normals { nullptr };
+        const glm::vec2* texCoords { nullptr };
+        const ofFloatColor* colors { nullptr };
+        const ofIndexType* indices { nullptr };
+        size_t vertexCount { 0 };
+        size_t indexCount { 0 };
+
+        // Returns true if a cached cell is mapped.
+        bool isOpen() const;
+
+        // Unmaps the cell.
+        void close();
+    };
+
+    CellMeshCache() = default;
+    ~CellMeshCache();
+
+    // Don't support copy constructor or copy assignment operator.
+    CellMeshCache(const CellMeshCache& c) = delete;
+    CellMeshCache& operator= (const CellMeshCache& c) = delete;
+
+    // Opens the cache for a particular terrain and level of detail, and starts the background writer.
+    // "terrainHash" should come from World::computeTerrainHash(); cells cached for any other terrain are never used.
+    void open(const std::filesystem::path& directory, uint64_t terrainHash, unsigned int lod);
+
+    // Maps a cached cell.  Returns false (leaving the mesh closed) if the cell isn't cached or the cache file is stale.
+    // Safe to call from several threads at once.
+    bool load(glm::uvec2 cellIndices, unsigned int cellSize, MappedMesh& mesh) const;
+
+    // Queues a built cell to be written to the cache in the background.  Safe to call from several threads at once.
+    // If the writer has fallen MAX_PENDING_CELLS behind, the cell is skipped instead (it's cached the next time it's built),
+    // so that queued copies of meshes can't pile up without bound.
+    void store(glm::uvec2 cellIndices, unsigned int cellSize, const ofMesh& terrainMesh);
+
+    // Waits for all queued cells to be written and stops the background writer; called automatically by the destructor.
+    void close();
+
+private:
+    // A cell waiting to be written.
+    struct PendingCell
+    {
+        glm::uvec2 cellIndices {};
+        unsigned int cellSize { 0 };
+        ofMesh terrainMesh {};
+    };
+
+    // The directory containing the cache files for this terrain.
+    std::filesystem::path directory {};
+
+    // The hash of the terrain that the cached cells were built from.
+    uint64_t terrainHash { 0 };
+
+    // The level of detail of the cached cells.
+    unsigned int lod { 0 };
+
+    // Cells waiting to be written by the background thread.
+    std::queue<PendingCell> pendingCells {};
+
+    // Guards the queue of pending cells.
+    std::mutex mutex {};
+
+    // Signals the background thread when a cell is queued or the cache is closed.
+    std::condition_variable condition {};
+
+    // Set to true to stop the background thread once the queue is empty.
+    bool closing { false };
+
+    // The background thread that writes pending cells.
+    std::thread writerThread {};
+
+    // Gets the path of the cache file for a particular cell.
+    std::filesystem::path getCellPath(glm::uvec2 cellIndices, unsigned int cellSize) const;
+
+    // Writes a single cell to disk.  Runs on the background thread.
+    void write(const PendingCell& cell) const;
+};
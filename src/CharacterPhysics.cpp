@@ -88,4 +88,36 @@ void CharacterPhysics::jump(float speed)
 void CharacterPhysics::setDesiredVelocity(glm::vec3 velocity)
 {
     this->desiredVelocity = velocity;
-}
\ No newline at end of file
+}
+
+float CharacterPhysics::getRadius() const
+{
+    return radius;
+}
+
+void CharacterPhysics::setRadius(float radius)
+{
+    this->radius = radius;
+}
+
+Capsule CharacterPhysics::getCapsule() const
+{
+    return Capsule { position, characterHeight, radius };
+}
+
+void CharacterPhysics::resolveCollisions(const SpatialHash& broadphase, size_t ignoreId)
+{
+    Capsule capsule { getCapsule() };
+    vec3 totalSeparation { 0 };
+    vec3 separation {};
+
+    broadphase.forEachInRadius(capsule.top, capsule.radius, [&](size_t id, const Capsule& other)
+    {
+        if (id != ignoreId && separateCapsules(capsule, other, separation))
+        {
+            totalSeparation += separation;
+        }
+    });
+
+    position += totalSeparation;
+}
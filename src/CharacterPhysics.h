@@ -1,6 +1,7 @@
 #pragma once
 #include "ofMain.h"
 #include "World.h"
+#include "SpatialHash.h"
 
 // A class for handling a character affected by gravity.
 class CharacterPhysics
@@ -33,10 +34,24 @@ public:
     // Sets the character's intended velocity in world space.
     void setDesiredVelocity(glm::vec3 velocity);
 
+    // Gets the radius of the character's collision capsule.
+    float getRadius() const;
+
+    // Sets the radius of the character's collision capsule.
+    void setRadius(float radius);
+
+    // Gets the character's collision capsule.
+    Capsule getCapsule() const;
+
+    // Pushes the character horizontally out of any bodies in a broadphase that it overlaps.
+    // Should be called after update(); bodies with an ID of "ignoreId" (such as the character's own entry) are skipped.
+    void resolveCollisions(const SpatialHash& broadphase, size_t ignoreId = SIZE_MAX);
+
 private:
     const World& world;
     float characterHeight { 1.0f };
     float swimmingHeight { 0.1f };
+    float radius { 0.25f };
 
     glm::vec3 position {};
     bool inAir { false };
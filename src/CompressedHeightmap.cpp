@@ -0,0 +1,430 @@
+#include "CompressedHeightmap.h"
+#include "hashBytes.h"
+
+using namespace glm;
+
+// Residuals with a unary quotient at least this long are written verbatim instead.
+static const unsigned int ESCAPE_LENGTH { 24 };
+
+// The number of bits needed to store any zig-zag encoded residual verbatim.
+static const unsigned int ESCAPE_BITS { 17 };
+
+// Predicts a pixel from its left, upper and upper-left neighbors using the median edge detector from LOCO-I.
+// Smooth terrain is predicted almost exactly, so the residuals are small.
+static int predict(const unsigned short* pixels, unsigned int width, unsigned int x, unsigned int y)
+{
+    if (x == 0 && y == 0)
+    {
+        return 0;
+    }
+    else if (y == 0)
+    {
+        return pixels[x - 1];
+    }
+    else if (x == 0)
+    {
+        return pixels[(y - 1) * width];
+    }
+    else
+    {
+        int a { pixels[y * width + x - 1] };
+        int b { pixels[(y - 1) * width + x] };
+        int c { pixels[(y - 1) * width + x - 1] };
+
+        if (c >= std::max(a, b))
+        {
+            return std::min(a, b);
+        }
+        else if (c <= std::min(a, b))
+        {
+            return std::max(a, b);
+        }
+        else
+        {
+            return a + b - c;
+        }
+    }
+}
+
+// Maps signed residuals to unsigned integers so that small magnitudes get small codes: 0, -1, 1, -2, 2, ...
+static uint32_t zigZag(int residual)
+{
+    return residual >= 0 ? static_cast<uint32_t>(residual) << 1 : (static_cast<uint32_t>(-residual) << 1) - 1;
+}
+
+static int unZigZag(uint32_t code)
+{
+    return (code & 1) ? -static_cast<int>((code + 1) >> 1) : static_cast<int>(code >> 1);
+}
+
+// Writes a stream of bits, least significant bit first.
+class BitWriter
+{
+public:
+    BitWriter(std::vector<uint8_t>& data)
+        : data { data }
+    {
+    }
+
+    void write(uint32_t bits, unsigned int count)
+    {
+        for (unsigned int i { 0 }; i < count; i++)
+        {
+            if (bitIndex == 0)
+            {
+                data.push_back(0);
+            }
+
+            data.back() |= ((bits >> i) & 1) << bitIndex;
+            bitIndex = (bitIndex + 1) % 8;
+        }
+    }
+
+private:
+    std::vector<uint8_t>& data;
+    unsigned int bitIndex { 0 };
+};
+
+// Reads a stream of bits written by BitWriter.  Reading past the end returns zeros.
+class BitReader
+{
+public:
+    BitReader(const std::vector<uint8_t>& data)
+        : data { data }
+    {
+    }
+
+    uint32_t read(unsigned int count)
+    {
+        uint32_t bits { 0 };
+        for (unsigned int i { 0 }; i < count; i++)
+        {
+            bits |= static_cast<uint32_t>(readBit()) << i;
+        }
+        return bits;
+    }
+
+    unsigned int readBit()
+    {
+        size_t byteIndex { position >> 3 };
+        unsigned int bit { byteIndex < data.size() ? (data[byteIndex] >> (position & 7)) & 1u : 0u };
+        position++;
+        return bit;
+    }
+
+private:
+    const std::vector<uint8_t>& data;
+    size_t position { 0 };
+};
+
+void CompressedHeightmap::compress(const ofShortPixels& heightmap, unsigned int tileSize, unsigned int cacheSize)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+
+    this->tileSize = tileSize;
+    size = uvec2(heightmap.getWidth(), heightmap.getHeight());
+    tileCount = (size + tileSize - 1u) / tileSize;
+    size_t channels { heightmap.getNumChannels() };
+
+    tiles.clear();
+    tiles.resize(static_cast<size_t>(tileCount.x) * tileCount.y);
+
+    std::vector<unsigned short> tilePixels(tileSize * tileSize);
+
+    for (unsigned int ty { 0 }; ty < tileCount.y; ty++)
+    {
+        for (unsigned int tx { 0 }; tx < tileCount.x; tx++)
+        {
+            uvec2 start { uvec2(tx, ty) * tileSize };
+            uvec2 extent { getTileExtent(uvec2(tx, ty)) };
+
+            // Gather the first channel of the tile's pixels.
+            for (unsigned int y { 0 }; y < extent.y; y++)
+            {
+                for (unsigned int x { 0 }; x < extent.x; x++)
+                {
+                    tilePixels[y * extent.x + x] = heightmap.getData()[((start.y + y) * size.x + start.x + x) * channels];
+                }
+            }
+
+            tiles[ty * tileCount.x + tx] = encodeTile(tilePixels.data(), extent);
+        }
+    }
+
+    cache.clear();
+    cache.resize(cacheSize);
+    cacheSlots.clear();
+    decodingTiles.clear();
+    useCounter = 0;
+    decodedTileCount = 0;
+    decodeSeconds = 0;
+}
+
+uvec2 CompressedHeightmap::getSize() const
+{
+    return size;
+}
+
+unsigned short CompressedHeightmap::getValue(unsigned int x, unsigned int y)
+{
+    uvec2 tileIndex { uvec2(x, y) / tileSize };
+    size_t index { tileIndex.y * tileCount.x + tileIndex.x };
+
+    if (tiles[index].data.empty())
+    {
+        return tiles[index].constantValue;
+    }
+    else
+    {
+        std::unique_lock<std::mutex> lock { mutex };
+        std::shared_ptr<const std::vector<unsigned short>> pixels { acquireTile(index, lock) };
+        return (*pixels)[(y % tileSize) * getTileExtent(tileIndex).x + (x % tileSize)];
+    }
+}
+
+void CompressedHeightmap::copyRegion(uvec2 start, uvec2 regionSize, ofShortPixels& region)
+{
+    region.allocate(regionSize.x, regionSize.y, OF_PIXELS_GRAY);
+
+    std::unique_lock<std::mutex> lock { mutex };
+
+    uvec2 end { start + regionSize }; // exclusive
+    uvec2 firstTile { start / tileSize };
+    uvec2 lastTile { (end - 1u) / tileSize };
+
+    for (unsigned int ty { firstTile.y }; ty <= lastTile.y; ty++)
+    {
+        for (unsigned int tx { firstTile.x }; tx <= lastTile.x; tx++)
+        {
+            size_t index { ty * tileCount.x + tx };
+            uvec2 tileStart { uvec2(tx, ty) * tileSize };
+            uvec2 extent { getTileExtent(uvec2(tx, ty)) };
+
+            // The part of the region that overlaps this tile, in heightmap pixel coordinates.
+            uvec2 overlapStart { max(start, tileStart) };
+            uvec2 overlapEnd { min(end, tileStart + extent) };
+
+            // Constant tiles never need to be decompressed.
+            std::shared_ptr<const std::vector<unsigned short>> pixels {};
+            if (!tiles[index].data.empty())
+            {
+                pixels = acquireTile(index, lock);
+            }
+
+            for (unsigned int y { overlapStart.y }; y < overlapEnd.y; y++)
+            {
+                unsigned short* dst { region.getData() + (y - start.y) * regionSize.x + (overlapStart.x - start.x) };
+
+                if (!pixels)
+                {
+                    std::fill(dst, dst + (overlapEnd.x - overlapStart.x), tiles[index].constantValue);
+                }
+                else
+                {
+                    const unsigned short* src { pixels->data() + (y - tileStart.y) * extent.x + (overlapStart.x - tileStart.x) };
+                    std::copy(src, src + (overlapEnd.x - overlapStart.x), dst);
+                }
+            }
+        }
+    }
+}
+
+size_t CompressedHeightmap::getResidentBytes() const
+{
+    std::lock_guard<std::mutex> lock { mutex };
+
+    size_t bytes { tiles.size() * sizeof(Tile) };
+    for (const Tile& tile : tiles)
+    {
+        bytes += tile.data.capacity();
+    }
+
+    for (const DecodedTile& decodedTile : cache)
+    {
+        bytes += sizeof(DecodedTile) + (decodedTile.pixels ? decodedTile.pixels->capacity() * sizeof(unsigned short) : 0);
+    }
+
+    return bytes;
+}
+
+size_t CompressedHeightmap::getRawBytes() const
+{
+    return static_cast<size_t>(size.x) * size.y * sizeof(unsigned short);
+}
+
+uint64_t CompressedHeightmap::computeHash() const
+{
+    uint64_t hash { hashBytes(&size, sizeof(size)) };
+    hash = hashBytes(&tileSize, sizeof(tileSize), hash);
+
+    for (const Tile& tile : tiles)
+    {
+        hash = hashBytes(tile.data.data(), tile.data.size(), hash);
+        hash = hashBytes(&tile.constantValue, sizeof(tile.constantValue), hash);
+        hash = hashBytes(&tile.riceParameter, sizeof(tile.riceParameter), hash);
+    }
+
+    return hash;
+}
+
+size_t CompressedHeightmap::getConstantTileCount() const
+{
+    return std::count_if(tiles.begin(), tiles.end(), [](const Tile& tile) { return tile.data.empty(); });
+}
+
+uint64_t CompressedHeightmap::getDecodedTileCount() const
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    return decodedTileCount;
+}
+
+double CompressedHeightmap::getDecodeSeconds() const
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    return decodeSeconds;
+}
+
+uvec2 CompressedHeightmap::getTileExtent(uvec2 tileIndex) const
+{
+    return min(uvec2(tileSize), size - tileIndex * tileSize);
+}
+
+std::shared_ptr<const std::vector<unsigned short>> CompressedHeightmap::acquireTile(size_t tileIndex, std::unique_lock<std::mutex>& lock)
+{
+    // If another thread is already decompressing the tile, wait for it rather than decompressing it twice.
+    tileDecoded.wait(lock, [this, tileIndex]() { return decodingTiles.count(tileIndex) == 0; });
+
+    useCounter++;
+
+    auto slot { cacheSlots.find(tileIndex) };
+    if (slot != cacheSlots.end())
+    {
+        cache[slot->second].lastUsed = useCounter;
+        return cache[slot->second].pixels;
+    }
+
+    // Decompress the tile without holding the lock, so that a cache miss doesn't stall every other thread reading cached tiles.
+    uvec2 extent { getTileExtent(uvec2(tileIndex % tileCount.x, tileIndex / tileCount.x)) };
+    decodingTiles.insert(tileIndex);
+    lock.unlock();
+
+    auto decodeStart { std::chrono::steady_clock::now() };
+    std::shared_ptr<std::vector<unsigned short>> pixels { std::make_shared<std::vector<unsigned short>>(extent.x * extent.y) };
+    decodeTile(tiles[tileIndex], extent, pixels->data());
+    double seconds { std::chrono::duration<double>(std::chrono::steady_clock::now() - decodeStart).count() };
+
+    lock.lock();
+    decodingTiles.erase(tileIndex);
+    decodeSeconds += seconds;
+    decodedTileCount++;
+
+    // Evict the least recently used slot; any thread still reading its tile keeps its own reference.
+    size_t lruSlot { 0 };
+    for (size_t i { 1 }; i < cache.size(); i++)
+    {
+        if (cache[i].lastUsed < cache[lruSlot].lastUsed)
+        {
+            lruSlot = i;
+        }
+    }
+
+    DecodedTile& decodedTile { cache[lruSlot] };
+    if (decodedTile.tileIndex != SIZE_MAX)
+    {
+        cacheSlots.erase(decodedTile.tileIndex);
+    }
+
+    decodedTile.pixels = pixels;
+    decodedTile.tileIndex = tileIndex;
+    decodedTile.lastUsed = ++useCounter;
+    cacheSlots[tileIndex] = lruSlot;
+
+    tileDecoded.notify_all();
+    return pixels;
+}
+
+CompressedHeightmap::Tile CompressedHeightmap::encodeTile(const unsigned short* pixels, uvec2 extent)
+{
+    Tile tile {};
+    size_t pixelCount { static_cast<size_t>(extent.x) * extent.y };
+
+    if (std::all_of(pixels, pixels + pixelCount, [pixels](unsigned short p) { return p == pixels[0]; }))
+    {
+        // Constant tile; no need to store anything else.
+        tile.constantValue = pixels[0];
+        return tile;
+    }
+
+    // Calculate the zig-zag encoded prediction residual for every pixel.
+    std::vector<uint32_t> codes(pixelCount);
+    for (unsigned int y { 0 }; y < extent.y; y++)
+    {
+        for (unsigned int x { 0 }; x < extent.x; x++)
+        {
+            codes[y * extent.x + x] = zigZag(pixels[y * extent.x + x] - predict(pixels, extent.x, x, y));
+        }
+    }
+
+    // Choose the Rice parameter that gives the smallest encoding.
+    size_t bestBits { SIZE_MAX };
+    for (unsigned int k { 0 }; k < ESCAPE_BITS; k++)
+    {
+        size_t bits { 0 };
+        for (uint32_t code : codes)
+        {
+            uint32_t quotient { code >> k };
+            bits += quotient < ESCAPE_LENGTH ? quotient + 1 + k : ESCAPE_LENGTH + ESCAPE_BITS;
+        }
+
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            tile.riceParameter = static_cast<uint8_t>(k);
+        }
+    }
+
+    // Write the residuals: the quotient in unary, followed by the remainder in binary.
+    tile.data.reserve((bestBits + 7) / 8);
+    BitWriter writer { tile.data };
+    for (uint32_t code : codes)
+    {
+        uint32_t quotient { code >> tile.riceParameter };
+        if (quotient < ESCAPE_LENGTH)
+        {
+            writer.write((1u << quotient) - 1, quotient + 1);
+            writer.write(code, tile.riceParameter);
+        }
+        else
+        {
+            writer.write((1u << ESCAPE_LENGTH) - 1, ESCAPE_LENGTH);
+            writer.write(code, ESCAPE_BITS);
+        }
+    }
+
+    tile.data.shrink_to_fit();
+    return tile;
+}
+
+void CompressedHeightmap::decodeTile(const Tile& tile, uvec2 extent, unsigned short* pixels)
+{
+    BitReader reader { tile.data };
+
+    for (unsigned int y { 0 }; y < extent.y; y++)
+    {
+        for (unsigned int x { 0 }; x < extent.x; x++)
+        {
+            // Count the unary quotient.
+            uint32_t quotient { 0 };
+            while (quotient < ESCAPE_LENGTH && reader.readBit())
+            {
+                quotient++;
+            }
+
+            uint32_t code { quotient < ESCAPE_LENGTH
+                ? (quotient << tile.riceParameter) | reader.read(tile.riceParameter)
+                : reader.read(ESCAPE_BITS) };
+
+            pixels[y * extent.x + x] = static_cast<unsigned short>(predict(pixels, extent.x, x, y) + unZigZag(code));
+        }
+    }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "ofMain.h"
+#include <condition_variable>
+#include <unordered_set>
+
+// A heightmap stored in memory as compressed, fixed-size tiles.
+// Each tile is delta-predicted from its neighboring pixels and the residuals are Rice-coded;
+// tiles where every pixel has the same value (such as open ocean) are collapsed to that single value.
+// Tiles are decompressed on demand into a small least-recently-used cache.
+class CompressedHeightmap
+{
+public:
+    CompressedHeightmap() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    CompressedHeightmap(const CompressedHeightmap& c) = delete;
+    CompressedHeightmap& operator= (const CompressedHeightmap& c) = delete;
+
+    // Compresses a heightmap (only the first channel is kept).
+    // "tileSize" is the size of each tile in pixels; "cacheSize" is the number of decompressed tiles to keep in memory.
+    void compress(const ofShortPixels& heightmap, unsigned int tileSize = 64, unsigned int cacheSize = 256);
+
+    // Gets the dimensions (in pixels) of the entire heightmap.
+    glm::uvec2 getSize() const;
+
+    // Gets the value of a single heightmap pixel, decompressing the tile containing it if necessary.
+    unsigned short getValue(unsigned int x, unsigned int y);
+
+    // Copies a rectangle of the heightmap into a single-channel pixel array.
+    void copyRegion(glm::uvec2 start, glm::uvec2 regionSize, ofShortPixels& region);
+
+    // Gets the number of bytes of compressed tile data, plus the decompressed tiles currently in the cache.
+    size_t getResidentBytes() const;
+
+    // Gets the number of bytes the same heightmap would take as raw 16-bit samples.
+    size_t getRawBytes() const;
+
+    // Computes a hash identifying the contents of the heightmap, from the compressed tiles.
+    uint64_t computeHash() const;
+
+    // Gets the number of tiles that were collapsed to a single value.
+    size_t getConstantTileCount() const;
+
+    // Gets the number of tiles that have been decompressed since the heightmap was compressed.
+    uint64_t getDecodedTileCount() const;
+
+    // Gets the total time (in seconds) spent decompressing tiles since the heightmap was compressed.
+    double getDecodeSeconds() const;
+
+private:
+    // The compressed representation of a single tile.
+    struct Tile
+    {
+        // The Rice-coded prediction residuals; empty if the tile is constant.
+        std::vector<uint8_t> data {};
+
+        // The value of every pixel in a constant tile.
+        unsigned short constantValue { 0 };
+
+        // The Rice parameter (number of low bits stored verbatim) used to code the residuals.
+        uint8_t riceParameter { 0 };
+    };
+
+    // A decompressed tile in the cache.
+    struct DecodedTile
+    {
+        // The decompressed pixels, in row-major order; null if the slot is unused.  Shared, so that a tile evicted while another thread
+        // is reading it stays alive until that thread is done.
+        std::shared_ptr<const std::vector<unsigned short>> pixels {};
+
+        // The index of the tile that was decompressed into this slot.
+        size_t tileIndex { SIZE_MAX };
+
+        // The value of the usage counter the last time this slot was accessed; used for LRU eviction.
+        uint64_t lastUsed { 0 };
+    };
+
+    // The dimensions (in pixels) of the entire heightmap.
+    glm::uvec2 size { 0 };
+
+    // The size (in pixels) of each tile; tiles on the right and bottom edges may be smaller.
+    unsigned int tileSize { 0 };
+
+    // The number of tiles in each dimension.
+    glm::uvec2 tileCount { 0 };
+
+    // Every compressed tile, stored in row-major order.
+    std::vector<Tile> tiles {};
+
+    // The cache of decompressed tiles.
+    std::vector<DecodedTile> cache {};
+
+    // Maps a tile index to its slot in the cache, for tiles that are currently decompressed.
+    std::unordered_map<size_t, size_t> cacheSlots {};
+
+    // Incremented every time a decompressed tile is accessed.
+    uint64_t useCounter { 0 };
+
+    // Statistics on decompression cost.
+    uint64_t decodedTileCount { 0 };
+    double decodeSeconds { 0 };
+
+    // The tiles currently being decompressed by some thread (without holding the mutex).
+    std::unordered_set<size_t> decodingTiles {};
+
+    // Guards the cache; tiles may be requested from several threads.
+    mutable std::mutex mutex {};
+
+    // Signalled whenever a tile finishes decompressing.
+    std::condition_variable tileDecoded {};
+
+    // Gets the dimensions (in pixels) of a particular tile.
+    glm::uvec2 getTileExtent(glm::uvec2 tileIndex) const;
+
+    // Gets the decompressed pixels of a non-constant tile, decompressing it if necessary.  The mutex must be held by the caller through the lock;
+    // it's released while the tile is decompressed, so other threads can use cached tiles in the meantime,
+    // and a thread that wants a tile someone else is already decompressing waits for it instead of decompressing it again.
+    std::shared_ptr<const std::vector<unsigned short>> acquireTile(size_t tileIndex, std::unique_lock<std::mutex>& lock);
+
+    // Compresses a single tile of pixels.
+    static Tile encodeTile(const unsigned short* pixels, glm::uvec2 extent);
+
+    // Decompresses a single tile of pixels.
+    static void decodeTile(const Tile& tile, glm::uvec2 extent, unsigned short* pixels);
+};
@@ -0,0 +1,153 @@
+#include "DynamicResolution.h"
+
+using namespace glm;
+
+// How quickly the smoothed GPU time follows new measurements.
+static const float SMOOTHING { 0.25f };
+
+void DynamicResolution::setSettings(const Settings& settings)
+{
+    this->settings = settings;
+    setScale(scale);
+}
+
+void DynamicResolution::begin()
+{
+    if (queries[0][0] == 0)
+    {
+        glGenQueries(2 * FRAME_LATENCY, &queries[0][0]);
+    }
+
+    // The oldest frame in the ring is the one the GPU has had longest to finish.
+    currentFrame = (currentFrame + 1) % FRAME_LATENCY;
+    measure();
+
+    // Allocate the framebuffer at the window's full size (in pixels, from the default viewport), so that changing the scale never reallocates it.
+    uvec2 newWindowSize { static_cast<unsigned int>(ofGetViewportWidth()), static_cast<unsigned int>(ofGetViewportHeight()) };
+    if (!fbo.isAllocated() || newWindowSize != windowSize)
+    {
+        windowSize = newWindowSize;
+
+        ofFbo::Settings fboSettings {};
+        fboSettings.width = static_cast<int>(windowSize.x);
+        fboSettings.height = static_cast<int>(windowSize.y);
+        fboSettings.internalformat = GL_RGBA8;
+        fboSettings.useDepth = true;
+        fboSettings.textureTarget = GL_TEXTURE_2D;
+        fboSettings.minFilter = GL_LINEAR;
+        fboSettings.maxFilter = GL_LINEAR;
+        fbo.allocate(fboSettings);
+    }
+
+    renderSize = max(uvec2(round(vec2(windowSize) * scale)), uvec2(1));
+
+    glQueryCounter(queries[currentFrame][0], GL_TIMESTAMP);
+
+    // Only the bottom-left corner of the framebuffer is drawn to.
+    fbo.begin();
+    ofViewport(0, 0, static_cast<float>(renderSize.x), static_cast<float>(renderSize.y), false);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DynamicResolution::end()
+{
+    fbo.end();
+
+    glQueryCounter(queries[currentFrame][1], GL_TIMESTAMP);
+    queriesPending[currentFrame] = true;
+
+    // Stretch the scene over the window with bilinear filtering, which costs next to nothing.
+    GLint drawFramebuffer { 0 };
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo.getId());
+    glBlitFramebuffer(0, 0, renderSize.x, renderSize.y, 0, 0, windowSize.x, windowSize.y, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFramebuffer);
+}
+
+float DynamicResolution::getScale() const
+{
+    return scale;
+}
+
+uvec2 DynamicResolution::getRenderSize() const
+{
+    return renderSize;
+}
+
+float DynamicResolution::getGPUMilliseconds() const
+{
+    return gpuMilliseconds;
+}
+
+void DynamicResolution::clear()
+{
+    if (queries[0][0] != 0)
+    {
+        glDeleteQueries(2 * FRAME_LATENCY, &queries[0][0]);
+        std::fill(&queries[0][0], &queries[0][0] + 2 * FRAME_LATENCY, 0);
+    }
+
+    std::fill(queriesPending, queriesPending + FRAME_LATENCY, false);
+    fbo.clear();
+}
+
+void DynamicResolution::measure()
+{
+    if (!queriesPending[currentFrame])
+    {
+        return;
+    }
+
+    queriesPending[currentFrame] = false;
+
+    // Never wait on the GPU; if the end of the frame still isn't done, skip the measurement.
+    GLuint available { 0 };
+    glGetQueryObjectuiv(queries[currentFrame][1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        return;
+    }
+
+    GLuint64 startTime { 0 };
+    GLuint64 endTime { 0 };
+    glGetQueryObjectui64v(queries[currentFrame][0], GL_QUERY_RESULT, &startTime);
+    glGetQueryObjectui64v(queries[currentFrame][1], GL_QUERY_RESULT, &endTime);
+    float milliseconds { (endTime - startTime) * 1.0e-6f };
+
+    gpuMilliseconds = gpuMilliseconds == 0 ? milliseconds : mix(gpuMilliseconds, milliseconds, SMOOTHING);
+
+    if (cooldown > 0)
+    {
+        // The last change hasn't fully shown up in the measurements yet.
+        cooldown--;
+        return;
+    }
+
+    framesOver = gpuMilliseconds > settings.targetMilliseconds ? framesOver + 1 : 0;
+    framesUnder = gpuMilliseconds < settings.targetMilliseconds * settings.headroom ? framesUnder + 1 : 0;
+
+    if (framesOver >= settings.framesToLower)
+    {
+        // The cost is roughly proportional to the number of pixels, so scale each axis by the square root of the overshoot.
+        setScale(glm::min(scale - settings.scaleStep, scale * sqrt(settings.targetMilliseconds / gpuMilliseconds)));
+    }
+    else if (framesUnder >= settings.framesToRaise)
+    {
+        // Creep back up one step at a time.
+        setScale(scale + settings.scaleStep);
+    }
+}
+
+void DynamicResolution::setScale(float newScale)
+{
+    newScale = clamp(round(newScale / settings.scaleStep) * settings.scaleStep, settings.minScale, settings.maxScale);
+
+    if (newScale != scale)
+    {
+        scale = newScale;
+        cooldown = settings.cooldownFrames;
+    }
+
+    framesOver = 0;
+    framesUnder = 0;
+}
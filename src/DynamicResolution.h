@@ -0,0 +1,107 @@
+#pragma once
+#include "ofMain.h"
+
+// Renders the scene into an offscreen framebuffer at a fraction of the window's resolution, adjusting the fraction every frame
+// to keep the GPU time of the scene near a target, and stretches the result over the window with a bilinear blit.
+// The GPU time is measured with a pair of timestamp queries per frame (which, unlike GL_TIME_ELAPSED queries, don't conflict with
+// any timer scopes inside the scene), read a few frames later so that nothing stalls.
+// To stop the resolution from oscillating, it's only lowered after the GPU has been over budget for several frames in a row,
+// only raised after it has had plenty of headroom for much longer, and left alone for a while after each change.
+class DynamicResolution
+{
+public:
+    // Controls how the resolution follows the frame time.
+    struct Settings
+    {
+        // The GPU time to aim for, in milliseconds.
+        float targetMilliseconds { 1000.0f / 60.0f };
+
+        // The range of resolution scales (along each axis).
+        float minScale { 0.5f };
+        float maxScale { 1.0f };
+
+        // Scales are rounded to multiples of this, so that small changes in frame time don't change the resolution.
+        float scaleStep { 0.05f };
+
+        // The fraction of the target below which there's enough headroom to raise the resolution.
+        float headroom { 0.8f };
+
+        // The number of frames in a row that must be over the target before the resolution is lowered, and under the headroom before it's raised.
+        unsigned int framesToLower { 6 };
+        unsigned int framesToRaise { 60 };
+
+        // The number of frames to wait after a change (for its effect to show up in the measurements) before considering another.
+        unsigned int cooldownFrames { 10 };
+    };
+
+    // The number of frames in flight; the timestamps from a frame are read this many frames later.
+    const static unsigned int FRAME_LATENCY { 3 };
+
+    DynamicResolution() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    DynamicResolution(const DynamicResolution& d) = delete;
+    DynamicResolution& operator= (const DynamicResolution& d) = delete;
+
+    // Sets how the resolution follows the frame time.
+    void setSettings(const Settings& settings);
+
+    // Starts rendering the scene: reads the GPU time of an earlier frame, adjusts the scale, and binds the offscreen framebuffer
+    // with its viewport set to the scaled resolution (so ofGetViewportWidth() and ofGetViewportHeight() return the scaled size).
+    // The color and depth buffers are cleared.  Must be called with a GL context, from your ofApp::draw() function.
+    void begin();
+
+    // Finishes rendering the scene and stretches it over the window.
+    void end();
+
+    // Gets the current resolution scale along each axis.
+    float getScale() const;
+
+    // Gets the current size of the scene, in pixels.
+    glm::uvec2 getRenderSize() const;
+
+    // Gets the smoothed GPU time of the scene, in milliseconds.
+    float getGPUMilliseconds() const;
+
+    // Deletes the GL queries and the framebuffer.  Must be called with a GL context (e.g. from your ofApp::exit() function).
+    void clear();
+
+private:
+    // The offscreen framebuffer, allocated at the window's full size.
+    ofFbo fbo {};
+
+    // The settings.
+    Settings settings {};
+
+    // The current resolution scale.
+    float scale { 1.0f };
+
+    // The size of the window and of the scaled scene this frame.
+    glm::uvec2 windowSize {};
+    glm::uvec2 renderSize {};
+
+    // A pair of timestamp queries (start and end of the scene) for each frame in flight.
+    GLuint queries[FRAME_LATENCY][2] {};
+
+    // True for each frame in flight whose queries have been issued but not read.
+    bool queriesPending[FRAME_LATENCY] {};
+
+    // The frame currently being timed.
+    unsigned int currentFrame { 0 };
+
+    // The smoothed GPU time of the scene, in milliseconds (zero until the first measurement).
+    float gpuMilliseconds { 0 };
+
+    // The number of frames in a row that have been over the target, or under the headroom.
+    unsigned int framesOver { 0 };
+    unsigned int framesUnder { 0 };
+
+    // The number of frames left before the scale can change again.
+    unsigned int cooldown { 0 };
+
+    // Reads the timestamps of the oldest frame in flight, if the GPU has finished with them, and adjusts the scale.
+    void measure();
+
+    // Changes the scale, rounded to a step and clamped to the range, and starts the cooldown.
+    void setScale(float newScale);
+};
@@ -0,0 +1,198 @@
+#include "FarImpostor.h"
+
+using namespace glm;
+
+// The direction each cubemap face looks in and its up vector, in GL's face order (+X, -X, +Y, -Y, +Z, -Z),
+// oriented so that each face's image lines up with the way the GPU looks up cubemaps.
+static const vec3 FACE_DIRECTIONS[6] { vec3(1, 0, 0), vec3(-1, 0, 0), vec3(0, 1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1) };
+static const vec3 FACE_UPS[6] { vec3(0, -1, 0), vec3(0, -1, 0), vec3(0, 0, 1), vec3(0, 0, -1), vec3(0, -1, 0), vec3(0, -1, 0) };
+
+void FarImpostor::setSettings(const Settings& settings)
+{
+    if (settings.faceResolution != this->settings.faceResolution)
+    {
+        // The cubemaps will be reallocated at the new size.
+        clear();
+    }
+
+    this->settings = settings;
+}
+
+void FarImpostor::renderFaces(vec3 cameraPosition, float nearPlane, float farPlane, const std::function<void(const CameraMatrices&)>& drawScene)
+{
+    if (!capturing && (!ready || invalidated || distance(cameraPosition, captures[front].center) > settings.updateDistance))
+    {
+        Capture& capture { captures[1 - front] };
+        capture.center = cameraPosition;
+        capture.nearPlane = nearPlane;
+        capture.farPlane = farPlane;
+        capturing = true;
+        invalidated = false;
+        nextFace = 0;
+    }
+
+    if (!capturing)
+    {
+        return;
+    }
+
+    if (framebuffer == 0)
+    {
+        allocate();
+    }
+
+    Capture& capture { captures[1 - front] };
+
+    // Save the state that rendering the faces changes.
+    GLint drawFramebuffer { 0 };
+    GLint readFramebuffer { 0 };
+    GLint viewport[4] {};
+    GLfloat clearColor[4] {};
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFramebuffer);
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glViewport(0, 0, static_cast<GLsizei>(settings.faceResolution), static_cast<GLsizei>(settings.faceResolution));
+    glClearColor(0, 0, 0, 0);
+
+    // Blend the color as usual, but accumulate coverage in alpha, so the faces end up premultiplied over a transparent background.
+    glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Render every face straight away the first time, so there's something to draw.
+    unsigned int faceCount { ready ? std::max(1u, settings.facesPerFrame) : 6u };
+    for (unsigned int i { 0 }; i < faceCount && nextFace < 6; i++, nextFace++)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + nextFace, capture.colorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_CUBE_MAP_POSITIVE_X + nextFace, capture.depthTexture, 0);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+        Camera faceCamera {};
+        faceCamera.position = capture.center;
+        faceCamera.rotation = transpose(mat3(lookAt(vec3(0), FACE_DIRECTIONS[nextFace], FACE_UPS[nextFace])));
+        faceCamera.fov = radians(90.0f);
+
+        drawScene(CameraMatrices { faceCamera, 1.0f, capture.nearPlane, capture.farPlane });
+        facesRendered++;
+    }
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFramebuffer);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    if (nextFace == 6)
+    {
+        // The new capture is complete; start drawing it.
+        front = 1 - front;
+        ready = true;
+        capturing = false;
+    }
+}
+
+bool FarImpostor::isReady() const
+{
+    return ready;
+}
+
+void FarImpostor::invalidate()
+{
+    invalidated = true;
+}
+
+void FarImpostor::draw(ShaderProgram& shader, const ofMesh& cubeMesh, vec3 cameraPosition) const
+{
+    const Capture& capture { captures[front] };
+
+    // The faces are premultiplied, and drawn over everything at infinity like the skybox.
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+    shader.begin();
+    shader.setUniformTexture("impostorColor", GL_TEXTURE_CUBE_MAP, static_cast<int>(capture.colorTexture), 0);
+    shader.setUniformTexture("impostorDepth", GL_TEXTURE_CUBE_MAP, static_cast<int>(capture.depthTexture), 1);
+    shader.setUniform3f("cameraOffset", cameraPosition - capture.center);
+    shader.setUniform1f("nearPlane", capture.nearPlane);
+    shader.setUniform1f("farPlane", capture.farPlane);
+    cubeMesh.draw();
+    shader.end();
+
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+    glEnable(GL_CULL_FACE);
+}
+
+uint64_t FarImpostor::getFacesRendered() const
+{
+    return facesRendered;
+}
+
+void FarImpostor::clear()
+{
+    for (Capture& capture : captures)
+    {
+        if (capture.colorTexture != 0)
+        {
+            glDeleteTextures(1, &capture.colorTexture);
+            glDeleteTextures(1, &capture.depthTexture);
+        }
+
+        capture = Capture {};
+    }
+
+    if (framebuffer != 0)
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+
+    ready = false;
+    capturing = false;
+}
+
+void FarImpostor::allocate()
+{
+    // Filter across the seams between faces.
+    glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+
+    for (Capture& capture : captures)
+    {
+        glGenTextures(1, &capture.colorTexture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, capture.colorTexture);
+        for (unsigned int face { 0 }; face < 6; face++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_RGBA8, settings.faceResolution, settings.faceResolution, 0,
+                GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        }
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        // The depth is read back as a plain value (not compared), and isn't filtered, so that edges don't blend near and far distances.
+        glGenTextures(1, &capture.depthTexture);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, capture.depthTexture);
+        for (unsigned int face { 0 }; face < 6; face++)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, 0, GL_DEPTH_COMPONENT24, settings.faceResolution, settings.faceResolution, 0,
+                GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+        }
+
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    }
+
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    glGenFramebuffers(1, &framebuffer);
+
+    cout << "Far impostor: " << 2 * 6 * settings.faceResolution * settings.faceResolution * 8 / (1024.0 * 1024.0) << " MB of cubemaps" << endl;
+}
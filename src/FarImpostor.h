@@ -0,0 +1,107 @@
+#pragma once
+#include "ofMain.h"
+#include "CameraMatrices.h"
+#include "ShaderProgram.h"
+
+// Stands in for the distant terrain and water with a cubemap captured around the camera, so that most frames draw a single cube
+// instead of every far cell.  The capture is only redone once the camera has moved a certain distance from where it was taken,
+// and then a face or so at a time into a second cubemap, which replaces the first once all six faces are done.
+// Each face keeps its depth as well as its color, so that when the impostor is drawn from a camera that has moved off the
+// capture point, the lookup can be shifted to the point the camera actually sees; the parallax is then only wrong
+// where the capture couldn't see (behind ridges, for instance), which the near terrain mostly covers anyway.
+// The color is stored premultiplied by alpha, so terrain that fades out towards the far plane blends over the skybox as before.
+class FarImpostor
+{
+public:
+    // Controls the resolution of the impostor and how often it's recaptured.
+    struct Settings
+    {
+        // The size (in pixels) of each face.
+        unsigned int faceResolution { 1024 };
+
+        // How far (in world units) the camera can move from the capture point before a new capture is started.
+        float updateDistance { 16.0f };
+
+        // The number of faces rendered per frame while a new capture is under way (the very first capture renders all six at once).
+        unsigned int facesPerFrame { 1 };
+    };
+
+    FarImpostor() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    FarImpostor(const FarImpostor& f) = delete;
+    FarImpostor& operator= (const FarImpostor& f) = delete;
+
+    // Sets the resolution and update settings.  The cubemaps are only allocated the first time faces are rendered,
+    // so an impostor that's never used costs no memory.
+    void setSettings(const Settings& settings);
+
+    // Starts a new capture around the camera if it has moved far enough from the last one (or the impostor has been invalidated),
+    // then renders the next faces of the capture under way, if any.  "drawScene" is called for each face with its camera
+    // (at the capture point, looking along the face's axis with a 90 degree field of view, clipped to the given planes)
+    // and should draw the distant terrain and water.  The framebuffer, viewport, blending and clear color are restored afterwards.
+    // Must be called with a GL context, from your ofApp::draw() function.
+    void renderFaces(glm::vec3 cameraPosition, float nearPlane, float farPlane, const std::function<void(const CameraMatrices&)>& drawScene);
+
+    // Returns true once a complete capture is available to draw.
+    bool isReady() const;
+
+    // Forces a new capture (when the terrain's appearance has changed, for instance); the current one is drawn until it's replaced.
+    void invalidate();
+
+    // Draws the latest complete capture around the camera, over whatever has been drawn (without depth testing).
+    // The shader should be skybox.vert with far_impostor.frag, and the camera block should hold the far pass's camera.
+    void draw(ShaderProgram& shader, const ofMesh& cubeMesh, glm::vec3 cameraPosition) const;
+
+    // Gets the number of faces rendered since the impostor was created.
+    uint64_t getFacesRendered() const;
+
+    // Deletes the cubemaps and the framebuffer.  Must be called with a GL context (e.g. from your ofApp::exit() function).
+    void clear();
+
+private:
+    // A cubemap captured around a single point.
+    struct Capture
+    {
+        // The color and depth cubemaps.
+        GLuint colorTexture { 0 };
+        GLuint depthTexture { 0 };
+
+        // The point the faces were rendered from.
+        glm::vec3 center {};
+
+        // The clipping planes the faces were rendered with, for turning the depth back into a distance.
+        float nearPlane { 0 };
+        float farPlane { 0 };
+    };
+
+    // The settings.
+    Settings settings {};
+
+    // The capture being drawn and the one being rendered.
+    Capture captures[2] {};
+
+    // The index of the capture being drawn.
+    unsigned int front { 0 };
+
+    // The framebuffer the faces are rendered through.
+    GLuint framebuffer { 0 };
+
+    // True once the front capture is complete.
+    bool ready { false };
+
+    // True while the back capture is being rendered.
+    bool capturing { false };
+
+    // Set to true to start a new capture regardless of how far the camera has moved.
+    bool invalidated { false };
+
+    // The next face of the back capture to render.
+    unsigned int nextFace { 0 };
+
+    // The number of faces rendered so far.
+    uint64_t facesRendered { 0 };
+
+    // Allocates the cubemaps and the framebuffer.
+    void allocate();
+};
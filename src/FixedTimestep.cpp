@@ -0,0 +1,36 @@
+#include "FixedTimestep.h"
+
+FixedTimestep::FixedTimestep(float stepDuration, unsigned int maxSubsteps)
+    : stepDuration { stepDuration }, maxSubsteps { maxSubsteps }
+{
+}
+
+unsigned int FixedTimestep::advance(float frameTime)
+{
+    accumulator += frameTime;
+
+    unsigned int steps { 0 };
+    while (accumulator >= stepDuration && steps < maxSubsteps)
+    {
+        accumulator -= stepDuration;
+        steps++;
+    }
+
+    if (steps == maxSubsteps && accumulator >= stepDuration)
+    {
+        // Too far behind; drop the time that can't be simulated this frame rather than trying to catch up later.
+        accumulator = 0;
+    }
+
+    return steps;
+}
+
+float FixedTimestep::getStepDuration() const
+{
+    return stepDuration;
+}
+
+float FixedTimestep::getInterpolationAlpha() const
+{
+    return accumulator / stepDuration;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+// Drives a simulation at a fixed rate, independent of the rendering frame rate.
+// Real elapsed time is accumulated each frame and consumed in whole steps of a fixed duration;
+// the time left over is used to interpolate between the last two simulated states when rendering.
+class FixedTimestep
+{
+public:
+    // "stepDuration" is the duration of a single simulation step (in seconds).
+    // "maxSubsteps" is the most steps that will be run in a single frame; any time beyond that is dropped,
+    // so that a long frame (such as a loading hitch) can't cause the simulation to fall further and further behind.
+    FixedTimestep(float stepDuration, unsigned int maxSubsteps);
+
+    // Adds the real time elapsed since the last frame and returns the number of simulation steps that should be run this frame.
+    unsigned int advance(float frameTime);
+
+    // Gets the duration of a single simulation step (in seconds).
+    float getStepDuration() const;
+
+    // Gets how far (from 0 to 1) the current time is between the last simulated state and the next one.
+    // Render state should be interpolated as mix(previousState, currentState, alpha).
+    float getInterpolationAlpha() const;
+
+private:
+    float stepDuration;
+    unsigned int maxSubsteps;
+
+    // The real time that has elapsed but not yet been simulated.
+    float accumulator { 0 };
+};
@@ -0,0 +1,228 @@
+#include "GPUTerrain.h"
+
+using namespace glm;
+
+GPUTerrain::GPUTerrain(const World& world, unsigned int cellSize, unsigned int cellPairsPerDimension)
+    : world { world }, cellSize { cellSize }, cellsPerDimension { 2 * cellPairsPerDimension }
+{
+}
+
+void GPUTerrain::initializeForPosition(vec3 position)
+{
+    buildPatch();
+    buildTessellationPatches();
+
+    // Center the window on the position, as CellManager does.
+    loadWindow(ivec2(round(getPositionInCells(position))) - ivec2(cellsPerDimension / 2));
+}
+
+void GPUTerrain::optimizeForPosition(vec3 position)
+{
+    // Like CellManager, allow the position to wander up to a cell before moving the window, so that it doesn't move back and forth.
+    ivec2 minStartCell { ivec2(ceil(getPositionInCells(position))) - ivec2(cellsPerDimension / 2) };
+    ivec2 newStartCell { clamp(windowStartCell, minStartCell, minStartCell + 1) };
+
+    if (newStartCell != windowStartCell)
+    {
+        loadWindow(newStartCell);
+    }
+}
+
+void GPUTerrain::draw(ShaderProgram& shader, int heightmapTextureLocation)
+{
+    if (cellOffsets.empty())
+    {
+        return;
+    }
+
+    uvec2 heightmapSize { world.getHeightmapSize() };
+
+    shader.setUniformTexture("heightmapTex", heightmapTexture, heightmapTextureLocation);
+    shader.setUniform2i("textureOrigin", textureOrigin.x, textureOrigin.y);
+    shader.setUniform2i("heightmapMax", heightmapSize.x - 1, heightmapSize.y - 1);
+    shader.setUniform3f("scale", world.dimensions / vec3(heightmapSize.x - 1, 1, heightmapSize.y - 1));
+
+    patch.drawElementsInstanced(GL_TRIANGLES, patchIndexCount, static_cast<int>(cellOffsets.size()));
+}
+
+void GPUTerrain::drawTessellated(ShaderProgram& shader, int heightmapTextureLocation, float targetTriangleSize)
+{
+    if (cellOffsets.empty())
+    {
+        return;
+    }
+
+    uvec2 heightmapSize { world.getHeightmapSize() };
+
+    shader.setUniformTexture("heightmapTex", heightmapTexture, heightmapTextureLocation);
+    shader.setUniform2i("textureOrigin", textureOrigin.x, textureOrigin.y);
+    shader.setUniform2i("heightmapMax", heightmapSize.x - 1, heightmapSize.y - 1);
+    shader.setUniform3f("scale", world.dimensions / vec3(heightmapSize.x - 1, 1, heightmapSize.y - 1));
+    shader.setUniform1f("targetTriangleSize", targetTriangleSize);
+    shader.setUniform1f("maxTessLevel", static_cast<float>(TESSELLATION_PATCH_SIZE));
+
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    tessellationPatches.drawInstanced(GL_PATCHES, 0, tessellationVertexCount, static_cast<int>(cellOffsets.size()));
+}
+
+bool GPUTerrain::isTessellationSupported()
+{
+    // Tessellation shaders are core in OpenGL 4.0, and available as an extension on some older drivers.
+    GLint majorVersion { 0 };
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    return majorVersion >= 4 || ofGLCheckExtension("GL_ARB_tessellation_shader");
+}
+
+size_t GPUTerrain::getGeometryBytes() const
+{
+    return (cellSize + 1) * (cellSize + 1) * sizeof(vec3) + patchIndexCount * sizeof(ofIndexType) + cellOffsets.size() * sizeof(vec2);
+}
+
+size_t GPUTerrain::getTessellationGeometryBytes() const
+{
+    return tessellationVertexCount * sizeof(vec3) + cellOffsets.size() * sizeof(vec2);
+}
+
+size_t GPUTerrain::getTextureBytes() const
+{
+    return static_cast<size_t>(heightmapTexture.getWidth() * heightmapTexture.getHeight()) * sizeof(unsigned short);
+}
+
+unsigned int GPUTerrain::getCellCount() const
+{
+    return static_cast<unsigned int>(cellOffsets.size());
+}
+
+void GPUTerrain::buildPatch()
+{
+    std::vector<vec3> vertices {};
+    std::vector<ofIndexType> indices {};
+
+    // Vertices are laid out in columns, in the same order as buildTerrainMesh().
+    for (unsigned int x { 0 }; x <= cellSize; x++)
+    {
+        for (unsigned int y { 0 }; y <= cellSize; y++)
+        {
+            vertices.push_back(vec3(x, 0, y));
+        }
+    }
+
+    // Use the same alternating triangulation as buildTerrainMesh() so that both modes produce the same surface.
+    unsigned int k { 0 }; // k stores the index of the first corner of the quad.
+    unsigned int columnSize { cellSize + 1 };
+    for (unsigned int x { 0 }; x < cellSize; x++)
+    {
+        for (unsigned int y { 0 }; y < cellSize; y++)
+        {
+            if (k % 2)
+            {
+                indices.insert(indices.end(), { k, k + 1, k + columnSize, k + columnSize, k + 1, k + columnSize + 1 });
+            }
+            else
+            {
+                indices.insert(indices.end(), { k + 1, k + columnSize + 1, k + columnSize, k + columnSize, k, k + 1 });
+            }
+
+            k++; // Advance k to the next vertex in the "column."
+        }
+
+        // Skip past the final vertex of the column.
+        k++;
+    }
+
+    patch.setVertexData(vertices.data(), static_cast<int>(vertices.size()), GL_STATIC_DRAW);
+    patch.setIndexData(indices.data(), static_cast<int>(indices.size()), GL_STATIC_DRAW);
+    patchIndexCount = static_cast<unsigned int>(indices.size());
+}
+
+void GPUTerrain::buildTessellationPatches()
+{
+    std::vector<vec3> vertices {};
+
+    // Each patch is a quad of four corners in the order the evaluation shader expects: (0, 0), (1, 0), (1, 1), (0, 1) in (x, z).
+    for (unsigned int x { 0 }; x < cellSize; x += TESSELLATION_PATCH_SIZE)
+    {
+        for (unsigned int y { 0 }; y < cellSize; y += TESSELLATION_PATCH_SIZE)
+        {
+            unsigned int x2 { std::min(x + TESSELLATION_PATCH_SIZE, cellSize) };
+            unsigned int y2 { std::min(y + TESSELLATION_PATCH_SIZE, cellSize) };
+            vertices.insert(vertices.end(), { vec3(x, 0, y), vec3(x2, 0, y), vec3(x2, 0, y2), vec3(x, 0, y2) });
+        }
+    }
+
+    tessellationPatches.setVertexData(vertices.data(), static_cast<int>(vertices.size()), GL_STATIC_DRAW);
+    tessellationVertexCount = static_cast<unsigned int>(vertices.size());
+}
+
+void GPUTerrain::loadWindow(ivec2 startCell)
+{
+    windowStartCell = startCell;
+
+    ivec2 heightmapMax { ivec2(world.getHeightmapSize()) - 1 };
+
+    // The pixels covered by the window, plus a one pixel border for the normals along the edges, clamped to the heightmap.
+    ivec2 windowStart { startCell * static_cast<int>(cellSize) };
+    ivec2 windowEnd { windowStart + static_cast<int>(cellsPerDimension * cellSize) };
+    uvec2 regionStart { clamp(windowStart - 1, ivec2(0), heightmapMax) };
+    uvec2 regionEnd { clamp(windowEnd + 1, ivec2(regionStart), heightmapMax) };
+    uvec2 regionSize { regionEnd - regionStart + 1u };
+
+    world.copyHeightmapRegion(regionStart, regionSize, windowPixels);
+
+    if (!heightmapTexture.isAllocated()
+        || heightmapTexture.getWidth() != regionSize.x || heightmapTexture.getHeight() != regionSize.y)
+    {
+        heightmapTexture.allocate(regionSize.x, regionSize.y, GL_R16);
+
+        // Heights are fetched texel by texel; never filter them.
+        heightmapTexture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+        heightmapTexture.setTextureWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+    }
+
+    heightmapTexture.loadData(windowPixels);
+    textureOrigin = regionStart;
+
+    // Draw an instance of the patch for every cell in the window that's on the heightmap.
+    cellOffsets.clear();
+    for (unsigned int i { 0 }; i < cellsPerDimension; i++)
+    {
+        for (unsigned int j { 0 }; j < cellsPerDimension; j++)
+        {
+            ivec2 cellStart { windowStart + ivec2(i, j) * static_cast<int>(cellSize) };
+            if (all(greaterThanEqual(cellStart, ivec2(0))) && all(lessThan(cellStart, heightmapMax)))
+            {
+                cellOffsets.push_back(vec2(cellStart));
+            }
+        }
+    }
+
+    // The window is centered on the player, so drawing the instances from the center outwards draws them roughly front to back,
+    // letting the nearer patches fill the depth buffer before the ones behind them are shaded.
+    vec2 windowCenter { vec2(windowStart) + 0.5f * static_cast<float>(cellsPerDimension * cellSize) };
+    float halfCell { 0.5f * cellSize };
+    std::sort(cellOffsets.begin(), cellOffsets.end(), [&](vec2 a, vec2 b)
+        {
+            return distance(a + halfCell, windowCenter) < distance(b + halfCell, windowCenter);
+        });
+
+    if (!cellOffsets.empty())
+    {
+        // The cell offsets are a per-instance attribute after the standard position, color, normal and texcoord attributes.
+        patch.setAttributeData(4, &cellOffsets[0].x, 2, static_cast<int>(cellOffsets.size()), GL_DYNAMIC_DRAW, sizeof(vec2));
+        patch.setAttributeDivisor(4, 1);
+
+        if (tessellationVertexCount > 0)
+        {
+            tessellationPatches.setAttributeData(4, &cellOffsets[0].x, 2, static_cast<int>(cellOffsets.size()), GL_DYNAMIC_DRAW, sizeof(vec2));
+            tessellationPatches.setAttributeDivisor(4, 1);
+        }
+    }
+}
+
+vec2 GPUTerrain::getPositionInCells(vec3 position) const
+{
+    // The size of a cell in world coordinates.
+    vec2 scaledCellSize { vec2(world.dimensions.x, world.dimensions.z) * static_cast<float>(cellSize) / vec2(world.getHeightmapSize() - 1u) };
+
+    return vec2(position.x, position.z) / scaledCellSize;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "ShaderProgram.h"
+
+// Renders the terrain around the player by displacing a single shared flat grid patch in the vertex shader,
+// instead of building a mesh for every cell on the CPU.
+// The part of the heightmap around the player (a window of cells, plus a one pixel border for normals) is kept in an R16 texture,
+// and the patch is instanced once per cell in the window with a per-instance offset; the shader derives positions, normals and tangents
+// from texture fetches.  When the player moves far enough for the window to shift, only the texture and the instance offsets change.
+// The window is copied out with World::copyHeightmapRegion(), so tiled and compressed heightmaps only page in or decode what's needed.
+// On hardware with tessellation shaders, the same window can instead be drawn as a few coarse patches per cell that the GPU subdivides
+// according to their size on screen (see drawTessellated()), so detail falls off smoothly with distance instead of being fixed per cell.
+class GPUTerrain
+{
+public:
+    // Sets up a window of (2 * cellPairsPerDimension) x (2 * cellPairsPerDimension) cells of a particular size (in heightmap pixels).
+    GPUTerrain(const World& world, unsigned int cellSize, unsigned int cellPairsPerDimension);
+
+    // Don't support copy constructor or copy assignment operator.
+    GPUTerrain(const GPUTerrain& g) = delete;
+    GPUTerrain& operator= (const GPUTerrain& g) = delete;
+
+    // Builds the shared patch and uploads the window of the heightmap around a position.  Must be called with a GL context.
+    void initializeForPosition(glm::vec3 position);
+
+    // Moves the window of cells to follow a position; the heightmap texture is only updated when the window moves by a whole cell.
+    void optimizeForPosition(glm::vec3 position);
+
+    // Draws every cell in the window using a shader that has already been started; the shader should be terrain_gpu.vert
+    // (or something compatible).  Sets the shader's heightmap uniforms and binds the heightmap texture to a particular texture unit.
+    void draw(ShaderProgram& shader, int heightmapTextureLocation);
+
+    // Draws every cell in the window as coarse quad patches using a tessellation shader that has already been started;
+    // the shader should be terrain_tess.vert/.tesc/.tese (or something compatible).  The camera block and the shader's "pixelsPerUnit"
+    // uniform must already be set; the edges of each patch are split so that triangles are about targetTriangleSize pixels across.
+    void drawTessellated(ShaderProgram& shader, int heightmapTextureLocation, float targetTriangleSize);
+
+    // Returns true if the current GL context supports tessellation shaders.  Must be called with a GL context.
+    static bool isTessellationSupported();
+
+    // Gets the number of bytes of vertex and index data used for the terrain (shared by every cell).
+    size_t getGeometryBytes() const;
+
+    // Gets the number of bytes of vertex data used for the coarse tessellation patches (shared by every cell).
+    size_t getTessellationGeometryBytes() const;
+
+    // Gets the number of bytes of heightmap texture data.
+    size_t getTextureBytes() const;
+
+    // Gets the number of cells drawn.
+    unsigned int getCellCount() const;
+
+private:
+    // The size (in heightmap pixels) of each side of a coarse tessellation patch.
+    // Patches are never split finer than a pixel, since there are no heights in between.
+    const static unsigned int TESSELLATION_PATCH_SIZE { 16 };
+
+    // The world the terrain belongs to.
+    const World& world;
+
+    // The size of each cell (in heightmap pixels).
+    unsigned int cellSize;
+
+    // The number of cells in each row and column of the window.
+    unsigned int cellsPerDimension;
+
+    // The index (in cells) of the first cell in the window.
+    glm::ivec2 windowStartCell { INT_MIN };
+
+    // The pixel coordinates (in the full heightmap) of the texture's first texel.
+    glm::uvec2 textureOrigin {};
+
+    // The window of the heightmap, as a single-channel 16-bit texture.
+    ofTexture heightmapTexture {};
+
+    // The shared flat patch: (cellSize + 1) x (cellSize + 1) vertices at integer pixel offsets.
+    ofVbo patch {};
+
+    // The number of indices in the patch.
+    unsigned int patchIndexCount { 0 };
+
+    // The coarse quad patches covering a cell, four corners per patch, at integer pixel offsets.
+    ofVbo tessellationPatches {};
+
+    // The number of vertices in the coarse patches.
+    unsigned int tessellationVertexCount { 0 };
+
+    // The pixel coordinates (in the full heightmap) of each cell drawn this frame, nearest the center of the window first.
+    std::vector<glm::vec2> cellOffsets {};
+
+    // Scratch space for copying the window out of the heightmap.
+    ofShortPixels windowPixels {};
+
+    // Builds the shared patch.
+    void buildPatch();
+
+    // Builds the coarse patches for tessellation.
+    void buildTessellationPatches();
+
+    // Copies the window starting at a particular cell into the heightmap texture and updates the instance offsets.
+    void loadWindow(glm::ivec2 startCell);
+
+    // Converts a position in world space to a position on the xz-plane measured in cells.
+    glm::vec2 getPositionInCells(glm::vec3 position) const;
+};
@@ -0,0 +1,271 @@
+#include "GeometryClipmap.h"
+
+using namespace glm;
+
+// Wraps a grid coordinate into the range [0, size).
+static int wrapCoordinate(int coordinate, int size)
+{
+    return ((coordinate % size) + size) % size;
+}
+
+GeometryClipmap::GeometryClipmap(const World& world, unsigned int levelCount, unsigned int levelSize)
+    : world { world }, levelSize { levelSize }, levels(levelCount)
+{
+}
+
+void GeometryClipmap::initializeForPosition(vec3 position)
+{
+    unsigned int vertexCount { levelSize + 1 };
+
+    // Vertices are laid out in columns, in the same order as buildTerrainMesh().
+    std::vector<vec3> vertices {};
+    for (unsigned int x { 0 }; x < vertexCount; x++)
+    {
+        for (unsigned int y { 0 }; y < vertexCount; y++)
+        {
+            vertices.push_back(vec3(x, 0, y));
+        }
+    }
+
+    gridVertices.allocate(vertices, GL_STATIC_DRAW);
+
+    for (Level& level : levels)
+    {
+        level.vbo.setVertexBuffer(gridVertices, 3, sizeof(vec3));
+
+        level.heightTexture.allocate(vertexCount, vertexCount, GL_R16);
+        level.heightTexture.setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+        level.heightTexture.setTextureWrap(GL_REPEAT, GL_REPEAT);
+
+        level.origin = ivec2(INT_MIN);
+        level.holeOffset = ivec2(-1);
+    }
+
+    // The finest level has no hole, so its triangles never change.
+    buildIndices(0);
+
+    // Fill every level.
+    optimizeForPosition(position);
+}
+
+void GeometryClipmap::optimizeForPosition(vec3 position)
+{
+    lastUpdateTexelCount = 0;
+
+    for (unsigned int i { 0 }; i < levels.size(); i++)
+    {
+        ivec2 newOrigin { getLevelOrigin(i, position) };
+        if (newOrigin != levels[i].origin)
+        {
+            moveLevel(i, newOrigin);
+        }
+    }
+
+    for (unsigned int i { 1 }; i < levels.size(); i++)
+    {
+        // The finer level's origin is always even, so its corner always falls on one of this level's vertices.
+        ivec2 holeOffset { levels[i - 1].origin / 2 - levels[i].origin };
+        if (holeOffset != levels[i].holeOffset)
+        {
+            levels[i].holeOffset = holeOffset;
+            buildIndices(i);
+        }
+    }
+}
+
+void GeometryClipmap::draw(ShaderProgram& shader, int heightmapTextureLocation, float minDistance, float maxDistance)
+{
+    uvec2 heightmapSize { world.getHeightmapSize() };
+    vec3 scale { world.dimensions / vec3(heightmapSize.x - 1, 1, heightmapSize.y - 1) };
+
+    shader.setUniform1i("levelSize", levelSize);
+    shader.setUniform3f("scale", scale);
+
+    // Look up the per-level uniforms once rather than for every level.
+    GLint heightmapTexUniform { shader.getUniformLocation("heightmapTex") };
+    GLint levelOriginUniform { shader.getUniformLocation("levelOrigin") };
+    GLint levelSpacingUniform { shader.getUniformLocation("levelSpacing") };
+    GLint hasCoarserLevelUniform { shader.getUniformLocation("hasCoarserLevel") };
+
+    for (unsigned int i { 0 }; i < levels.size(); i++)
+    {
+        Level& level { levels[i] };
+        int spacing { 1 << i };
+
+        // Skip levels entirely outside of the range of distances.
+        float outerDistance { 0.5f * levelSize * spacing * max(scale.x, scale.z) };
+        float innerDistance { i == 0 ? 0.0f : 0.5f * outerDistance };
+        if (innerDistance > maxDistance || outerDistance < minDistance)
+        {
+            continue;
+        }
+
+        shader.setUniformTexture(heightmapTexUniform, level.heightTexture, heightmapTextureLocation);
+        shader.setUniform2i(levelOriginUniform, level.origin.x, level.origin.y);
+        shader.setUniform1i(levelSpacingUniform, spacing);
+        shader.setUniform1i(hasCoarserLevelUniform, i + 1 < levels.size());
+
+        level.vbo.drawElements(GL_TRIANGLES, level.indexCount);
+    }
+}
+
+float GeometryClipmap::getExtent() const
+{
+    uvec2 heightmapSize { world.getHeightmapSize() };
+    return 0.5f * levelSize * (1 << (levels.size() - 1)) * world.dimensions.x / (heightmapSize.x - 1);
+}
+
+size_t GeometryClipmap::getTextureBytes() const
+{
+    return levels.size() * (levelSize + 1) * (levelSize + 1) * sizeof(unsigned short);
+}
+
+size_t GeometryClipmap::getGeometryBytes() const
+{
+    size_t bytes { (levelSize + 1) * (levelSize + 1) * sizeof(vec3) };
+    for (const Level& level : levels)
+    {
+        bytes += level.indexCount * sizeof(ofIndexType);
+    }
+
+    return bytes;
+}
+
+size_t GeometryClipmap::getLastUpdateTexelCount() const
+{
+    return lastUpdateTexelCount;
+}
+
+ivec2 GeometryClipmap::getLevelOrigin(unsigned int level, vec3 position) const
+{
+    // The position in heightmap pixels.
+    uvec2 heightmapSize { world.getHeightmapSize() };
+    vec2 pixel { vec2(position.x, position.z) * vec2(heightmapSize - 1u) / vec2(world.dimensions.x, world.dimensions.z) };
+
+    // Center the level on the position, keeping the origin even so that the level lines up with the next coarser level.
+    float spacing { static_cast<float>(1 << level) };
+    return ivec2(2.0f * floor((pixel / spacing - 0.5f * levelSize) * 0.5f));
+}
+
+void GeometryClipmap::moveLevel(unsigned int level, ivec2 newOrigin)
+{
+    int vertexCount { static_cast<int>(levelSize + 1) };
+    ivec2 oldOrigin { levels[level].origin };
+
+    if (oldOrigin == ivec2(INT_MIN) || abs(newOrigin.x - oldOrigin.x) >= vertexCount || abs(newOrigin.y - oldOrigin.y) >= vertexCount)
+    {
+        // Nothing in the old range is still in use.
+        updateRegion(level, newOrigin, newOrigin + vertexCount);
+    }
+    else
+    {
+        // Rewrite the columns that came into range...
+        if (newOrigin.x > oldOrigin.x)
+        {
+            updateRegion(level, ivec2(oldOrigin.x + vertexCount, newOrigin.y), newOrigin + vertexCount);
+        }
+        else if (newOrigin.x < oldOrigin.x)
+        {
+            updateRegion(level, newOrigin, ivec2(oldOrigin.x, newOrigin.y + vertexCount));
+        }
+
+        // ...and the rows, which together make an L-shaped strip.
+        if (newOrigin.y > oldOrigin.y)
+        {
+            updateRegion(level, ivec2(newOrigin.x, oldOrigin.y + vertexCount), newOrigin + vertexCount);
+        }
+        else if (newOrigin.y < oldOrigin.y)
+        {
+            updateRegion(level, newOrigin, ivec2(newOrigin.x + vertexCount, oldOrigin.y));
+        }
+    }
+
+    levels[level].origin = newOrigin;
+}
+
+void GeometryClipmap::updateRegion(unsigned int level, ivec2 min, ivec2 max)
+{
+    int vertexCount { static_cast<int>(levelSize + 1) };
+    int spacing { 1 << level };
+    ivec2 heightmapMax { ivec2(world.getHeightmapSize()) - 1 };
+
+    // A rectangle of grid coordinates maps to up to two ranges of texels in each dimension, since the texture wraps around.
+    auto splitRange { [&](int begin, int end, int ranges[2][3])
+    {
+        int start { wrapCoordinate(begin, vertexCount) };
+        int firstLength { std::min(end - begin, vertexCount - start) };
+        ranges[0][0] = begin;
+        ranges[0][1] = start;
+        ranges[0][2] = firstLength;
+        ranges[1][0] = begin + firstLength;
+        ranges[1][1] = 0;
+        ranges[1][2] = end - begin - firstLength;
+    } };
+
+    int xRanges[2][3];
+    int yRanges[2][3];
+    splitRange(min.x, max.x, xRanges);
+    splitRange(min.y, max.y, yRanges);
+
+    glBindTexture(GL_TEXTURE_2D, levels[level].heightTexture.getTextureData().textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+
+    for (auto& xRange : xRanges)
+    {
+        for (auto& yRange : yRanges)
+        {
+            int width { xRange[2] };
+            int height { yRange[2] };
+            if (width <= 0 || height <= 0)
+            {
+                continue;
+            }
+
+            // Sample the heightmap at this level's spacing, clamping to its edges.
+            updateBuffer.resize(width * height);
+            for (int j { 0 }; j < height; j++)
+            {
+                for (int i { 0 }; i < width; i++)
+                {
+                    ivec2 pixel { clamp(ivec2(xRange[0] + i, yRange[0] + j) * spacing, ivec2(0), heightmapMax) };
+                    updateBuffer[j * width + i] = world.getHeightmapValue(pixel.x, pixel.y);
+                }
+            }
+
+            glTexSubImage2D(GL_TEXTURE_2D, 0, xRange[1], yRange[1], width, height, GL_RED, GL_UNSIGNED_SHORT, updateBuffer.data());
+            lastUpdateTexelCount += width * height;
+        }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GeometryClipmap::buildIndices(unsigned int level)
+{
+    std::vector<ofIndexType> indices {};
+    unsigned int columnSize { levelSize + 1 };
+    ivec2 holeOffset { levels[level].holeOffset };
+    int holeSize { static_cast<int>(levelSize / 2) };
+
+    for (unsigned int x { 0 }; x < levelSize; x++)
+    {
+        for (unsigned int y { 0 }; y < levelSize; y++)
+        {
+            // Leave out the quads covered by the finer level.
+            if (level > 0
+                && static_cast<int>(x) >= holeOffset.x && static_cast<int>(x) < holeOffset.x + holeSize
+                && static_cast<int>(y) >= holeOffset.y && static_cast<int>(y) < holeOffset.y + holeSize)
+            {
+                continue;
+            }
+
+            // k is the index of the quad's SW corner; the winding matches buildTerrainMesh().
+            ofIndexType k { x * columnSize + y };
+            indices.insert(indices.end(), { k, k + 1, k + columnSize, k + columnSize, k + 1, k + columnSize + 1 });
+        }
+    }
+
+    levels[level].vbo.setIndexData(indices.data(), static_cast<int>(indices.size()), GL_DYNAMIC_DRAW);
+    levels[level].indexCount = static_cast<unsigned int>(indices.size());
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "ShaderProgram.h"
+
+// Renders the whole terrain, near and far, as a nested geometry clipmap centered on the player.
+// Each level is a grid of levelSize x levelSize quads with twice the vertex spacing of the level inside it,
+// and leaves a hole where the finer level is drawn.  The heights for each level live in a small toroidal texture:
+// when the player moves, only the L-shaped strips of newly exposed texels are rewritten, so memory and per-frame update cost
+// depend only on the number and size of the levels, not on the size of the world.
+// Along each level's outer edge, every other vertex takes the average height of its neighbors so that it lines up exactly
+// with the coarser level's edge, leaving no cracks.
+class GeometryClipmap
+{
+public:
+    // Sets up a clipmap with a particular number of levels, each with levelSize x levelSize quads (levelSize must be a multiple of 4).
+    GeometryClipmap(const World& world, unsigned int levelCount, unsigned int levelSize);
+
+    // Don't support copy constructor or copy assignment operator.
+    GeometryClipmap(const GeometryClipmap& g) = delete;
+    GeometryClipmap& operator= (const GeometryClipmap& g) = delete;
+
+    // Builds the grid geometry and fills every level around a position.  Must be called with a GL context.
+    void initializeForPosition(glm::vec3 position);
+
+    // Moves each level to follow a position, rewriting only the texels that have come into range.
+    void optimizeForPosition(glm::vec3 position);
+
+    // Draws the levels that overlap a range of horizontal distances from the player (so that the near and far passes
+    // can each draw only the levels they need), using a shader that has already been started; the shader should be
+    // terrain_clipmap.vert (or something compatible).  Each level's heights are bound to a particular texture unit.
+    void draw(ShaderProgram& shader, int heightmapTextureLocation, float minDistance, float maxDistance);
+
+    // Gets the horizontal distance (in world space) from the center of the clipmap to the edge of the coarsest level.
+    float getExtent() const;
+
+    // Gets the number of bytes of height textures used by all of the levels.
+    size_t getTextureBytes() const;
+
+    // Gets the number of bytes of vertex and index data used by all of the levels.
+    size_t getGeometryBytes() const;
+
+    // Gets the number of texels rewritten by the most recent call to optimizeForPosition().
+    size_t getLastUpdateTexelCount() const;
+
+private:
+    // The state of a single level.
+    struct Level
+    {
+        // The level's heights, indexed toroidally by grid coordinates.
+        ofTexture heightTexture {};
+
+        // The grid coordinates (in units of this level's vertex spacing) of the level's first vertex.
+        glm::ivec2 origin { INT_MIN };
+
+        // The position (in this level's quads) of the hole left for the finer level.
+        glm::ivec2 holeOffset { -1 };
+
+        // The level's triangles; shares its vertices with every other level.
+        ofVbo vbo {};
+
+        // The number of indices in the level's triangles.
+        unsigned int indexCount { 0 };
+    };
+
+    // The world the terrain belongs to.
+    const World& world;
+
+    // The number of quads in each row and column of a level.
+    unsigned int levelSize;
+
+    // Every level, from finest to coarsest.
+    std::vector<Level> levels {};
+
+    // The grid of (levelSize + 1) x (levelSize + 1) vertices shared by every level.
+    ofBufferObject gridVertices {};
+
+    // Scratch space for heights being written to a texture.
+    std::vector<unsigned short> updateBuffer {};
+
+    // The number of texels rewritten by the most recent update.
+    size_t lastUpdateTexelCount { 0 };
+
+    // Gets the origin a level should have to be centered on a position.
+    glm::ivec2 getLevelOrigin(unsigned int level, glm::vec3 position) const;
+
+    // Moves a level to a new origin, rewriting the texels that have come into range.
+    void moveLevel(unsigned int level, glm::ivec2 newOrigin);
+
+    // Rewrites the texels for the rectangle [min, max) of a level's grid coordinates, wrapping around the texture as needed.
+    void updateRegion(unsigned int level, glm::ivec2 min, glm::ivec2 max);
+
+    // Rebuilds a level's triangles around the hole for the finer level.
+    void buildIndices(unsigned int level);
+};
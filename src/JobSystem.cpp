@@ -0,0 +1,349 @@
+#include "JobSystem.h"
+#include "Tracer.h"
+
+JobSystem::JobSystem(unsigned int threadCount, unsigned int attachableThreadCount)
+{
+    threadCount = std::max(1u, threadCount);
+    jobThreadCount = threadCount;
+
+    // Every state is created up front, so the vector never changes while other threads are reading it.
+    for (unsigned int i { 0 }; i < threadCount + attachableThreadCount; i++)
+    {
+        threadStates.push_back(std::make_unique<ThreadState>());
+    }
+
+    threadStates[0]->threadId = std::this_thread::get_id();
+
+    for (unsigned int i { 1 }; i < threadCount; i++)
+    {
+        workers.emplace_back([this, i]() { workerLoop(i); });
+        threadStates[i]->threadId = workers.back().get_id();
+    }
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock { sleepMutex };
+        stopping = true;
+    }
+
+    wakeCondition.notify_all();
+
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+
+    // Background jobs that were never started are allocated on their own, so free them; jobs in the threads' rings go with the rings.
+    for (Job* job : backgroundJobs)
+    {
+        delete job;
+    }
+
+    backgroundJobs.clear();
+}
+
+unsigned int JobSystem::getThreadCount() const
+{
+    return jobThreadCount;
+}
+
+bool JobSystem::attachThread()
+{
+    for (unsigned int i { jobThreadCount }; i < threadStates.size(); i++)
+    {
+        std::thread::id unused {};
+        if (threadStates[i]->threadId.compare_exchange_strong(unused, std::this_thread::get_id()))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void JobSystem::detachThread()
+{
+    unsigned int threadIndex { getThreadIndex() };
+    assert(threadIndex >= jobThreadCount);
+
+    // The job pool is left as it is; jobs from it may still be running, and the next thread to attach carries on where this one left off.
+    threadStates[threadIndex]->threadId = std::thread::id {};
+}
+
+JobSystem::Job* JobSystem::createJob(std::function<void()> function, Job* parent)
+{
+    ThreadState& thread { *threadStates[getThreadIndex()] };
+    Job* job { &thread.jobPool[thread.jobsCreated % JOB_POOL_SIZE] };
+    thread.jobsCreated++;
+
+    // If the ring has come all the way round to a job that's still queued or running, help out until it's done
+    // rather than overwriting it.  Every job created should be run, or this never returns.
+    wait(job);
+
+    job->function = std::move(function);
+    job->parent = parent;
+    job->unfinishedJobs = 1;
+
+    if (parent)
+    {
+        parent->unfinishedJobs++;
+    }
+
+    return job;
+}
+
+void JobSystem::run(Job* job)
+{
+    ThreadState& thread { *threadStates[getThreadIndex()] };
+
+    // Count the job before it can be taken, so that the count never drops below zero.
+    queuedJobs++;
+
+    {
+        std::lock_guard<std::mutex> lock { thread.mutex };
+        thread.jobs.push_back(job);
+    }
+
+    wakeWorker();
+}
+
+void JobSystem::runInBackground(std::function<void()> function)
+{
+    Job* job { new Job {} };
+    job->function = std::move(function);
+    job->unfinishedJobs = 1;
+    job->heapAllocated = true;
+
+    if (getThreadCount() == 1)
+    {
+        // There are no workers to hand the job to.
+        runningJobs++;
+        execute(job);
+        return;
+    }
+
+    queuedBackgroundJobs++;
+
+    {
+        std::lock_guard<std::mutex> lock { backgroundMutex };
+        backgroundJobs.push_back(job);
+    }
+
+    wakeWorker();
+}
+
+void JobSystem::wait(const Job* job)
+{
+    unsigned int threadIndex { getThreadIndex() };
+
+    while (!isFinished(job))
+    {
+        // Help out instead of blocking; this is what lets jobs wait on their own children.
+        Job* otherJob { takeJob(threadIndex) };
+        if (otherJob)
+        {
+            execute(otherJob);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void JobSystem::waitForIdle()
+{
+    unsigned int threadIndex { getThreadIndex() };
+
+    while (queuedJobs > 0 || queuedBackgroundJobs > 0 || runningJobs > 0)
+    {
+        Job* job { takeJob(threadIndex) };
+        if (job)
+        {
+            execute(job);
+        }
+        else
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool JobSystem::isFinished(const Job* job) const
+{
+    return job->unfinishedJobs == 0;
+}
+
+void JobSystem::parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function)
+{
+    batchSize = std::max<size_t>(1, batchSize);
+
+    if (count <= batchSize || getThreadCount() == 1)
+    {
+        // Not worth the overhead of jobs.
+        for (size_t begin { 0 }; begin < count; begin += batchSize)
+        {
+            function(begin, std::min(begin + batchSize, count));
+        }
+    }
+    else
+    {
+        // Group every batch under a single job so there's only one thing to wait on.
+        Job* root { createJob({}) };
+
+        for (size_t begin { 0 }; begin < count; begin += batchSize)
+        {
+            size_t end { std::min(begin + batchSize, count) };
+            run(createJob([&function, begin, end]() { function(begin, end); }, root));
+        }
+
+        run(root);
+        wait(root);
+    }
+}
+
+unsigned int JobSystem::getThreadIndex() const
+{
+    std::thread::id threadId { std::this_thread::get_id() };
+
+    for (unsigned int i { 0 }; i < threadStates.size(); i++)
+    {
+        if (threadStates[i]->threadId == threadId)
+        {
+            return i;
+        }
+    }
+
+    // Carrying on with another thread's slot would let two threads share its job pool and deque unguarded, so stop here instead.
+    ofLogError("JobSystem") << "Jobs can only be used from the thread that created the job system, from inside a job, or from an attached thread.";
+    std::abort();
+}
+
+JobSystem::Job* JobSystem::takeJob(unsigned int threadIndex)
+{
+    if (queuedJobs > 0)
+    {
+        Job* job { takeForegroundJob(threadIndex) };
+        if (job)
+        {
+            return job;
+        }
+    }
+
+    // Only workers run background jobs, so the creating thread (or an attached thread) never gets stuck behind one.
+    if (threadIndex != 0 && threadIndex < jobThreadCount && queuedBackgroundJobs > 0)
+    {
+        std::lock_guard<std::mutex> lock { backgroundMutex };
+        if (!backgroundJobs.empty())
+        {
+            Job* job { backgroundJobs.front() };
+            backgroundJobs.pop_front();
+            runningJobs++;
+            queuedBackgroundJobs--;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+JobSystem::Job* JobSystem::takeForegroundJob(unsigned int threadIndex)
+{
+    // Newest job from our own deque first...
+    {
+        ThreadState& thread { *threadStates[threadIndex] };
+        std::lock_guard<std::mutex> lock { thread.mutex };
+        if (!thread.jobs.empty())
+        {
+            Job* job { thread.jobs.back() };
+            thread.jobs.pop_back();
+            runningJobs++;
+            queuedJobs--;
+            return job;
+        }
+    }
+
+    // ...then the oldest job from each other thread in turn.
+    for (unsigned int i { 1 }; i < threadStates.size(); i++)
+    {
+        ThreadState& victim { *threadStates[(threadIndex + i) % threadStates.size()] };
+        std::lock_guard<std::mutex> lock { victim.mutex };
+        if (!victim.jobs.empty())
+        {
+            Job* job { victim.jobs.front() };
+            victim.jobs.pop_front();
+            runningJobs++;
+            queuedJobs--;
+            return job;
+        }
+    }
+
+    return nullptr;
+}
+
+void JobSystem::execute(Job* job)
+{
+    if (job->function)
+    {
+        job->function();
+    }
+
+    finish(job);
+    runningJobs--;
+}
+
+void JobSystem::wakeWorker()
+{
+    // Take the sleep lock before notifying so that a worker can't miss the job between checking for work and going to sleep.
+    {
+        std::lock_guard<std::mutex> lock { sleepMutex };
+    }
+
+    wakeCondition.notify_one();
+}
+
+void JobSystem::finish(Job* job)
+{
+    // Read the parent first; once the count reaches zero, the job's owner may recycle it.
+    Job* parent { job->parent };
+    bool heapAllocated { job->heapAllocated };
+
+    if (--job->unfinishedJobs == 0)
+    {
+        if (heapAllocated)
+        {
+            delete job;
+        }
+
+        if (parent)
+        {
+            finish(parent);
+        }
+    }
+}
+
+void JobSystem::workerLoop(unsigned int threadIndex)
+{
+    Tracer::setThreadName("job worker " + std::to_string(threadIndex));
+
+    while (true)
+    {
+        Job* job { takeJob(threadIndex) };
+        if (job)
+        {
+            execute(job);
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock { sleepMutex };
+            wakeCondition.wait(lock, [this]() { return stopping || queuedJobs > 0 || queuedBackgroundJobs > 0; });
+
+            if (stopping)
+            {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include "ofMain.h"
+#include <condition_variable>
+
+// A small work-stealing job system.
+// The thread that creates the job system and one worker thread per additional hardware thread each have their own deque of jobs.
+// A thread pushes and pops jobs at the back of its own deque (so it tends to work on what it just created, which is still in cache),
+// and steals from the front of another thread's deque when its own is empty.
+// A job can have a parent; the parent isn't finished until all of its children are, so waiting on one job waits for a whole tree of work.
+// A thread waiting on a job runs other jobs in the meantime, so jobs can safely create and wait on their own children.
+// Low-priority work that nobody waits on within a frame (such as streaming terrain cells) can be run in the background instead;
+// background jobs are only picked up by worker threads once there's no other work, so they never stall the creating thread.
+// Jobs may only be created, run, and waited on from the thread that created the job system, from inside a job,
+// or from a long-running thread of its own (such as a simulation loop) that has been attached with attachThread().
+class JobSystem
+{
+public:
+    // A unit of work.  Jobs are owned by the job system and recycled, so only hold on to a job until it has been waited on.
+    struct Job
+    {
+        // The work to do; may be empty for jobs that only group their children.
+        std::function<void()> function {};
+
+        // The job that is waiting on this one, if any.
+        Job* parent { nullptr };
+
+        // The number of jobs in this job's tree that haven't finished yet (this job plus its unfinished children).
+        std::atomic<unsigned int> unfinishedJobs { 0 };
+
+        // True for background jobs, which are allocated on their own rather than taken from a thread's ring, and deleted once finished.
+        bool heapAllocated { false };
+    };
+
+    // Starts the job system with a particular number of threads, including the calling thread,
+    // and room for a number of other threads to be attached later with attachThread().
+    JobSystem(unsigned int threadCount = std::thread::hardware_concurrency(), unsigned int attachableThreadCount = 0);
+
+    // Stops the worker threads.  Every job should already have been waited on; background jobs that haven't started yet are dropped.
+    ~JobSystem();
+
+    // Don't support copy constructor or copy assignment operator.
+    JobSystem(const JobSystem& j) = delete;
+    JobSystem& operator= (const JobSystem& j) = delete;
+
+    // Gets the number of threads that run jobs, including the thread that created the job system (but not attached threads).
+    unsigned int getThreadCount() const;
+
+    // Lets the calling thread create, run, and wait on jobs, like the thread that created the job system.
+    // An attached thread only runs other jobs while it waits, and never runs background jobs, so it keeps to its own schedule.
+    // Returns false if every slot reserved for attached threads is already taken.
+    bool attachThread();
+
+    // Gives up the calling thread's slot; it must have been attached with attachThread(), and must not create any more jobs.
+    // Jobs it created may still be running.
+    void detachThread();
+
+    // Creates a job without starting it.  If a parent is given, the parent won't finish until this job does,
+    // so the child must be created before the parent is run.  Every job created must be run.
+    // Jobs come from a ring of JOB_POOL_SIZE per thread; if the job that last had this slot hasn't finished yet,
+    // this runs other jobs until it has.
+    Job* createJob(std::function<void()> function, Job* parent = nullptr);
+
+    // Queues a job to be run by whichever thread gets to it first.
+    void run(Job* job);
+
+    // Queues a function to be run by a worker thread when there's no other work to do.
+    // The creating thread never runs background jobs (unless it's the only thread, in which case the function runs immediately).
+    // Background jobs can take any amount of time, so rather than coming from the creating thread's ring (which they could
+    // hold up, or be overwritten in), each one is allocated on its own and freed when it finishes.  Nothing can wait on one.
+    void runInBackground(std::function<void()> function);
+
+    // Returns once a job and all of its children have finished, running other jobs while it waits.
+    void wait(const Job* job);
+
+    // Returns once every queued job, including background jobs, has finished.  Must not be called from inside a job.
+    void waitForIdle();
+
+    // Returns true if a job and all of its children have finished.
+    bool isFinished(const Job* job) const;
+
+    // Calls a function for the range [0, count) split into batches of "batchSize" as [begin, end),
+    // running the batches as jobs across every thread, and returns once every batch is done.
+    void parallelFor(size_t count, size_t batchSize, const std::function<void(size_t, size_t)>& function);
+
+private:
+    // The number of jobs each thread can have created before its oldest job is recycled.
+    const static size_t JOB_POOL_SIZE { 4096 };
+
+    // The state belonging to each thread.
+    struct ThreadState
+    {
+        // The ID of the thread this state belongs to; atomic, since a thread can attach while others are looking themselves up.
+        std::atomic<std::thread::id> threadId { std::thread::id {} };
+
+        // The thread's queued jobs; the owner uses the back, thieves use the front.
+        std::deque<Job*> jobs {};
+
+        // Guards the deque of jobs.
+        std::mutex mutex {};
+
+        // The jobs created by this thread, reused in a ring.  Only touched by the owning thread.
+        std::unique_ptr<Job[]> jobPool { std::make_unique<Job[]>(JOB_POOL_SIZE) };
+
+        // The number of jobs this thread has created; the next job comes from this index in the pool (modulo its size).
+        size_t jobsCreated { 0 };
+    };
+
+    // The state of every thread; index 0 is the thread that created the job system, followed by the workers,
+    // followed by the slots for attached threads (whose ID is the default while unused).
+    std::vector<std::unique_ptr<ThreadState>> threadStates {};
+
+    // The number of threads that run jobs (the creating thread and the workers); attached threads' states come after theirs.
+    unsigned int jobThreadCount { 1 };
+
+    // The worker threads (every thread except the one that created the job system).
+    std::vector<std::thread> workers {};
+
+    // The number of jobs that are queued but haven't been taken by a thread yet.
+    std::atomic<size_t> queuedJobs { 0 };
+
+    // Background jobs, oldest first.
+    std::deque<Job*> backgroundJobs {};
+
+    // Guards the background jobs.
+    std::mutex backgroundMutex {};
+
+    // The number of background jobs that haven't been taken by a thread yet.
+    std::atomic<size_t> queuedBackgroundJobs { 0 };
+
+    // The number of jobs currently being run by any thread.
+    std::atomic<size_t> runningJobs { 0 };
+
+    // Guards going to sleep and waking up idle workers.
+    std::mutex sleepMutex {};
+
+    // Signals idle workers when a job is queued or the job system is stopping.
+    std::condition_variable wakeCondition {};
+
+    // Set to true to stop the workers.
+    bool stopping { false };
+
+    // Gets the index of the calling thread's state.  Logs an error and aborts if the calling thread isn't allowed to use jobs.
+    unsigned int getThreadIndex() const;
+
+    // Takes a job from the calling thread's own deque, or steals one from another thread, 
+    // or (for worker threads only) takes a background job.  Returns nullptr if there are no queued jobs.
+    // The job counts as running from the moment it's taken, so waitForIdle() never sees it as neither queued nor running.
+    Job* takeJob(unsigned int threadIndex);
+
+    // Takes a job from the calling thread's own deque, or steals one from another thread.  Returns nullptr if there are none.
+    Job* takeForegroundJob(unsigned int threadIndex);
+
+    // Runs a job that has been taken and marks it finished.
+    void execute(Job* job);
+
+    // Wakes up an idle worker after a job has been queued.
+    void wakeWorker();
+
+    // Marks one job in a tree as finished, finishing the parent too if it was the last one.
+    void finish(Job* job);
+
+    // The loop run by each worker thread.
+    void workerLoop(unsigned int threadIndex);
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+// The fixed-size header at the start of a KTX (version 1) texture container.
+// Each mip level follows the key/value data as a 32-bit image size and then the image data for each face (or array element),
+// each padded to a multiple of four bytes, from the largest level to the smallest.
+struct KTXHeader
+{
+    uint8_t identifier[12];
+    uint32_t endianness;
+    uint32_t glType;
+    uint32_t glTypeSize;
+    uint32_t glFormat;
+    uint32_t glInternalFormat;
+    uint32_t glBaseInternalFormat;
+    uint32_t pixelWidth;
+    uint32_t pixelHeight;
+    uint32_t pixelDepth;
+    uint32_t numberOfArrayElements;
+    uint32_t numberOfFaces;
+    uint32_t numberOfMipmapLevels;
+    uint32_t bytesOfKeyValueData;
+};
+
+// The identifier every KTX 1 file starts with.
+const uint8_t KTX_IDENTIFIER[12] { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// The value of the endianness field when the file is in this machine's byte order.
+const uint32_t KTX_NATIVE_ENDIANNESS { 0x04030201 };
+
+// Returns true if a header belongs to a KTX 1 file in this machine's byte order.
+inline bool isNativeKTXHeader(const KTXHeader& header)
+{
+    return memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0 && header.endianness == KTX_NATIVE_ENDIANNESS;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "ofMain.h"
+
+// A read-only memory mapping of an entire file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+
+    // Don't support copy constructor or copy assignment operator.
+    MappedFile(const MappedFile& m) = delete;
+    MappedFile& operator= (const MappedFile& m) = delete;
+
+    // Maps a file into memory.  Returns false if the file doesn't exist, is empty, or couldn't be mapped.
+    bool open(const std::filesystem::path& path);
+
+    // Unmaps the file; called automatically by the destructor.
+    void close();
+
+    // Gets a pointer to the start of the mapped file, or nullptr if no file is mapped.
+    const uint8_t* getData() const;
+
+    // Gets the size (in bytes) of the mapped file.
+    size_t getSize() const;
+
+private:
+    const uint8_t* data { nullptr };
+    size_t size { 0 };
+
+#ifdef _WIN32
+    // The Windows file and file mapping handles.
+    void* fileHandle { nullptr };
+    void* mappingHandle { nullptr };
+#endif
+};
@@ -0,0 +1,312 @@
+#include "OcclusionCuller.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE
+#endif
+
+using namespace glm;
+
+OcclusionCuller::OcclusionCuller(uvec2 resolution)
+    : resolution { (glm::max(resolution.x, 4u) + 3u) & ~3u, glm::max(resolution.y, 1u) }
+{
+    depth.resize(this->resolution.x * this->resolution.y);
+}
+
+void OcclusionCuller::renderOccluders(const mat4& viewProjection, const std::vector<Cell*>& cells, size_t maxOccluders, JobSystem& jobSystem)
+{
+    std::chrono::steady_clock::time_point startTime { std::chrono::steady_clock::now() };
+
+    stats = Stats {};
+    this->viewProjection = viewProjection;
+
+    const unsigned int gridSize { Cell::OCCLUDER_RESOLUTION + 1 };
+    const size_t verticesPerCell { gridSize * gridSize };
+    occluderCount = std::min(maxOccluders, cells.size());
+    screenVertices.resize(occluderCount * verticesPerCell);
+
+    // Project every occluder vertex once, up front, so the bands don't each have to.
+    jobSystem.parallelFor(occluderCount, 4, [&](size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            const Cell& cell { *cells[i] };
+            ScreenVertex* vertices { &screenVertices[i * verticesPerCell] };
+
+            if (cell.occluderHeights.empty())
+            {
+                std::fill(vertices, vertices + verticesPerCell, ScreenVertex { vec3(0), false });
+                continue;
+            }
+
+            for (unsigned int z { 0 }; z < gridSize; z++)
+            {
+                for (unsigned int x { 0 }; x < gridSize; x++)
+                {
+                    vec2 t { vec2(x, z) / static_cast<float>(Cell::OCCLUDER_RESOLUTION) };
+                    vec3 position { mix(cell.boundsMin.x, cell.boundsMax.x, t.x), cell.occluderHeights[z * gridSize + x],
+                        mix(cell.boundsMin.z, cell.boundsMax.z, t.y) };
+                    vertices[z * gridSize + x] = project(position);
+                }
+            }
+        }
+    });
+
+    stats.occluderCells = occluderCount;
+    stats.occluderTriangles = occluderCount * 2 * Cell::OCCLUDER_RESOLUTION * Cell::OCCLUDER_RESOLUTION;
+
+    // Each band of rows is cleared and rasterized by its own job, so no two jobs ever write the same pixel.
+    // Every job goes through all of the triangles, but most are rejected by their bounding box straight away.
+    size_t bandCount { (resolution.y + BAND_HEIGHT - 1) / BAND_HEIGHT };
+    jobSystem.parallelFor(bandCount, 1, [&](size_t begin, size_t end)
+    {
+        for (size_t band { begin }; band < end; band++)
+        {
+            int rowBegin { static_cast<int>(band * BAND_HEIGHT) };
+            int rowEnd { static_cast<int>(glm::min((band + 1) * BAND_HEIGHT, static_cast<size_t>(resolution.y))) };
+            std::fill(depth.begin() + rowBegin * resolution.x, depth.begin() + rowEnd * resolution.x, 0.0f);
+
+            for (size_t cell { 0 }; cell < occluderCount; cell++)
+            {
+                const ScreenVertex* vertices { &screenVertices[cell * verticesPerCell] };
+
+                for (unsigned int z { 0 }; z < Cell::OCCLUDER_RESOLUTION; z++)
+                {
+                    for (unsigned int x { 0 }; x < Cell::OCCLUDER_RESOLUTION; x++)
+                    {
+                        const ScreenVertex& corner00 { vertices[z * gridSize + x] };
+                        const ScreenVertex& corner10 { vertices[z * gridSize + x + 1] };
+                        const ScreenVertex& corner01 { vertices[(z + 1) * gridSize + x] };
+                        const ScreenVertex& corner11 { vertices[(z + 1) * gridSize + x + 1] };
+
+                        rasterizeTriangle(corner00, corner10, corner11, rowBegin, rowEnd);
+                        rasterizeTriangle(corner00, corner11, corner01, rowBegin, rowEnd);
+                    }
+                }
+            }
+        }
+    });
+
+    stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void OcclusionCuller::cullCells(const std::vector<Cell*>& cells, std::vector<Cell*>& visibleCells, JobSystem& jobSystem)
+{
+    std::chrono::steady_clock::time_point startTime { std::chrono::steady_clock::now() };
+
+    results.resize(cells.size());
+    jobSystem.parallelFor(cells.size(), 16, [&](size_t begin, size_t end)
+    {
+        for (size_t i { begin }; i < end; i++)
+        {
+            results[i] = testCell(*cells[i]);
+        }
+    });
+
+    // Keep the visible cells in their original (front to back) order.
+    visibleCells.clear();
+    for (size_t i { 0 }; i < cells.size(); i++)
+    {
+        switch (results[i])
+        {
+        case Visibility::VISIBLE:
+            visibleCells.push_back(cells[i]);
+            break;
+        case Visibility::OCCLUDED:
+            stats.occludedCells++;
+            break;
+        case Visibility::OFFSCREEN:
+            stats.offscreenCells++;
+            break;
+        }
+    }
+
+    stats.testedCells += cells.size();
+    stats.milliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::getStats() const
+{
+    return stats;
+}
+
+OcclusionCuller::ScreenVertex OcclusionCuller::project(vec3 position) const
+{
+    vec4 clip { viewProjection * vec4(position, 1) };
+
+    // Points at (or behind) the camera can't be projected sensibly.
+    if (clip.w < 1e-3f)
+    {
+        return ScreenVertex { vec3(0), false };
+    }
+
+    float invW { 1.0f / clip.w };
+    return ScreenVertex { vec3((clip.x * invW * 0.5f + 0.5f) * resolution.x, (clip.y * invW * 0.5f + 0.5f) * resolution.y, invW), true };
+}
+
+void OcclusionCuller::rasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, int rowBegin, int rowEnd)
+{
+    // Triangles reaching behind the camera are skipped; leaving out an occluder only ever makes the culling more conservative.
+    if (!v0.valid || !v1.valid || !v2.valid)
+    {
+        return;
+    }
+
+    vec3 a { v0.position };
+    vec3 b { v1.position };
+    vec3 c { v2.position };
+
+    // The range of pixel centers the triangle might cover, within the screen and the band.
+    vec2 screenSize { resolution };
+    vec2 minPos { clamp(min(vec2(a), min(vec2(b), vec2(c))), vec2(-1), screenSize + 1.0f) };
+    vec2 maxPos { clamp(max(vec2(a), max(vec2(b), vec2(c))), vec2(-1), screenSize + 1.0f) };
+    int xBegin { glm::max(static_cast<int>(ceil(minPos.x - 0.5f)), 0) };
+    int xEnd { glm::min(static_cast<int>(floor(maxPos.x - 0.5f)), static_cast<int>(resolution.x) - 1) };
+    int yBegin { glm::max(static_cast<int>(ceil(minPos.y - 0.5f)), rowBegin) };
+    int yEnd { glm::min(static_cast<int>(floor(maxPos.y - 0.5f)), rowEnd - 1) };
+    if (xBegin > xEnd || yBegin > yEnd)
+    {
+        return;
+    }
+
+    // Make the triangle counterclockwise, so that all three edge functions are positive inside it.
+    float area { (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) };
+    if (abs(area) < 1e-6f)
+    {
+        return;
+    }
+    else if (area < 0)
+    {
+        std::swap(b, c);
+        area = -area;
+    }
+
+    // Each edge function is e(x, y) = A x + B y + C; it's zero along one edge and equal to the area at the opposite vertex.
+    vec3 edgeA { b.y - c.y, c.y - a.y, a.y - b.y };
+    vec3 edgeB { c.x - b.x, a.x - c.x, b.x - a.x };
+    vec3 edgeC { -(edgeA.x * b.x + edgeB.x * b.y), -(edgeA.y * c.x + edgeB.y * c.y), -(edgeA.z * a.x + edgeB.z * a.y) };
+
+    // 1 / w is a plane in screen space too: the edge functions, normalized, are the barycentric weights of the vertices.
+    vec3 vertexDepths { a.z, b.z, c.z };
+    float depthA { dot(edgeA, vertexDepths) / area };
+    float depthB { dot(edgeB, vertexDepths) / area };
+    float depthC { dot(edgeC, vertexDepths) / area };
+
+#ifdef OCCLUSION_CULLER_SSE
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 pixelOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+    const __m128 edgeA0 = _mm_set1_ps(edgeA.x);
+    const __m128 edgeA1 = _mm_set1_ps(edgeA.y);
+    const __m128 edgeA2 = _mm_set1_ps(edgeA.z);
+    const __m128 depthStep = _mm_set1_ps(depthA);
+#endif
+
+    for (int y { yBegin }; y <= yEnd; y++)
+    {
+        float pixelY { y + 0.5f };
+        float* row { &depth[y * resolution.x] };
+
+        // The parts of the edge functions and depth that are constant along the row.
+        vec3 rowEdges { edgeB * pixelY + edgeC };
+        float rowDepth { depthB * pixelY + depthC };
+
+#ifdef OCCLUSION_CULLER_SSE
+        const __m128 rowEdge0 = _mm_set1_ps(rowEdges.x);
+        const __m128 rowEdge1 = _mm_set1_ps(rowEdges.y);
+        const __m128 rowEdge2 = _mm_set1_ps(rowEdges.z);
+        const __m128 rowDepths = _mm_set1_ps(rowDepth);
+
+        // Four pixels at a time, starting from a multiple of four; the width is a multiple of four, so this never leaves the row,
+        // and the edge functions reject the extra pixels.
+        for (int x { xBegin & ~3 }; x <= xEnd; x += 4)
+        {
+            __m128 pixelX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), pixelOffsets);
+            __m128 edge0 = _mm_add_ps(_mm_mul_ps(edgeA0, pixelX), rowEdge0);
+            __m128 edge1 = _mm_add_ps(_mm_mul_ps(edgeA1, pixelX), rowEdge1);
+            __m128 edge2 = _mm_add_ps(_mm_mul_ps(edgeA2, pixelX), rowEdge2);
+            __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_cmpge_ps(edge1, zero)), _mm_cmpge_ps(edge2, zero));
+
+            __m128 current = _mm_loadu_ps(row + x);
+            __m128 nearest = _mm_max_ps(current, _mm_add_ps(_mm_mul_ps(depthStep, pixelX), rowDepths));
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+        }
+#else
+        for (int x { xBegin }; x <= xEnd; x++)
+        {
+            float pixelX { x + 0.5f };
+            vec3 edges { edgeA * pixelX + rowEdges };
+            if (edges.x >= 0 && edges.y >= 0 && edges.z >= 0)
+            {
+                row[x] = glm::max(row[x], depthA * pixelX + rowDepth);
+            }
+        }
+#endif
+    }
+}
+
+OcclusionCuller::Visibility OcclusionCuller::testCell(const Cell& cell) const
+{
+    // Project the corners of the bounding box; its nearest point is always one of them.
+    vec2 minPos { std::numeric_limits<float>::max() };
+    vec2 maxPos { std::numeric_limits<float>::lowest() };
+    float nearestDepth { 0 };
+
+    for (unsigned int corner { 0 }; corner < 8; corner++)
+    {
+        vec3 position { corner & 1 ? cell.boundsMax.x : cell.boundsMin.x,
+            corner & 2 ? cell.boundsMax.y : cell.boundsMin.y,
+            corner & 4 ? cell.boundsMax.z : cell.boundsMin.z };
+
+        ScreenVertex vertex { project(position) };
+        if (!vertex.valid)
+        {
+            // The box reaches behind the camera, so it surrounds the camera or is right next to it.
+            return Visibility::VISIBLE;
+        }
+
+        minPos = min(minPos, vec2(vertex.position));
+        maxPos = max(maxPos, vec2(vertex.position));
+        nearestDepth = glm::max(nearestDepth, vertex.position.z);
+    }
+
+    vec2 screenSize { resolution };
+    if (maxPos.x < 0 || maxPos.y < 0 || minPos.x > screenSize.x || minPos.y > screenSize.y)
+    {
+        return Visibility::OFFSCREEN;
+    }
+
+    // The pixel centers the box covers, plus one pixel all round.
+    minPos = clamp(minPos, vec2(-1), screenSize + 1.0f);
+    maxPos = clamp(maxPos, vec2(-1), screenSize + 1.0f);
+    int xBegin { glm::max(static_cast<int>(ceil(minPos.x - 0.5f)) - 1, 0) };
+    int xEnd { glm::min(static_cast<int>(floor(maxPos.x - 0.5f)) + 1, static_cast<int>(resolution.x) - 1) };
+    int yBegin { glm::max(static_cast<int>(ceil(minPos.y - 0.5f)) - 1, 0) };
+    int yEnd { glm::min(static_cast<int>(floor(maxPos.y - 0.5f)) + 1, static_cast<int>(resolution.y) - 1) };
+
+    // The box is visible if any of those pixels is farther away than its nearest point (or has no occluder at all).
+    for (int y { yBegin }; y <= yEnd; y++)
+    {
+        const float* row { &depth[y * resolution.x] };
+
+#ifdef OCCLUSION_CULLER_SSE
+        const __m128 boxDepth = _mm_set1_ps(nearestDepth);
+        for (int x { xBegin & ~3 }; x <= xEnd; x += 4)
+        {
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+            {
+                return Visibility::VISIBLE;
+            }
+        }
+#else
+        for (int x { xBegin }; x <= xEnd; x++)
+        {
+            if (row[x] < nearestDepth)
+            {
+                return Visibility::VISIBLE;
+            }
+        }
+#endif
+    }
+
+    return Visibility::OCCLUDED;
+}
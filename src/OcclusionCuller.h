@@ -0,0 +1,100 @@
+#pragma once
+#include "ofMain.h"
+#include "CellManager.h"
+#include "JobSystem.h"
+
+// Culls terrain cells hidden behind nearer hills, on the CPU, before they're drawn.
+// The coarse occluders of the nearest cells (see Cell::occluderHeights), which never rise above the real terrain, are rasterized
+// into a small depth buffer; every cell's bounding box is then projected and kept only if some pixel it covers is farther away
+// than the nearest point of the box.  The buffer holds 1 / w (which interpolates linearly across the screen and keeps its precision
+// at a distance), with larger values nearer.  The screen is split into bands of rows that are rasterized as separate jobs,
+// and each job fills and tests four pixels at a time with SSE where it's available.
+// Occluders only count for the pixel centers they cover, so the tests look one pixel beyond each box's edges,
+// which stops a box peeking out from behind a ridge by less than a pixel from being culled.
+class OcclusionCuller
+{
+public:
+    // The counts and cost of the last frame's culling.
+    struct Stats
+    {
+        // The number of cells rasterized as occluders, and their triangles.
+        size_t occluderCells { 0 };
+        size_t occluderTriangles { 0 };
+
+        // The number of cells tested, and how many of them were hidden behind the occluders or outside the view.
+        size_t testedCells { 0 };
+        size_t occludedCells { 0 };
+        size_t offscreenCells { 0 };
+
+        // The time spent rasterizing and testing, in milliseconds.
+        double milliseconds { 0 };
+    };
+
+    // Sets up a depth buffer of a particular size; the width is rounded up to a multiple of four.
+    OcclusionCuller(glm::uvec2 resolution = glm::uvec2(256, 128));
+
+    // Don't support copy constructor or copy assignment operator.
+    OcclusionCuller(const OcclusionCuller& o) = delete;
+    OcclusionCuller& operator= (const OcclusionCuller& o) = delete;
+
+    // Clears the depth buffer and rasterizes the occluders of the first "maxOccluders" cells of a list (which should be sorted front to back)
+    // as seen through a view-projection matrix.  Starts a new frame of stats.  Must be called from a thread that can wait on jobs.
+    void renderOccluders(const glm::mat4& viewProjection, const std::vector<Cell*>& cells, size_t maxOccluders, JobSystem& jobSystem);
+
+    // Copies the cells of a list that aren't hidden behind the occluders, in the same order, to another list.
+    void cullCells(const std::vector<Cell*>& cells, std::vector<Cell*>& visibleCells, JobSystem& jobSystem);
+
+    // Gets the counts and cost of the culling since the last call to renderOccluders().
+    const Stats& getStats() const;
+
+private:
+    // The result of testing a cell.
+    enum class Visibility : uint8_t
+    {
+        VISIBLE,
+        OCCLUDED,
+        OFFSCREEN
+    };
+
+    // A vertex of an occluder in screen space: x and y in pixels, and 1 / w.
+    struct ScreenVertex
+    {
+        glm::vec3 position;
+
+        // True if the vertex is in front of the camera; triangles with a vertex that isn't are skipped.
+        bool valid;
+    };
+
+    // The number of rows in each band rasterized by a single job.
+    const static unsigned int BAND_HEIGHT { 16 };
+
+    // The size of the depth buffer, in pixels.
+    glm::uvec2 resolution;
+
+    // The depth buffer: 1 / w for each pixel, row by row from the bottom, zero where there's no occluder.
+    std::vector<float> depth {};
+
+    // The view-projection matrix the occluders were rasterized with.
+    glm::mat4 viewProjection {};
+
+    // The screen-space vertices of every occluder, (Cell::OCCLUDER_RESOLUTION + 1) squared per cell.
+    std::vector<ScreenVertex> screenVertices {};
+
+    // The number of occluder cells whose vertices are in the screen-space vertices.
+    size_t occluderCount { 0 };
+
+    // The result of each test in the last call to cullCells().
+    std::vector<Visibility> results {};
+
+    // The stats since the last call to renderOccluders().
+    Stats stats {};
+
+    // Projects a point in world space to screen space.
+    ScreenVertex project(glm::vec3 position) const;
+
+    // Rasterizes a triangle into the rows [rowBegin, rowEnd) of the depth buffer.
+    void rasterizeTriangle(const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, int rowBegin, int rowEnd);
+
+    // Tests a cell's bounding box against the depth buffer.
+    Visibility testCell(const Cell& cell) const;
+};
@@ -0,0 +1,227 @@
+#include "Profiler.h"
+
+// How quickly the smoothed times follow new results; about the last 20 frames count.
+static const double SMOOTHING { 0.05 };
+
+void Profiler::setEnabled(bool enabled)
+{
+    enableRequested = enabled;
+}
+
+bool Profiler::isEnabled() const
+{
+    return enableRequested;
+}
+
+void Profiler::beginFrame()
+{
+    // Scopes that were left open belong to the last frame; drop them.
+    openCPUSamples.clear();
+    if (gpuScopeOpen)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        gpuScopeOpen = false;
+    }
+
+    if (enabled != enableRequested)
+    {
+        // Forget any frames in flight; their queries are simply reused.
+        for (Frame& frame : frames)
+        {
+            for (const Sample& sample : frame.samples)
+            {
+                if (sample.query != 0)
+                {
+                    freeQueries.push_back(sample.query);
+                }
+            }
+
+            frame.samples.clear();
+        }
+
+        enabled = enableRequested;
+    }
+
+    if (!enabled)
+    {
+        return;
+    }
+
+    // The oldest frame in the ring is the one the GPU has had longest to finish.
+    currentFrame = (currentFrame + 1) % FRAME_LATENCY;
+    collect(frames[currentFrame]);
+    frames[currentFrame].frameNumber = ofGetFrameNum();
+}
+
+void Profiler::beginCPU(const std::string& name)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    std::vector<Sample>& samples { frames[currentFrame].samples };
+    openCPUSamples.push_back(samples.size());
+    samples.push_back(Sample { getStatIndex(name, false), 0, std::chrono::steady_clock::now(), 0 });
+}
+
+void Profiler::endCPU()
+{
+    if (!enabled || openCPUSamples.empty())
+    {
+        return;
+    }
+
+    Sample& sample { frames[currentFrame].samples[openCPUSamples.back()] };
+    sample.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - sample.start).count();
+    openCPUSamples.pop_back();
+}
+
+void Profiler::addCPU(const std::string& name, double milliseconds)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    frames[currentFrame].samples.push_back(Sample { getStatIndex(name, false), 0, {}, milliseconds });
+}
+
+void Profiler::beginGPU(const std::string& name)
+{
+    if (!enabled)
+    {
+        return;
+    }
+
+    // GL_TIME_ELAPSED queries can't overlap.
+    assert(!gpuScopeOpen);
+
+    GLuint query { 0 };
+    if (freeQueries.empty())
+    {
+        glGenQueries(1, &query);
+        allQueries.push_back(query);
+    }
+    else
+    {
+        query = freeQueries.back();
+        freeQueries.pop_back();
+    }
+
+    frames[currentFrame].samples.push_back(Sample { getStatIndex(name, true), query, {}, 0 });
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    gpuScopeOpen = true;
+}
+
+void Profiler::endGPU()
+{
+    if (!enabled || !gpuScopeOpen)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    gpuScopeOpen = false;
+}
+
+bool Profiler::openCSV(const std::filesystem::path& path)
+{
+    csv.close();
+    csv.clear();
+    csv.open(ofToDataPath(path, true), std::ios::trunc);
+    if (!csv)
+    {
+        ofLogWarning("Profiler") << "Failed to open " << path;
+        return false;
+    }
+
+    csv << "frame,type,scope,milliseconds" << endl;
+    return true;
+}
+
+void Profiler::drawOverlay(float x, float y, const std::string& header) const
+{
+    std::ostringstream text {};
+    text << std::fixed << std::setprecision(2) << header;
+    for (const Stat& stat : stats)
+    {
+        text << (stat.gpu ? "GPU " : "CPU ") << stat.name << ": " << stat.averageMilliseconds << " ms" << endl;
+    }
+
+    ofDrawBitmapStringHighlight(text.str(), x, y);
+}
+
+void Profiler::clear()
+{
+    if (!allQueries.empty())
+    {
+        glDeleteQueries(static_cast<GLsizei>(allQueries.size()), allQueries.data());
+    }
+
+    allQueries.clear();
+    freeQueries.clear();
+    for (Frame& frame : frames)
+    {
+        frame.samples.clear();
+    }
+
+    gpuScopeOpen = false;
+    csv.close();
+}
+
+size_t Profiler::getStatIndex(const std::string& name, bool gpu)
+{
+    std::unordered_map<std::string, size_t>& indices { gpu ? gpuStatIndices : cpuStatIndices };
+
+    auto existing { indices.find(name) };
+    if (existing != indices.end())
+    {
+        return existing->second;
+    }
+
+    stats.push_back(Stat { name, gpu, 0, 0 });
+    indices[name] = stats.size() - 1;
+    return stats.size() - 1;
+}
+
+void Profiler::collect(Frame& frame)
+{
+    for (Sample& sample : frame.samples)
+    {
+        if (sample.query != 0)
+        {
+            // Never wait on the GPU; if the result still isn't ready after FRAME_LATENCY frames, drop it.
+            GLuint available { 0 };
+            glGetQueryObjectuiv(sample.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            bool ready { available != 0 };
+            if (ready)
+            {
+                GLuint64 nanoseconds { 0 };
+                glGetQueryObjectui64v(sample.query, GL_QUERY_RESULT, &nanoseconds);
+                sample.milliseconds = nanoseconds * 1.0e-6;
+            }
+
+            freeQueries.push_back(sample.query);
+
+            if (!ready)
+            {
+                continue;
+            }
+        }
+
+        Stat& stat { stats[sample.stat] };
+        // Start from the first result rather than ramping up from zero.
+        stat.averageMilliseconds = stat.sampleCount == 0 ? sample.milliseconds
+            : stat.averageMilliseconds + (sample.milliseconds - stat.averageMilliseconds) * SMOOTHING;
+        stat.sampleCount++;
+
+        if (csv.is_open())
+        {
+            csv << frame.frameNumber << "," << (stat.gpu ? "gpu" : "cpu") << "," << stat.name << "," << sample.milliseconds << "\n";
+        }
+    }
+
+    frame.samples.clear();
+}
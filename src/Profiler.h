@@ -0,0 +1,135 @@
+#pragma once
+#include "ofMain.h"
+
+// A lightweight frame profiler for named CPU and GPU scopes.
+// CPU scopes are timed with a steady clock and may nest.  GPU scopes are timed with GL_TIME_ELAPSED queries, which can't nest or overlap,
+// so GPU scopes must follow one another.  Each frame's queries are only read FRAME_LATENCY frames later, by which point the GPU
+// has finished them, so reading a result never stalls the pipeline; a query that still isn't ready is dropped rather than waited on.
+// Results are smoothed for an on-screen overlay and, if a CSV file is open, written to it one row per scope per frame.
+// Only use a profiler from the thread that owns the GL context.
+class Profiler
+{
+public:
+    // The number of frames in flight; queries from a frame are read this many frames later.
+    const static unsigned int FRAME_LATENCY { 3 };
+
+    Profiler() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    Profiler(const Profiler& p) = delete;
+    Profiler& operator= (const Profiler& p) = delete;
+
+    // Turns the profiler on or off, starting with the next frame.  Scopes cost almost nothing while it's off.
+    void setEnabled(bool enabled);
+
+    // Returns true if the profiler is (or will be from the next frame) turned on.
+    bool isEnabled() const;
+
+    // Starts a new frame, collecting the results of the frame FRAME_LATENCY frames ago.
+    // This should be called at the start of your ofApp::update() function.
+    void beginFrame();
+
+    // Starts and ends a CPU scope.  CPU scopes may nest; each end closes the most recently started scope.
+    void beginCPU(const std::string& name);
+    void endCPU();
+
+    // Starts and ends a GPU scope, timing the GL commands issued in between.  GPU scopes can't nest.
+    void beginGPU(const std::string& name);
+    void endGPU();
+
+    // Adds a CPU time measured some other way (such as work done on other threads during the frame) as a scope of the current frame.
+    void addCPU(const std::string& name, double milliseconds);
+
+    // Starts writing every collected result to a CSV file (frame, type, scope, milliseconds), replacing the file.  Returns false on failure.
+    bool openCSV(const std::filesystem::path& path);
+
+    // Draws the smoothed time of every scope seen so far as text, below a header of other stats (which may be empty),
+    // with its top-left corner at a particular position in screen space.
+    void drawOverlay(float x, float y, const std::string& header) const;
+
+    // Deletes the GL queries.  Must be called with a GL context (e.g. from your ofApp::exit() function).
+    void clear();
+
+private:
+    // A scope timed during a particular frame.
+    struct Sample
+    {
+        // The index of the scope's statistics.
+        size_t stat;
+
+        // The query timing a GPU scope (zero for a CPU scope).
+        GLuint query;
+
+        // When a CPU scope started.
+        std::chrono::steady_clock::time_point start;
+
+        // How long a CPU scope took, once it has ended.
+        double milliseconds;
+    };
+
+    // The scopes timed during a frame that hasn't been collected yet.
+    struct Frame
+    {
+        // The frame number, for the CSV file.
+        uint64_t frameNumber { 0 };
+
+        // Every scope timed during the frame, in the order they started.
+        std::vector<Sample> samples {};
+    };
+
+    // The running statistics of a named scope.
+    struct Stat
+    {
+        // The scope's name.
+        std::string name;
+
+        // True if it's a GPU scope.
+        bool gpu;
+
+        // The smoothed time taken by the scope, in milliseconds.
+        double averageMilliseconds;
+
+        // The number of results collected so far.
+        uint64_t sampleCount;
+    };
+
+    // Set to true to turn the profiler on from the next frame.
+    bool enableRequested { false };
+
+    // True while the profiler is on.
+    bool enabled { false };
+
+    // The last FRAME_LATENCY frames, used as a ring.
+    Frame frames[FRAME_LATENCY] {};
+
+    // The frame currently being timed.
+    size_t currentFrame { 0 };
+
+    // The statistics of every scope seen so far, in the order they were first seen.
+    std::vector<Stat> stats {};
+
+    // The index of each CPU and GPU scope's statistics, by name.
+    std::unordered_map<std::string, size_t> cpuStatIndices {};
+    std::unordered_map<std::string, size_t> gpuStatIndices {};
+
+    // The samples of the CPU scopes that have started but not ended, innermost last.
+    std::vector<size_t> openCPUSamples {};
+
+    // True while a GPU scope is open.
+    bool gpuScopeOpen { false };
+
+    // Queries that aren't in use.
+    std::vector<GLuint> freeQueries {};
+
+    // Every query created, so that they can be deleted.
+    std::vector<GLuint> allQueries {};
+
+    // The CSV file results are written to, if open.
+    std::ofstream csv {};
+
+    // Gets the index of a scope's statistics, adding them if this is the first time the scope has been seen.
+    size_t getStatIndex(const std::string& name, bool gpu);
+
+    // Reads the results of a frame, folding them into the statistics and the CSV file, and recycles its queries.
+    void collect(Frame& frame);
+};
@@ -0,0 +1,276 @@
+#include "SceneObjects.h"
+#include <random>
+
+using namespace glm;
+
+SceneObjects::SceneObjects(const World& world, float obstacleCellSize)
+    : world { world }, obstacles { obstacleCellSize }
+{
+}
+
+size_t SceneObjects::addModel(const ofMesh& mesh, const ofTexture& texture, const ScatterSettings& settings)
+{
+    models.push_back(std::make_unique<Model>());
+    Model& model { *models.back() };
+
+    model.vbo.setMesh(mesh, GL_STATIC_DRAW);
+    model.indexCount = static_cast<unsigned int>(mesh.getNumIndices());
+    model.vertexCount = static_cast<unsigned int>(mesh.getNumVertices());
+    model.texture = texture;
+    model.settings = settings;
+
+    return models.size() - 1;
+}
+
+void SceneObjects::loadCell(vec2 cellStartPos, vec2 cellSize)
+{
+    uint64_t key { getCellKey(cellStartPos, cellSize) };
+
+    // Do the placement (which samples the terrain) outside of the lock.
+    std::vector<Instance> instances {};
+    scatter(key, cellStartPos, cellSize, instances);
+
+    std::lock_guard<std::mutex> lock { pendingMutex };
+    pendingChanges.push_back(CellChange { key, true, std::move(instances) });
+}
+
+void SceneObjects::unloadCell(vec2 cellStartPos, vec2 cellSize)
+{
+    std::lock_guard<std::mutex> lock { pendingMutex };
+    pendingChanges.push_back(CellChange { getCellKey(cellStartPos, cellSize), false, {} });
+}
+
+void SceneObjects::update()
+{
+    applyChanges();
+    uploadChanges();
+}
+
+void SceneObjects::applyChanges()
+{
+    std::vector<CellChange> changes {};
+
+    {
+        std::lock_guard<std::mutex> lock { pendingMutex };
+        changes.swap(pendingChanges);
+    }
+
+    // Apply the changes in order, so a cell that was unloaded and loaded again ends up loaded.
+    for (CellChange& change : changes)
+    {
+        auto existing { cells.find(change.key) };
+        if (existing != cells.end())
+        {
+            // Remove the cell's old props.
+            for (size_t id : existing->second.obstacleIds)
+            {
+                obstacles.remove(id);
+                freeObstacleIds.push_back(id);
+            }
+
+            for (const Instance& instance : existing->second.instances)
+            {
+                models[instance.model]->dirty = true;
+            }
+
+            cells.erase(existing);
+        }
+
+        if (change.loaded)
+        {
+            CellObjects& cell { cells[change.key] };
+            cell.instances = std::move(change.instances);
+
+            for (const Instance& instance : cell.instances)
+            {
+                models[instance.model]->dirty = true;
+
+                if (models[instance.model]->settings.obstacleRadius > 0)
+                {
+                    size_t id { nextObstacleId };
+                    if (freeObstacleIds.empty())
+                    {
+                        nextObstacleId++;
+                    }
+                    else
+                    {
+                        id = freeObstacleIds.back();
+                        freeObstacleIds.pop_back();
+                    }
+
+                    obstacles.update(id, instance.capsule);
+                    cell.obstacleIds.push_back(id);
+                }
+            }
+        }
+    }
+
+    for (size_t model { 0 }; model < models.size(); model++)
+    {
+        if (models[model]->dirty)
+        {
+            stageTransforms(model);
+        }
+    }
+}
+
+void SceneObjects::uploadChanges()
+{
+    if (!hasStagedTransforms.exchange(false))
+    {
+        return;
+    }
+
+    for (size_t model { 0 }; model < models.size(); model++)
+    {
+        {
+            std::lock_guard<std::mutex> lock { stagingMutex };
+            if (!models[model]->staged)
+            {
+                continue;
+            }
+
+            models[model]->uploadBuffer.swap(models[model]->stagedTransforms);
+            models[model]->staged = false;
+        }
+
+        uploadTransforms(model);
+    }
+}
+
+void SceneObjects::draw(ShaderProgram& shader, int textureLocation)
+{
+    GLint texUniform { shader.getUniformLocation("tex") };
+
+    for (const std::unique_ptr<Model>& model : models)
+    {
+        if (model->instanceCount == 0)
+        {
+            continue;
+        }
+
+        shader.setUniformTexture(texUniform, model->texture, textureLocation);
+
+        if (model->indexCount > 0)
+        {
+            model->vbo.drawElementsInstanced(GL_TRIANGLES, model->indexCount, static_cast<int>(model->instanceCount));
+        }
+        else
+        {
+            model->vbo.drawInstanced(GL_TRIANGLES, 0, model->vertexCount, static_cast<int>(model->instanceCount));
+        }
+    }
+}
+
+const SpatialHash& SceneObjects::getObstacles() const
+{
+    return obstacles;
+}
+
+size_t SceneObjects::getInstanceCount() const
+{
+    size_t count { 0 };
+    for (const std::unique_ptr<Model>& model : models)
+    {
+        count += model->instanceCount;
+    }
+
+    return count;
+}
+
+size_t SceneObjects::getModelCount() const
+{
+    return models.size();
+}
+
+uint64_t SceneObjects::getCellKey(vec2 cellStartPos, vec2 cellSize)
+{
+    // Cells are always aligned to the grid, so their indices identify them exactly, despite any round-off in the start position.
+    ivec2 indices { round(cellStartPos / cellSize) };
+    return (static_cast<uint64_t>(static_cast<uint32_t>(indices.x)) << 32) | static_cast<uint32_t>(indices.y);
+}
+
+void SceneObjects::scatter(uint64_t key, vec2 cellStartPos, vec2 cellSize, std::vector<Instance>& instances) const
+{
+    // Seed from the cell so that it gets the same props every time.
+    std::mt19937 random { static_cast<std::mt19937::result_type>(key ^ (key >> 32)) };
+    std::uniform_real_distribution<float> unit { 0.0f, 1.0f };
+
+    for (size_t model { 0 }; model < models.size(); model++)
+    {
+        const ScatterSettings& settings { models[model]->settings };
+
+        for (unsigned int i { 0 }; i < settings.instancesPerCell; i++)
+        {
+            // Always draw every random number, so that skipping one prop doesn't move all of the others.
+            vec2 position { cellStartPos + vec2(unit(random), unit(random)) * cellSize };
+            float angle { unit(random) * 2 * pi<float>() };
+            float scale { mix(settings.minScale, settings.maxScale, unit(random)) };
+
+            vec3 ground { position.x, 0, position.y };
+            ground.y = world.getTerrainHeightAtPosition(ground);
+
+            // Props don't grow out of the water.
+            if (ground.y < world.waterHeight)
+            {
+                continue;
+            }
+
+            Instance instance {};
+            instance.model = model;
+            instance.transform = translate(ground) * rotate(angle, vec3(0, 1, 0)) * glm::scale(vec3(scale));
+            instance.capsule = Capsule { ground + vec3(0, settings.obstacleHeight * scale, 0),
+                settings.obstacleHeight * scale, settings.obstacleRadius * scale };
+            instances.push_back(instance);
+        }
+    }
+}
+
+void SceneObjects::stageTransforms(size_t modelIndex)
+{
+    Model& model { *models[modelIndex] };
+
+    transformBuffer.clear();
+    for (const auto& cell : cells)
+    {
+        for (const Instance& instance : cell.second.instances)
+        {
+            if (instance.model == modelIndex)
+            {
+                transformBuffer.push_back(instance.transform);
+            }
+        }
+    }
+
+    model.dirty = false;
+
+    {
+        // Swapping hands the old staged buffer back as scratch space, so neither side reallocates once the buffers have grown.
+        std::lock_guard<std::mutex> lock { stagingMutex };
+        model.stagedTransforms.swap(transformBuffer);
+        model.staged = true;
+    }
+
+    hasStagedTransforms = true;
+}
+
+void SceneObjects::uploadTransforms(size_t modelIndex)
+{
+    Model& model { *models[modelIndex] };
+
+    model.instanceCount = model.uploadBuffer.size();
+
+    if (model.uploadBuffer.empty())
+    {
+        return;
+    }
+
+    model.transforms.allocate(model.uploadBuffer, GL_DYNAMIC_DRAW);
+
+    // A mat4 attribute takes four consecutive locations, one per column, after the standard position, color, normal and texcoord attributes.
+    for (int column { 0 }; column < 4; column++)
+    {
+        model.vbo.setAttributeBuffer(4 + column, model.transforms, 4, sizeof(mat4), column * sizeof(vec4));
+        model.vbo.setAttributeDivisor(4 + column, 1);
+    }
+}
@@ -0,0 +1,195 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "ShaderProgram.h"
+#include "SpatialHash.h"
+
+// Scatters repeated props (swords, rocks, markers, ...) across the terrain and draws them with instancing.
+// Instances are grouped by model (a mesh and its texture); each group keeps every instance's transform in a single GPU buffer
+// and is drawn with one instanced call, so thousands of props cost a handful of draw calls.
+// The props belong to terrain cells: a cell manager calls loadCell() when it builds a cell and unloadCell() when it evicts one,
+// and the props come and go with the terrain.  Props that are solid are also added to a broadphase that characters can collide with.
+// Applying the changes and uploading the transforms are separate steps, so that the props can be simulated on a different thread
+// from the one that owns the GL context.
+class SceneObjects
+{
+public:
+    // How a model is scattered over each cell.
+    struct ScatterSettings
+    {
+        // The number of instances placed in each cell (fewer if some would be under water).
+        unsigned int instancesPerCell { 16 };
+
+        // The range of uniform scales applied to the model.
+        float minScale { 1.0f };
+        float maxScale { 1.0f };
+
+        // The radius and height of the capsule that characters collide with, in model units (before scaling).
+        // A radius of zero means the props aren't solid.
+        float obstacleRadius { 0.0f };
+        float obstacleHeight { 0.0f };
+    };
+
+    // Sets up an empty set of props; the obstacle broadphase uses grid cells of a particular size (in world space).
+    SceneObjects(const World& world, float obstacleCellSize);
+
+    // Don't support copy constructor or copy assignment operator.
+    SceneObjects(const SceneObjects& s) = delete;
+    SceneObjects& operator= (const SceneObjects& s) = delete;
+
+    // Adds a model to scatter over every cell and returns its index.  Must be called with a GL context,
+    // before any cells are loaded (cells are loaded from other threads, which read the models).
+    size_t addModel(const ofMesh& mesh, const ofTexture& texture, const ScatterSettings& settings);
+
+    // Places the props for a terrain cell starting at a particular corner (in world space).
+    // Placement is deterministic, so a cell gets the same props every time it's loaded.
+    // Safe to call from any thread (such as a job building the cell); the props appear after the next call to update().
+    void loadCell(glm::vec2 cellStartPos, glm::vec2 cellSize);
+
+    // Removes the props for the terrain cell starting at a particular corner.
+    // Safe to call from any thread; the props disappear after the next call to update().
+    void unloadCell(glm::vec2 cellStartPos, glm::vec2 cellSize);
+
+    // Applies the cells loaded and unloaded since the last update, re-uploading the transforms of any model whose instances changed.
+    // This should be called from your ofApp::update() function.  Equivalent to applyChanges() followed by uploadChanges().
+    void update();
+
+    // Applies the cells loaded and unloaded since the last call, updating the obstacles and gathering the transforms
+    // of any model whose instances changed.  Doesn't touch GL, so it can be called from a simulation thread;
+    // only that thread may then read the obstacles.
+    void applyChanges();
+
+    // Uploads the transforms gathered by applyChanges() since the last call.  Must be called with a GL context;
+    // only takes a lock if some props have changed.
+    void uploadChanges();
+
+    // Draws every model using a shader that has already been started; the shader should be instanced.vert (or something compatible).
+    // Each model's texture is bound to a particular texture unit as "tex".
+    void draw(ShaderProgram& shader, int textureLocation);
+
+    // Gets the broadphase containing every solid prop currently loaded.
+    const SpatialHash& getObstacles() const;
+
+    // Gets the number of props currently loaded.
+    size_t getInstanceCount() const;
+
+    // Gets the number of models (and therefore draw calls).
+    size_t getModelCount() const;
+
+private:
+    // A single prop.
+    struct Instance
+    {
+        // The index of the prop's model.
+        size_t model;
+
+        // The transform from model space to world space.
+        glm::mat4 transform;
+
+        // The prop's collision shape (only used if the model's props are solid).
+        Capsule capsule;
+    };
+
+    // The props belonging to a single loaded cell.
+    struct CellObjects
+    {
+        // Every prop in the cell.
+        std::vector<Instance> instances {};
+
+        // The broadphase IDs of the cell's solid props.
+        std::vector<size_t> obstacleIds {};
+    };
+
+    // A cell that was loaded or unloaded but hasn't been applied yet.
+    struct CellChange
+    {
+        // The cell's key (see getCellKey()).
+        uint64_t key;
+
+        // True if the cell was loaded, false if it was unloaded.
+        bool loaded;
+
+        // The cell's props, if it was loaded.
+        std::vector<Instance> instances;
+    };
+
+    // The geometry, texture, and instances of a single model.
+    struct Model
+    {
+        // The model's mesh, along with the per-instance transforms.
+        ofVbo vbo {};
+
+        // The number of indices in the mesh (or zero if it isn't indexed).
+        unsigned int indexCount { 0 };
+
+        // The number of vertices in the mesh.
+        unsigned int vertexCount { 0 };
+
+        // The model's texture.
+        ofTexture texture {};
+
+        // How the model is scattered.
+        ScatterSettings settings {};
+
+        // The transform of every instance, one mat4 per instance.
+        ofBufferObject transforms {};
+
+        // The number of instances in the transform buffer.
+        size_t instanceCount { 0 };
+
+        // Set to true when the model's instances have changed and need to be gathered again.
+        bool dirty { false };
+
+        // The transforms gathered by applyChanges() but not uploaded yet, and true while there are some.  Guarded by the staging mutex.
+        std::vector<glm::mat4> stagedTransforms {};
+        bool staged { false };
+
+        // The transforms being uploaded by uploadChanges(), swapped with the staged ones so that the upload happens outside the lock.
+        std::vector<glm::mat4> uploadBuffer {};
+    };
+
+    // The world the props are placed on.
+    const World& world;
+
+    // Every model; models are never removed, so pointers remain valid.
+    std::vector<std::unique_ptr<Model>> models {};
+
+    // The props in every loaded cell, by cell key.  Only touched by update().
+    std::unordered_map<uint64_t, CellObjects> cells {};
+
+    // Cells that have been loaded or unloaded since the last update, in order.
+    std::vector<CellChange> pendingChanges {};
+
+    // Guards the pending changes.
+    std::mutex pendingMutex {};
+
+    // Every solid prop currently loaded.
+    SpatialHash obstacles;
+
+    // Broadphase IDs that were used by props that have been unloaded, so that IDs stay small.
+    std::vector<size_t> freeObstacleIds {};
+
+    // The next broadphase ID to hand out when there are no free ones.
+    size_t nextObstacleId { 0 };
+
+    // Scratch space for gathering a model's transforms before staging them.
+    std::vector<glm::mat4> transformBuffer {};
+
+    // Guards the staged transforms of every model.
+    std::mutex stagingMutex {};
+
+    // True while any model has staged transforms, so that uploadChanges() can skip the lock when nothing has changed.
+    std::atomic<bool> hasStagedTransforms { false };
+
+    // Gets a key identifying the cell starting at a particular corner.
+    static uint64_t getCellKey(glm::vec2 cellStartPos, glm::vec2 cellSize);
+
+    // Chooses where the props go in a cell.
+    void scatter(uint64_t key, glm::vec2 cellStartPos, glm::vec2 cellSize, std::vector<Instance>& instances) const;
+
+    // Gathers the transforms of every instance of a model and stages them for upload.
+    void stageTransforms(size_t modelIndex);
+
+    // Uploads a model's transforms from its upload buffer.
+    void uploadTransforms(size_t modelIndex);
+};
@@ -0,0 +1,143 @@
+#include "ShaderCompiler.h"
+#include "GLFW/glfw3.h"
+#include "Tracer.h"
+
+ShaderCompiler::~ShaderCompiler()
+{
+    close();
+}
+
+bool ShaderCompiler::setup()
+{
+    close();
+
+    auto window { dynamic_pointer_cast<ofAppGLFWWindow>(ofGetCurrentWindow()) };
+    if (!window)
+    {
+        return false;
+    }
+
+    // The window hints that created the main window are still set, so the hidden context gets the same GL version and profile.
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    context = glfwCreateWindow(1, 1, "", nullptr, window->getGLFWWindow());
+    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+
+    if (!context)
+    {
+        ofLogWarning("ShaderCompiler") << "Couldn't create a shared GL context; shaders will be built on the main thread.";
+        return false;
+    }
+
+    closing = false;
+    thread = std::thread { [this]()
+    {
+        Tracer::setThreadName("shader compiler");
+        glfwMakeContextCurrent(context);
+
+        std::unique_lock<std::mutex> lock { mutex };
+        while (true)
+        {
+            condition.wait(lock, [this]() { return closing || pendingBuild; });
+
+            if (closing)
+            {
+                break;
+            }
+
+            std::function<bool()> build { std::move(pendingBuild) };
+            pendingBuild = nullptr;
+
+            // Don't hold the lock while building, so that the main thread can poll.
+            lock.unlock();
+            bool succeeded { build() };
+
+            // Make sure every command has completed before the main context uses the new programs.
+            glFinish();
+            lock.lock();
+
+            buildSucceeded = succeeded;
+            finished = true;
+            condition.notify_all();
+        }
+
+        glfwMakeContextCurrent(nullptr);
+    } };
+
+    return true;
+}
+
+bool ShaderCompiler::compile(std::function<bool()> build)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    if (busy)
+    {
+        return false;
+    }
+
+    busy = true;
+
+    if (!thread.joinable())
+    {
+        // No background context; build right away.
+        buildSucceeded = build();
+        finished = true;
+        return true;
+    }
+
+    finished = false;
+    pendingBuild = std::move(build);
+    condition.notify_all();
+    return true;
+}
+
+bool ShaderCompiler::poll(bool& succeeded)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    if (!busy || !finished)
+    {
+        return false;
+    }
+
+    succeeded = buildSucceeded;
+    busy = false;
+    return true;
+}
+
+bool ShaderCompiler::wait(bool& succeeded)
+{
+    std::unique_lock<std::mutex> lock { mutex };
+    if (!busy)
+    {
+        return false;
+    }
+
+    condition.wait(lock, [this]() { return finished; });
+
+    succeeded = buildSucceeded;
+    busy = false;
+    return true;
+}
+
+void ShaderCompiler::close()
+{
+    if (thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock { mutex };
+            closing = true;
+        }
+
+        condition.notify_all();
+        thread.join();
+    }
+
+    if (context)
+    {
+        glfwDestroyWindow(context);
+        context = nullptr;
+    }
+
+    pendingBuild = nullptr;
+    busy = false;
+    finished = false;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "ofMain.h"
+#include <condition_variable>
+
+struct GLFWwindow;
+
+// Builds shader programs on a background thread with its own hidden GL context, shared with the main window's, so that compiling
+// and linking never blocks a frame.  Programs are built in batches: a batch is a function that loads a set of ShaderPrograms
+// (which must not be touched by the main thread until the batch has finished), and the main thread polls for it to finish
+// before swapping the new programs in.
+// If a shared context can't be created, batches are simply built on the calling thread.
+class ShaderCompiler
+{
+public:
+    ShaderCompiler() = default;
+    ~ShaderCompiler();
+
+    // Don't support copy constructor or copy assignment operator.
+    ShaderCompiler(const ShaderCompiler& s) = delete;
+    ShaderCompiler& operator= (const ShaderCompiler& s) = delete;
+
+    // Creates the hidden context and starts the background thread.  Must be called from the main thread, with the window's context current.
+    // Returns false if there's no shared context, in which case batches will be built on the calling thread.
+    bool setup();
+
+    // Starts building a batch of programs; "build" returns true if every program it loaded linked successfully.
+    // Only one batch is built at a time: returns false (without building anything) if the last batch hasn't been collected by poll() yet.
+    bool compile(std::function<bool()> build);
+
+    // Returns true once the batch has finished, setting "succeeded" to the result of its build function; the programs are then safe
+    // to use on the main thread, and another batch can be started.  Returns false while the batch is still being built (or if there isn't one).
+    bool poll(bool& succeeded);
+
+    // Waits for the batch to finish and collects it like poll().  Returns false if there's no batch.
+    bool wait(bool& succeeded);
+
+    // Stops the background thread and destroys its context; called automatically by the destructor.
+    void close();
+
+private:
+    // The hidden window whose context the background thread uses.
+    GLFWwindow* context { nullptr };
+
+    // The background thread.
+    std::thread thread {};
+
+    // Guards the batch state below.
+    std::mutex mutex {};
+
+    // Signals the background thread when a batch is queued or the compiler is closed, and the main thread when a batch finishes.
+    std::condition_variable condition {};
+
+    // The batch waiting for the background thread, if any.
+    std::function<bool()> pendingBuild {};
+
+    // True from when a batch is started until it's collected.
+    bool busy { false };
+
+    // True once the batch has finished.
+    bool finished { false };
+
+    // The result of the finished batch.
+    bool buildSucceeded { false };
+
+    // Set to true to stop the background thread.
+    bool closing { false };
+};
@@ -0,0 +1,470 @@
+#include "ShaderProgram.h"
+#include "hashBytes.h"
+
+using namespace glm;
+
+// The directory (relative to the data folder) containing the cached program binaries.
+static const std::filesystem::path CACHE_DIRECTORY { "shader_cache" };
+
+// How deeply "#pragma include" files may nest, as in ofShader.
+static const unsigned int MAX_INCLUDE_DEPTH { 32 };
+
+// An empty ofShader that's bound to openFrameworks' renderer while a program is in use.
+// ofGLProgrammableRenderer switches to its own default shader before drawing a mesh or vbo unless a custom shader has been bound
+// through bind(const ofShader&), the call ofShader::begin() makes, and it only accepts an ofShader there.  Binding this one through
+// that same public call marks a custom shader as in use; because it isn't loaded, the matrix and color uniforms the renderer then
+// sets on it are ignored, and begin() makes the real program current straight afterwards.  This relies on openFrameworks 0.11's renderer
+// not calling glUseProgram() again for the bound shader until the next bind() or unbind(), which holds for every drawing call this app makes.
+static const ofShader& getRendererShader()
+{
+    static const ofShader shader {};
+    return shader;
+}
+
+ShaderProgram::~ShaderProgram()
+{
+    unload();
+}
+
+ShaderProgram::ShaderProgram(ShaderProgram&& s) noexcept
+    : program { s.program }, uniformLocations { std::move(s.uniformLocations) }
+{
+    s.program = 0;
+    s.uniformLocations.clear();
+}
+
+ShaderProgram& ShaderProgram::operator= (ShaderProgram&& s) noexcept
+{
+    if (this != &s)
+    {
+        unload();
+        program = s.program;
+        uniformLocations = std::move(s.uniformLocations);
+        s.program = 0;
+        s.uniformLocations.clear();
+    }
+
+    return *this;
+}
+
+bool ShaderProgram::load(const std::filesystem::path& vertexPath, const std::filesystem::path& fragmentPath)
+{
+    return load({ { GL_VERTEX_SHADER, vertexPath }, { GL_FRAGMENT_SHADER, fragmentPath } });
+}
+
+bool ShaderProgram::load(const std::vector<Stage>& stages)
+{
+    unload();
+
+    // Read every stage with its includes pasted in, so that editing an included file changes the cache key too.
+    std::vector<std::string> sources {};
+    for (const Stage& stage : stages)
+    {
+        ofBuffer buffer { ofBufferFromFile(stage.path) };
+        if (buffer.size() == 0)
+        {
+            ofLogError("ShaderProgram") << "Failed to read " << stage.path;
+            return false;
+        }
+
+        sources.push_back(resolveIncludes(buffer.getText(), stage.path.parent_path()));
+    }
+
+    std::filesystem::path cachePath { getCachePath(stages, sources) };
+    if (cachePath.empty() || !loadBinary(cachePath))
+    {
+        if (!compile(stages, sources))
+        {
+            return false;
+        }
+
+        if (!cachePath.empty())
+        {
+            storeBinary(cachePath);
+        }
+    }
+
+    resolveUniformLocations();
+    return true;
+}
+
+void ShaderProgram::unload()
+{
+    if (program != 0)
+    {
+        glDeleteProgram(program);
+        program = 0;
+    }
+
+    uniformLocations.clear();
+}
+
+bool ShaderProgram::isLoaded() const
+{
+    return program != 0;
+}
+
+GLuint ShaderProgram::getProgram() const
+{
+    return program;
+}
+
+void ShaderProgram::begin() const
+{
+    // The renderer makes its (empty) shader current, so use the real program afterwards.
+    ofGetGLRenderer()->bind(getRendererShader());
+    glUseProgram(program);
+}
+
+void ShaderProgram::end() const
+{
+    ofGetGLRenderer()->unbind(getRendererShader());
+}
+
+GLint ShaderProgram::getUniformLocation(const std::string& name) const
+{
+    auto existing { uniformLocations.find(name) };
+    return existing != uniformLocations.end() ? existing->second : -1;
+}
+
+void ShaderProgram::setUniform1i(GLint location, int value) const
+{
+    glUniform1i(location, value);
+}
+
+void ShaderProgram::setUniform2i(GLint location, int x, int y) const
+{
+    glUniform2i(location, x, y);
+}
+
+void ShaderProgram::setUniform1f(GLint location, float value) const
+{
+    glUniform1f(location, value);
+}
+
+void ShaderProgram::setUniform2f(GLint location, const vec2& value) const
+{
+    glUniform2f(location, value.x, value.y);
+}
+
+void ShaderProgram::setUniform3f(GLint location, const vec3& value) const
+{
+    glUniform3f(location, value.x, value.y, value.z);
+}
+
+void ShaderProgram::setUniform1i(const std::string& name, int value) const
+{
+    setUniform1i(getUniformLocation(name), value);
+}
+
+void ShaderProgram::setUniform2i(const std::string& name, int x, int y) const
+{
+    setUniform2i(getUniformLocation(name), x, y);
+}
+
+void ShaderProgram::setUniform1f(const std::string& name, float value) const
+{
+    setUniform1f(getUniformLocation(name), value);
+}
+
+void ShaderProgram::setUniform2f(const std::string& name, const vec2& value) const
+{
+    setUniform2f(getUniformLocation(name), value);
+}
+
+void ShaderProgram::setUniform3f(const std::string& name, const vec3& value) const
+{
+    setUniform3f(getUniformLocation(name), value);
+}
+
+void ShaderProgram::setUniformTexture(GLint location, const ofTexture& texture, int textureLocation) const
+{
+    const ofTextureData& textureData { texture.getTextureData() };
+    glActiveTexture(GL_TEXTURE0 + textureLocation);
+    glBindTexture(textureData.textureTarget, textureData.textureID);
+    glActiveTexture(GL_TEXTURE0);
+    setUniform1i(location, textureLocation);
+}
+
+void ShaderProgram::setUniformTexture(const std::string& name, const ofTexture& texture, int textureLocation) const
+{
+    setUniformTexture(getUniformLocation(name), texture, textureLocation);
+}
+
+void ShaderProgram::setUniformTexture(const std::string& name, GLenum textureTarget, GLint textureID, int textureLocation) const
+{
+    glActiveTexture(GL_TEXTURE0 + textureLocation);
+    glBindTexture(textureTarget, textureID);
+    glActiveTexture(GL_TEXTURE0);
+    setUniform1i(name, textureLocation);
+}
+
+void ShaderProgram::resolveUniformLocations()
+{
+    uniformLocations.clear();
+
+    GLint uniformCount { 0 };
+    GLint maxNameLength { 0 };
+    glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniformCount);
+    glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+    std::vector<char> nameBuffer(std::max(maxNameLength, 1));
+    for (GLint i { 0 }; i < uniformCount; i++)
+    {
+        GLsizei nameLength { 0 };
+        GLint size { 0 };
+        GLenum type { 0 };
+        glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(nameBuffer.size()), &nameLength, &size, &type, nameBuffer.data());
+
+        std::string name { nameBuffer.data(), static_cast<size_t>(nameLength) };
+        GLint location { glGetUniformLocation(program, name.c_str()) };
+        if (location < 0)
+        {
+            // Uniforms in blocks have no location; they're set through ShaderUniforms.
+            continue;
+        }
+
+        // Arrays are reported as "name[0]"; make them available by their plain name too, as glGetUniformLocation allows.
+        uniformLocations[name] = location;
+        if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        {
+            uniformLocations[name.substr(0, name.size() - 3)] = location;
+        }
+    }
+}
+
+std::filesystem::path ShaderProgram::getCachePath(const std::vector<Stage>& stages, const std::vector<std::string>& sources)
+{
+    // Some drivers support the functions but no binary formats.
+    GLint formatCount { 0 };
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+    if (formatCount <= 0)
+    {
+        return {};
+    }
+
+    size_t stageCount { stages.size() };
+    uint64_t hash { hashBytes(&stageCount, sizeof(stageCount)) };
+    for (size_t i { 0 }; i < stages.size(); i++)
+    {
+        hash = hashBytes(&stages[i].type, sizeof(stages[i].type), hash);
+        hash = hashBytes(sources[i].data(), sources[i].size(), hash);
+    }
+
+    // A binary is only valid for the driver that produced it.
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const char* driverString { reinterpret_cast<const char*>(glGetString(name)) };
+        if (driverString)
+        {
+            hash = hashBytes(driverString, strlen(driverString) + 1, hash);
+        }
+    }
+
+    std::ostringstream filename {};
+    filename << std::hex << std::setw(16) << std::setfill('0') << hash << ".bin";
+    return ofToDataPath(CACHE_DIRECTORY / filename.str(), true);
+}
+
+bool ShaderProgram::loadBinary(const std::filesystem::path& cachePath)
+{
+    std::ifstream stream { cachePath, std::ios::binary };
+    if (!stream)
+    {
+        return false;
+    }
+
+    // The file is the binary's format followed by the binary itself.
+    GLenum format { 0 };
+    stream.read(reinterpret_cast<char*>(&format), sizeof(format));
+    std::vector<char> binary { std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>() };
+    if (binary.empty())
+    {
+        return false;
+    }
+
+    program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+    GLint linked { GL_FALSE };
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE)
+    {
+        // The driver may reject a binary after an update its version string doesn't show; rebuild it from source.
+        ofLogWarning("ShaderProgram") << "Cached program " << cachePath.filename() << " was rejected; rebuilding it.";
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    return true;
+}
+
+void ShaderProgram::storeBinary(const std::filesystem::path& cachePath) const
+{
+    GLint length { 0 };
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+
+    GLenum format { 0 };
+    std::vector<char> binary(length);
+    glGetProgramBinary(program, length, nullptr, &format, binary.data());
+
+    std::error_code error {};
+    std::filesystem::create_directories(cachePath.parent_path(), error);
+
+    // Write to a temporary file and rename it once complete, so that a partially written binary is never loaded.
+    std::filesystem::path tempPath { cachePath };
+    tempPath += ".tmp";
+
+    {
+        std::ofstream stream { tempPath, std::ios::binary | std::ios::trunc };
+        stream.write(reinterpret_cast<const char*>(&format), sizeof(format));
+        stream.write(binary.data(), binary.size());
+
+        if (!stream)
+        {
+            ofLogWarning("ShaderProgram") << "Failed to write " << tempPath;
+            return;
+        }
+    }
+
+    std::filesystem::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        ofLogWarning("ShaderProgram") << "Failed to write " << cachePath << ": " << error.message();
+        std::filesystem::remove(tempPath, error);
+    }
+}
+
+bool ShaderProgram::compile(const std::vector<Stage>& stages, const std::vector<std::string>& sources)
+{
+    program = glCreateProgram();
+
+    // The binary can only be read back if this is set before linking.
+    glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+
+    bool compiled { true };
+    std::vector<GLuint> shaders {};
+    for (size_t i { 0 }; i < stages.size(); i++)
+    {
+        GLuint shader { glCreateShader(stages[i].type) };
+        const char* source { sources[i].c_str() };
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        glAttachShader(program, shader);
+        shaders.push_back(shader);
+
+        GLint status { GL_FALSE };
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+        if (status != GL_TRUE)
+        {
+            ofLogError("ShaderProgram") << "Failed to compile " << stages[i].path << ":" << endl << getInfoLog(shader, false);
+            compiled = false;
+        }
+    }
+
+    GLint linked { GL_FALSE };
+    if (compiled)
+    {
+        glLinkProgram(program);
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE)
+        {
+            ofLogError("ShaderProgram") << "Failed to link " << stages.front().path << " and the other stages:" << endl
+                << getInfoLog(program, true);
+        }
+    }
+
+    // The shader objects aren't needed once the program is linked.
+    for (GLuint shader : shaders)
+    {
+        glDetachShader(program, shader);
+        glDeleteShader(shader);
+    }
+
+    if (linked != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        program = 0;
+        return false;
+    }
+
+    return true;
+}
+
+std::string ShaderProgram::resolveIncludes(const std::string& source, const std::filesystem::path& directory, unsigned int depth)
+{
+    if (depth > MAX_INCLUDE_DEPTH)
+    {
+        ofLogError("ShaderProgram") << "Includes nested more than " << MAX_INCLUDE_DEPTH << " deep in " << directory;
+        return source;
+    }
+
+    std::istringstream lines { source };
+    std::ostringstream resolved {};
+    std::string line {};
+    while (std::getline(lines, line))
+    {
+        std::string trimmed { ofTrim(line) };
+        if (trimmed.compare(0, 15, "#pragma include") != 0)
+        {
+            resolved << line << "\n";
+            continue;
+        }
+
+        // The file name is in quotes or angle brackets.
+        size_t start { trimmed.find_first_of("\"<", 15) };
+        size_t end { start == std::string::npos ? start : trimmed.find_first_of("\">", start + 1) };
+        if (end == std::string::npos)
+        {
+            ofLogError("ShaderProgram") << "Malformed include in " << directory << ": " << trimmed;
+            continue;
+        }
+
+        std::filesystem::path includePath { directory / trimmed.substr(start + 1, end - start - 1) };
+        ofBuffer buffer { ofBufferFromFile(includePath) };
+        if (buffer.size() == 0)
+        {
+            ofLogError("ShaderProgram") << "Failed to read include " << includePath;
+            continue;
+        }
+
+        resolved << resolveIncludes(buffer.getText(), includePath.parent_path(), depth + 1) << "\n";
+    }
+
+    return resolved.str();
+}
+
+std::string ShaderProgram::getInfoLog(GLuint object, bool isProgram)
+{
+    GLint length { 0 };
+    if (isProgram)
+    {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+    else
+    {
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+
+    if (length <= 0)
+    {
+        return {};
+    }
+
+    std::string log(length, '\0');
+    if (isProgram)
+    {
+        glGetProgramInfoLog(object, length, nullptr, &log[0]);
+    }
+    else
+    {
+        glGetShaderInfoLog(object, length, nullptr, &log[0]);
+    }
+
+    return log;
+}
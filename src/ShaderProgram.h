@@ -0,0 +1,103 @@
+#pragma once
+#include "ofMain.h"
+
+// A linked GLSL program built from source files, with the linked binary cached on disk (via glGetProgramBinary) so that later launches
+// can load it with glProgramBinary instead of compiling and linking again.  Cached binaries are keyed by a hash of every stage's source
+// (with its "#pragma include" files pasted in) and the driver's vendor, renderer and version strings, so editing a shader or updating
+// the driver simply misses the cache; a binary the driver rejects anyway is rebuilt from source.
+// ofShader can't be used for this, since it only works with programs it has linked from its own sources.  This is a thin replacement
+// with the parts of ofShader's interface this app uses; while a program is in use, openFrameworks' renderer is told a custom shader is bound,
+// so drawing meshes doesn't switch to its default shader (but it doesn't set openFrameworks' built-in matrix and color uniforms either;
+// the shaders get those from ShaderUniforms).
+class ShaderProgram
+{
+public:
+    // A shader stage, and the file containing its source (relative to the data folder).
+    struct Stage
+    {
+        GLenum type;
+        std::filesystem::path path;
+    };
+
+    ShaderProgram() = default;
+    ~ShaderProgram();
+
+    // Programs can be moved (e.g. to swap a freshly built set in), but not copied.
+    ShaderProgram(ShaderProgram&& s) noexcept;
+    ShaderProgram& operator= (ShaderProgram&& s) noexcept;
+
+    // Don't support copy constructor or copy assignment operator.
+    ShaderProgram(const ShaderProgram& s) = delete;
+    ShaderProgram& operator= (const ShaderProgram& s) = delete;
+
+    // Loads a program from a vertex and a fragment shader.  Returns false (leaving the program unloaded) if it doesn't compile or link.
+    bool load(const std::filesystem::path& vertexPath, const std::filesystem::path& fragmentPath);
+
+    // Loads a program from any set of stages.  Returns false (leaving the program unloaded) if it doesn't compile or link.
+    bool load(const std::vector<Stage>& stages);
+
+    // Deletes the program.  Must be called with a GL context.
+    void unload();
+
+    // Returns true if the program has been loaded successfully.
+    bool isLoaded() const;
+
+    // Gets the GL name of the program (zero if it isn't loaded).
+    GLuint getProgram() const;
+
+    // Starts and stops using the program for drawing.
+    void begin() const;
+    void end() const;
+
+    // Gets the location of a uniform, or -1 if the program doesn't have it (or it was optimized out).
+    // Every location is resolved when the program is linked, so this never queries GL; uniforms set on every pass
+    // should still be looked up once after each load and set by location.
+    GLint getUniformLocation(const std::string& name) const;
+
+    // Set uniforms of the program, by location or by name; it must be in use.  Location -1 (a missing uniform) is ignored.
+    void setUniform1i(GLint location, int value) const;
+    void setUniform2i(GLint location, int x, int y) const;
+    void setUniform1f(GLint location, float value) const;
+    void setUniform2f(GLint location, const glm::vec2& value) const;
+    void setUniform3f(GLint location, const glm::vec3& value) const;
+    void setUniform1i(const std::string& name, int value) const;
+    void setUniform2i(const std::string& name, int x, int y) const;
+    void setUniform1f(const std::string& name, float value) const;
+    void setUniform2f(const std::string& name, const glm::vec2& value) const;
+    void setUniform3f(const std::string& name, const glm::vec3& value) const;
+
+    // Binds a texture to a particular texture unit and points a sampler uniform at it.
+    void setUniformTexture(GLint location, const ofTexture& texture, int textureLocation) const;
+    void setUniformTexture(const std::string& name, const ofTexture& texture, int textureLocation) const;
+    void setUniformTexture(const std::string& name, GLenum textureTarget, GLint textureID, int textureLocation) const;
+
+private:
+    // The linked program, or zero.
+    GLuint program { 0 };
+
+    // The location of every active uniform (outside of uniform blocks), by name; filled in when the program is linked.
+    std::unordered_map<std::string, GLint> uniformLocations {};
+
+    // Fills in the uniform locations from the linked program.
+    void resolveUniformLocations();
+
+    // Gets the path of the cache file for a program with particular stages and (include-resolved) sources,
+    // or an empty path if the driver can't save program binaries.
+    static std::filesystem::path getCachePath(const std::vector<Stage>& stages, const std::vector<std::string>& sources);
+
+    // Loads the program from a cache file.  Returns false if there's no such file or the driver rejects the binary.
+    bool loadBinary(const std::filesystem::path& cachePath);
+
+    // Writes the linked program to a cache file.
+    void storeBinary(const std::filesystem::path& cachePath) const;
+
+    // Compiles and links the program from source.  Returns false (logging the errors) if any stage fails to compile or the program fails to link.
+    bool compile(const std::vector<Stage>& stages, const std::vector<std::string>& sources);
+
+    // Replaces every "#pragma include" line in some source with the contents of the named file (relative to the including file's directory),
+    // recursively, as ofShader does.
+    static std::string resolveIncludes(const std::string& source, const std::filesystem::path& directory, unsigned int depth = 0);
+
+    // Gets the info log of a shader or program object.
+    static std::string getInfoLog(GLuint object, bool isProgram);
+};
@@ -0,0 +1,50 @@
+#include "ShaderUniforms.h"
+
+using namespace glm;
+
+void ShaderUniforms::setup()
+{
+    cameraBuffer.allocate(sizeof(CameraBlock), GL_DYNAMIC_DRAW);
+    lightingBuffer.allocate(sizeof(LightingBlock), GL_DYNAMIC_DRAW);
+    fadeBuffer.allocate(sizeof(FadeBlock), GL_DYNAMIC_DRAW);
+
+    cameraBuffer.bindBase(GL_UNIFORM_BUFFER, CAMERA_BINDING);
+    lightingBuffer.bindBase(GL_UNIFORM_BUFFER, LIGHTING_BINDING);
+    fadeBuffer.bindBase(GL_UNIFORM_BUFFER, FADE_BINDING);
+}
+
+void ShaderUniforms::bindBlocks(const ShaderProgram& shader) const
+{
+    bindBlock(shader, "Camera", CAMERA_BINDING);
+    bindBlock(shader, "Lighting", LIGHTING_BINDING);
+    bindBlock(shader, "Fade", FADE_BINDING);
+}
+
+void ShaderUniforms::setCamera(const CameraMatrices& camMatrices)
+{
+    // Everything is already in world space, so the model matrix (and the normal matrix) is the identity.
+    CameraBlock block { camMatrices.getProj() * camMatrices.getView(), camMatrices.getView(), camMatrices.getProj(), mat4() };
+    cameraBuffer.updateData(0, sizeof(block), &block);
+}
+
+void ShaderUniforms::setLighting(vec3 lightDir, vec3 lightColor, vec3 ambientColor, float gammaInv)
+{
+    LightingBlock block { lightDir, gammaInv, lightColor, 0, ambientColor, 0 };
+    lightingBuffer.updateData(0, sizeof(block), &block);
+}
+
+void ShaderUniforms::setFade(float startFade, float endFade)
+{
+    FadeBlock block { startFade, endFade };
+    fadeBuffer.updateData(0, sizeof(block), &block);
+}
+
+void ShaderUniforms::bindBlock(const ShaderProgram& shader, const char* blockName, GLuint binding)
+{
+    // Blocks that a program doesn't use may be optimized out.
+    GLuint blockIndex { glGetUniformBlockIndex(shader.getProgram(), blockName) };
+    if (blockIndex != GL_INVALID_INDEX)
+    {
+        glUniformBlockBinding(shader.getProgram(), blockIndex, binding);
+    }
+}
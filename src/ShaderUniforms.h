@@ -0,0 +1,74 @@
+#pragma once
+#include "ofMain.h"
+#include "CameraMatrices.h"
+#include "ShaderProgram.h"
+
+// The per-pass and per-frame shader state shared by every program, kept in std140 uniform buffers
+// (declared in shaders/uniform_blocks.glsl) instead of being set one uniform at a time by name on every program.
+// Each block is bound to a fixed binding point once; a program only needs its blocks connected to those binding points
+// once, right after it's linked, and then sees whatever was last written to the buffers.
+class ShaderUniforms
+{
+public:
+    // The std140 layout of the Camera block.
+    struct CameraBlock
+    {
+        glm::mat4 mvp;
+        glm::mat4 modelView;
+        glm::mat4 projection;
+        glm::mat4 normalMatrix;
+    };
+
+    // The std140 layout of the Lighting block; each vec3 is padded to 16 bytes unless a float follows it.
+    struct LightingBlock
+    {
+        glm::vec3 lightDir;
+        float gammaInv;
+        glm::vec3 lightColor;
+        float padding0;
+        glm::vec3 ambientColor;
+        float padding1;
+    };
+
+    // The std140 layout of the Fade block.
+    struct FadeBlock
+    {
+        float startFade;
+        float endFade;
+    };
+
+    // The binding points of each block.
+    const static GLuint CAMERA_BINDING { 0 };
+    const static GLuint LIGHTING_BINDING { 1 };
+    const static GLuint FADE_BINDING { 2 };
+
+    ShaderUniforms() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    ShaderUniforms(const ShaderUniforms& s) = delete;
+    ShaderUniforms& operator= (const ShaderUniforms& s) = delete;
+
+    // Allocates the buffers and binds them to their binding points.  Must be called with a GL context.
+    void setup();
+
+    // Connects whichever of the blocks a program uses to their binding points.  Call once after the program is linked (or reloaded).
+    void bindBlocks(const ShaderProgram& shader) const;
+
+    // Writes the camera for the following pass.
+    void setCamera(const CameraMatrices& camMatrices);
+
+    // Writes the lighting.
+    void setLighting(glm::vec3 lightDir, glm::vec3 lightColor, glm::vec3 ambientColor, float gammaInv);
+
+    // Writes the level-of-detail fade distances for the following pass.
+    void setFade(float startFade, float endFade);
+
+private:
+    // The buffer backing each block.
+    ofBufferObject cameraBuffer {};
+    ofBufferObject lightingBuffer {};
+    ofBufferObject fadeBuffer {};
+
+    // Connects a block, if the program uses it, to a binding point.
+    static void bindBlock(const ShaderProgram& shader, const char* blockName, GLuint binding);
+};
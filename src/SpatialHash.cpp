@@ -0,0 +1,91 @@
+#include "SpatialHash.h"
+
+using namespace glm;
+
+SpatialHash::SpatialHash(float cellSize)
+    : cellSize { cellSize }
+{
+}
+
+void SpatialHash::update(size_t id, const Capsule& capsule)
+{
+    if (id >= bodies.size())
+    {
+        bodies.resize(id + 1);
+    }
+
+    Body& body { bodies[id] };
+    uint64_t cellKey { getCellKey(getCellIndices(vec2(capsule.top.x, capsule.top.z))) };
+
+    body.capsule = capsule;
+    maxRadius = std::max(maxRadius, capsule.radius);
+
+    // Only touch the hash table if the body is new or crossed into a different grid cell.
+    if (!body.present || body.cellKey != cellKey)
+    {
+        if (body.present)
+        {
+            removeFromBucket(id);
+        }
+
+        std::vector<size_t>& bucket { buckets[cellKey] };
+        body.cellKey = cellKey;
+        body.bucketIndex = bucket.size();
+        body.present = true;
+        bucket.push_back(id);
+    }
+}
+
+void SpatialHash::remove(size_t id)
+{
+    if (contains(id))
+    {
+        removeFromBucket(id);
+        bodies[id].present = false;
+    }
+}
+
+void SpatialHash::clear()
+{
+    bodies.clear();
+    buckets.clear();
+    maxRadius = 0;
+}
+
+bool SpatialHash::contains(size_t id) const
+{
+    return id < bodies.size() && bodies[id].present;
+}
+
+const Capsule& SpatialHash::getCapsule(size_t id) const
+{
+    return bodies[id].capsule;
+}
+
+float SpatialHash::getCellSize() const
+{
+    return cellSize;
+}
+
+void SpatialHash::queryRadius(const vec3& center, float radius, std::vector<size_t>& results) const
+{
+    forEachInRadius(center, radius, [&](size_t id, const Capsule&) { results.push_back(id); });
+}
+
+void SpatialHash::removeFromBucket(size_t id)
+{
+    Body& body { bodies[id] };
+    auto bucket { buckets.find(body.cellKey) };
+    std::vector<size_t>& ids { bucket->second };
+
+    // Swap the last ID in the bucket into this body's slot so that removal is constant time.
+    size_t lastId { ids.back() };
+    ids[body.bucketIndex] = lastId;
+    bodies[lastId].bucketIndex = body.bucketIndex;
+    ids.pop_back();
+
+    if (ids.empty())
+    {
+        buckets.erase(bucket);
+    }
+}
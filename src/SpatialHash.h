@@ -0,0 +1,112 @@
+#pragma once
+#include "ofMain.h"
+#include "Capsule.h"
+
+// A uniform-grid broadphase for finding nearby bodies on the xz-plane.
+// Each body is bucketed by the grid cell containing the top of its capsule; the grid cells are usually the same size as terrain cells.
+// Bodies are identified by small integer IDs chosen by the caller (such as agent indices).
+// Moving a body only touches the hash table if it crosses into a different grid cell, so it can be updated incrementally every physics step.
+class SpatialHash
+{
+public:
+    // Creates an empty broadphase with grid cells of a particular size (in world space).
+    SpatialHash(float cellSize);
+
+    // Inserts a body, or moves it if it's already present.
+    void update(size_t id, const Capsule& capsule);
+
+    // Removes a body, if present.
+    void remove(size_t id);
+
+    // Removes every body.
+    void clear();
+
+    // Returns true if a body with a particular ID is present.
+    bool contains(size_t id) const;
+
+    // Gets the capsule of a body that is present.
+    const Capsule& getCapsule(size_t id) const;
+
+    // Gets the size of each grid cell (in world space).
+    float getCellSize() const;
+
+    // Gets the IDs of every body whose capsule comes within a horizontal distance of a point.
+    // The results are appended to the vector.
+    void queryRadius(const glm::vec3& center, float radius, std::vector<size_t>& results) const;
+
+    // Calls a function with the ID and capsule of every body whose capsule comes within a horizontal distance of a point.
+    template<typename Function>
+    void forEachInRadius(const glm::vec3& center, float radius, Function function) const
+    {
+        // Bodies are bucketed by their center, so expand the search by the largest body radius.
+        float searchRadius { radius + maxRadius };
+        glm::ivec2 minCell { getCellIndices(glm::vec2(center.x, center.z) - searchRadius) };
+        glm::ivec2 maxCell { getCellIndices(glm::vec2(center.x, center.z) + searchRadius) };
+
+        for (int cellY { minCell.y }; cellY <= maxCell.y; cellY++)
+        {
+            for (int cellX { minCell.x }; cellX <= maxCell.x; cellX++)
+            {
+                auto bucket { buckets.find(getCellKey(glm::ivec2(cellX, cellY))) };
+                if (bucket != buckets.end())
+                {
+                    for (size_t id : bucket->second)
+                    {
+                        const Capsule& capsule { bodies[id].capsule };
+                        float reach { radius + capsule.radius };
+                        glm::vec2 offset { capsule.top.x - center.x, capsule.top.z - center.z };
+
+                        if (glm::dot(offset, offset) < reach * reach)
+                        {
+                            function(id, capsule);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    // The state of a single body.
+    struct Body
+    {
+        // The body's collision shape.
+        Capsule capsule {};
+
+        // The key of the grid cell the body is bucketed in.
+        uint64_t cellKey { 0 };
+
+        // The position of the body's ID within its bucket.
+        size_t bucketIndex { 0 };
+
+        // Set to false for IDs that aren't in use.
+        bool present { false };
+    };
+
+    // The size of each grid cell (in world space).
+    float cellSize;
+
+    // The largest radius of any body that has been inserted; used to expand queries.
+    float maxRadius { 0 };
+
+    // Every body, indexed by ID.
+    std::vector<Body> bodies {};
+
+    // The IDs of the bodies in each non-empty grid cell.
+    std::unordered_map<uint64_t, std::vector<size_t>> buckets {};
+
+    // Gets the indices of the grid cell containing a point on the xz-plane.
+    glm::ivec2 getCellIndices(glm::vec2 position) const
+    {
+        return glm::ivec2(glm::floor(position / cellSize));
+    }
+
+    // Packs the indices of a grid cell into a single key.
+    static uint64_t getCellKey(glm::ivec2 cellIndices)
+    {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cellIndices.x)) << 32) | static_cast<uint32_t>(cellIndices.y);
+    }
+
+    // Removes a body's ID from its bucket.
+    void removeFromBucket(size_t id);
+};
@@ -0,0 +1,420 @@
+#include "StreamedTexture.h"
+
+using namespace glm;
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+// The number of bytes in each 4x4 block of a format.
+static size_t getBlockBytes(StreamedTexture::Format format)
+{
+    return format == StreamedTexture::Format::BC1 ? 8 : 16;
+}
+
+// Packs a color (with channels from 0 to 255) into 5:6:5 bits.
+static uint16_t packRGB565(vec3 color)
+{
+    uvec3 quantized { round(clamp(color, vec3(0), vec3(255)) * vec3(31, 63, 31) / 255.0f) };
+    return static_cast<uint16_t>((quantized.r << 11) | (quantized.g << 5) | quantized.b);
+}
+
+// Unpacks a 5:6:5 color to channels from 0 to 255.
+static vec3 unpackRGB565(uint16_t packed)
+{
+    return vec3((packed >> 11) & 31, (packed >> 5) & 63, packed & 31) * 255.0f / vec3(31, 63, 31);
+}
+
+// Compresses a block of 16 RGBA texels (row by row) to BC1, using the inset bounding box of the colors as the endpoints.
+static void encodeBC1Block(const u8vec4 texels[16], uint8_t* block)
+{
+    vec3 minColor { 255 };
+    vec3 maxColor { 0 };
+    for (int i { 0 }; i < 16; i++)
+    {
+        minColor = min(minColor, vec3(texels[i]));
+        maxColor = max(maxColor, vec3(texels[i]));
+    }
+
+    // Pulling the endpoints in slightly reduces the average error, since few texels are at the extremes.
+    vec3 inset { (maxColor - minColor) / 16.0f };
+    uint16_t color0 { packRGB565(maxColor - inset) };
+    uint16_t color1 { packRGB565(minColor + inset) };
+
+    // color0 > color1 selects the four-color mode.
+    if (color0 < color1)
+    {
+        std::swap(color0, color1);
+    }
+
+    uint32_t indices { 0 };
+    if (color0 != color1)
+    {
+        vec3 endpoint0 { unpackRGB565(color0) };
+        vec3 endpoint1 { unpackRGB565(color1) };
+        vec3 palette[4] { endpoint0, endpoint1, (2.0f * endpoint0 + endpoint1) / 3.0f, (endpoint0 + 2.0f * endpoint1) / 3.0f };
+
+        for (int i { 0 }; i < 16; i++)
+        {
+            uint32_t bestIndex { 0 };
+            float bestError { FLT_MAX };
+            for (uint32_t p { 0 }; p < 4; p++)
+            {
+                vec3 difference { vec3(texels[i]) - palette[p] };
+                float error { dot(difference, difference) };
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestIndex = p;
+                }
+            }
+
+            indices |= bestIndex << (2 * i);
+        }
+    }
+
+    // Little-endian, as the format requires.
+    block[0] = color0 & 0xFF;
+    block[1] = color0 >> 8;
+    block[2] = color1 & 0xFF;
+    block[3] = color1 >> 8;
+    for (int i { 0 }; i < 4; i++)
+    {
+        block[4 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+}
+
+// Compresses a block of 16 single-channel values to BC4, using the range of the values as the endpoints.
+static void encodeBC4Block(const uint8_t values[16], uint8_t* block)
+{
+    uint8_t low { 255 };
+    uint8_t high { 0 };
+    for (int i { 0 }; i < 16; i++)
+    {
+        low = std::min(low, values[i]);
+        high = std::max(high, values[i]);
+    }
+
+    // high > low selects the eight-value mode: index 0 is high, 1 is low, and 2 through 7 step from high to low.
+    block[0] = high;
+    block[1] = low;
+
+    uint64_t indices { 0 };
+    if (high > low)
+    {
+        for (int i { 0 }; i < 16; i++)
+        {
+            int step { static_cast<int>(std::round((high - values[i]) * 7.0f / (high - low))) };
+            uint64_t index { step == 0 ? 0u : step == 7 ? 1u : static_cast<uint64_t>(step + 1) };
+            indices |= index << (3 * i);
+        }
+    }
+
+    for (int i { 0 }; i < 6; i++)
+    {
+        block[2 + i] = (indices >> (8 * i)) & 0xFF;
+    }
+}
+
+// Halves an RGBA image in each dimension by averaging 2x2 texels; normal maps are renormalized so that they stay unit length.
+static void downsample(const std::vector<u8vec4>& source, uvec2 sourceSize, std::vector<u8vec4>& result, uvec2 resultSize, bool normalMap)
+{
+    result.resize(resultSize.x * resultSize.y);
+
+    for (unsigned int y { 0 }; y < resultSize.y; y++)
+    {
+        for (unsigned int x { 0 }; x < resultSize.x; x++)
+        {
+            vec4 sum { 0 };
+            for (unsigned int dy { 0 }; dy < 2; dy++)
+            {
+                for (unsigned int dx { 0 }; dx < 2; dx++)
+                {
+                    uvec2 texel { min(uvec2(2 * x + dx, 2 * y + dy), sourceSize - 1u) };
+                    sum += vec4(source[texel.y * sourceSize.x + texel.x]);
+                }
+            }
+
+            vec4 average { sum * 0.25f };
+            if (normalMap)
+            {
+                vec3 normal { normalize(vec3(average) / 127.5f - 1.0f) };
+                average = vec4((normal + 1.0f) * 127.5f, average.a);
+            }
+
+            result[y * resultSize.x + x] = u8vec4(round(average));
+        }
+    }
+}
+
+bool StreamedTexture::bake(const std::filesystem::path& sourcePath, const std::filesystem::path& ktxPath, Format format, JobSystem& jobSystem)
+{
+    ofPixels pixels {};
+    if (!ofLoadImage(pixels, sourcePath))
+    {
+        cout << "Couldn't load " << sourcePath << " to compress it." << endl;
+        return false;
+    }
+
+    pixels.setImageType(OF_IMAGE_COLOR_ALPHA);
+
+    uvec2 levelSize { static_cast<unsigned int>(pixels.getWidth()), static_cast<unsigned int>(pixels.getHeight()) };
+    std::vector<u8vec4> level(levelSize.x * levelSize.y);
+    memcpy(level.data(), pixels.getData(), level.size() * sizeof(u8vec4));
+    pixels.clear();
+
+    unsigned int levelCount { 1 };
+    while ((std::max(levelSize.x, levelSize.y) >> levelCount) > 0)
+    {
+        levelCount++;
+    }
+
+    KTXHeader header {};
+    memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+    header.endianness = KTX_NATIVE_ENDIANNESS;
+    header.glType = 0; // Compressed
+    header.glTypeSize = 1;
+    header.glFormat = 0;
+    header.glInternalFormat = format == Format::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RG_RGTC2;
+    header.glBaseInternalFormat = format == Format::BC1 ? GL_RGB : GL_RG;
+    header.pixelWidth = levelSize.x;
+    header.pixelHeight = levelSize.y;
+    header.numberOfFaces = 1;
+    header.numberOfMipmapLevels = levelCount;
+
+    // Write to a temporary file first so that an interrupted bake never leaves a truncated texture behind.
+    std::filesystem::path fullPath { ofToDataPath(ktxPath, true) };
+    std::filesystem::path tempPath { fullPath };
+    tempPath += ".tmp";
+
+    {
+        std::ofstream stream { tempPath, std::ios::binary | std::ios::trunc };
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        size_t blockBytes { getBlockBytes(format) };
+        std::vector<uint8_t> blocks {};
+        std::vector<u8vec4> nextLevel {};
+
+        for (unsigned int levelIndex { 0 }; levelIndex < levelCount; levelIndex++)
+        {
+            uvec2 blockCount { (levelSize + 3u) / 4u };
+            blocks.resize(blockCount.x * blockCount.y * blockBytes);
+
+            // Each row of blocks is independent.
+            jobSystem.parallelFor(blockCount.y, 4, [&](size_t begin, size_t end)
+            {
+                for (size_t by { begin }; by < end; by++)
+                {
+                    for (unsigned int bx { 0 }; bx < blockCount.x; bx++)
+                    {
+                        // Gather the block's texels, repeating the edge for levels that aren't a multiple of four.
+                        u8vec4 texels[16];
+                        for (unsigned int i { 0 }; i < 16; i++)
+                        {
+                            uvec2 texel { min(uvec2(bx * 4 + i % 4, by * 4 + i / 4), levelSize - 1u) };
+                            texels[i] = level[texel.y * levelSize.x + texel.x];
+                        }
+
+                        uint8_t* block { &blocks[(by * blockCount.x + bx) * blockBytes] };
+                        if (format == Format::BC1)
+                        {
+                            encodeBC1Block(texels, block);
+                        }
+                        else
+                        {
+                            // Red (x) then green (y), each as a BC4 block.
+                            uint8_t channel[16];
+                            for (int c { 0 }; c < 2; c++)
+                            {
+                                for (int i { 0 }; i < 16; i++)
+                                {
+                                    channel[i] = texels[i][c];
+                                }
+
+                                encodeBC4Block(channel, block + 8 * c);
+                            }
+                        }
+                    }
+                }
+            });
+
+            // Blocks are always a multiple of four bytes, so no padding is needed.
+            uint32_t imageSize { static_cast<uint32_t>(blocks.size()) };
+            stream.write(reinterpret_cast<const char*>(&imageSize), sizeof(imageSize));
+            stream.write(reinterpret_cast<const char*>(blocks.data()), blocks.size());
+
+            if (levelIndex + 1 < levelCount)
+            {
+                uvec2 nextSize { max(levelSize / 2u, uvec2(1)) };
+                downsample(level, levelSize, nextLevel, nextSize, format == Format::BC5_NORMAL);
+                level.swap(nextLevel);
+                levelSize = nextSize;
+            }
+        }
+
+        if (!stream)
+        {
+            cout << "Couldn't write " << tempPath << "." << endl;
+            return false;
+        }
+    }
+
+    std::error_code error {};
+    std::filesystem::rename(tempPath, fullPath, error);
+    return !error;
+}
+
+void StreamedTexture::loadAsync(const std::filesystem::path& ktxPath, JobSystem& jobSystem, const ofColor& placeholder)
+{
+    // Start with a single texel of the placeholder color, which is replaced as the levels arrive.
+    ofPixels placeholderPixels {};
+    placeholderPixels.allocate(1, 1, OF_PIXELS_RGBA);
+    placeholderPixels.setColor(0, 0, placeholder);
+    texture.allocate(placeholderPixels);
+    texture.loadData(placeholderPixels);
+    texture.setTextureWrap(GL_REPEAT, GL_REPEAT);
+
+    std::filesystem::path fullPath { ofToDataPath(ktxPath, true) };
+    jobSystem.runInBackground([this, fullPath]() { readFile(fullPath); });
+}
+
+void StreamedTexture::update(size_t byteBudget)
+{
+    // Carry on after a read error too: the levels read before it are still uploaded, and once they're gone there's nothing left to take.
+    if (isComplete())
+    {
+        return;
+    }
+
+    std::deque<Level> levels {};
+
+    {
+        std::lock_guard<std::mutex> lock { readMutex };
+        if (!headerRead)
+        {
+            return;
+        }
+
+        if (levelCount == 0)
+        {
+            // First time the header is available.
+            internalFormat = readHeader.glInternalFormat;
+            size = uvec2(readHeader.pixelWidth, readHeader.pixelHeight);
+            levelCount = readHeader.numberOfMipmapLevels;
+            finestUploadedLevel = levelCount;
+        }
+
+        // Take levels (at least one) until the budget is spent.
+        size_t bytes { 0 };
+        while (!readyLevels.empty() && (levels.empty() || bytes + readyLevels.front().data.size() <= byteBudget))
+        {
+            bytes += readyLevels.front().data.size();
+            levels.push_back(std::move(readyLevels.front()));
+            readyLevels.pop_front();
+        }
+    }
+
+    if (levels.empty())
+    {
+        return;
+    }
+
+    GLuint textureId { texture.getTextureData().textureID };
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    for (const Level& level : levels)
+    {
+        uvec2 levelSize { max(size >> level.index, uvec2(1)) };
+        glCompressedTexImage2D(GL_TEXTURE_2D, level.index, internalFormat, levelSize.x, levelSize.y, 0,
+            static_cast<GLsizei>(level.data.size()), level.data.data());
+
+        finestUploadedLevel = level.index;
+        uploadedBytes += level.data.size();
+    }
+
+    // Only sample the levels that have arrived; the texture is complete as long as the range is.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, finestUploadedLevel);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    ofTextureData& textureData { texture.getTextureData() };
+    textureData.glInternalFormat = internalFormat;
+    textureData.width = static_cast<float>(size.x);
+    textureData.height = static_cast<float>(size.y);
+    textureData.tex_w = textureData.width;
+    textureData.tex_h = textureData.height;
+}
+
+bool StreamedTexture::isComplete() const
+{
+    return levelCount > 0 && finestUploadedLevel == 0;
+}
+
+const ofTexture& StreamedTexture::getTexture() const
+{
+    return texture;
+}
+
+size_t StreamedTexture::getUploadedBytes() const
+{
+    return uploadedBytes;
+}
+
+void StreamedTexture::readFile(std::filesystem::path ktxPath)
+{
+    std::ifstream stream { ktxPath, std::ios::binary };
+    KTXHeader header {};
+
+    if (!stream.read(reinterpret_cast<char*>(&header), sizeof(header)) || !isNativeKTXHeader(header)
+        || header.glType != 0 || header.numberOfFaces != 1 || header.numberOfMipmapLevels == 0)
+    {
+        cout << "Couldn't read " << ktxPath << " as a compressed, mipmapped KTX texture." << endl;
+        readFailed = true;
+        return;
+    }
+
+    // Find where each level starts; KTX files store the largest level first, but it's needed last.
+    std::vector<std::streamoff> levelOffsets {};
+    std::vector<uint32_t> levelSizes {};
+    std::streamoff offset { static_cast<std::streamoff>(sizeof(header) + header.bytesOfKeyValueData) };
+
+    for (unsigned int i { 0 }; i < header.numberOfMipmapLevels; i++)
+    {
+        uint32_t imageSize { 0 };
+        stream.seekg(offset);
+        if (!stream.read(reinterpret_cast<char*>(&imageSize), sizeof(imageSize)))
+        {
+            cout << "Couldn't read " << ktxPath << "; it ends before mip level " << i << "." << endl;
+            readFailed = true;
+            return;
+        }
+
+        levelOffsets.push_back(offset + static_cast<std::streamoff>(sizeof(imageSize)));
+        levelSizes.push_back(imageSize);
+        offset += sizeof(imageSize) + ((imageSize + 3) & ~3u);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock { readMutex };
+        readHeader = header;
+        headerRead = true;
+    }
+
+    // Publish each level as soon as it's read, coarsest first.
+    for (unsigned int i { header.numberOfMipmapLevels }; i-- > 0; )
+    {
+        Level level { i, std::vector<char>(levelSizes[i]) };
+        stream.seekg(levelOffsets[i]);
+        if (!stream.read(level.data.data(), level.data.size()))
+        {
+            cout << "Couldn't read mip level " << i << " of " << ktxPath << "." << endl;
+            readFailed = true;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock { readMutex };
+        readyLevels.push_back(std::move(level));
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+#include "ofMain.h"
+#include "JobSystem.h"
+#include "KTXFile.h"
+
+// A block-compressed, mipmapped texture that is read from disk in the background and streamed to the GPU coarsest mip level first,
+// so that it can be drawn (blurry at first) right away and sharpens over the next few frames.
+// The texture data lives in a KTX file, which bake() creates once from an ordinary image: color textures are stored as BC1
+// (half a byte per pixel) and normal maps as BC5 (one byte per pixel, x and y only; shaders reconstruct z).
+// No pixels are kept on the CPU once a level has been uploaded.
+class StreamedTexture
+{
+public:
+    // The block-compressed formats a texture can be baked to.
+    enum class Format
+    {
+        // RGB color, 4 bits per pixel.
+        BC1,
+
+        // Two-channel normal maps (x and y, remapped to [0, 1]), 8 bits per pixel.
+        BC5_NORMAL
+    };
+
+    StreamedTexture() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    StreamedTexture(const StreamedTexture& s) = delete;
+    StreamedTexture& operator= (const StreamedTexture& s) = delete;
+
+    // Converts an image to a block-compressed KTX file with a full mip chain, compressing across every thread.  Returns false on failure.
+    static bool bake(const std::filesystem::path& sourcePath, const std::filesystem::path& ktxPath, Format format, JobSystem& jobSystem);
+
+    // Starts reading a KTX file in the background; the texture shows a flat placeholder color until the first level is uploaded.
+    // Must be called with a GL context.
+    void loadAsync(const std::filesystem::path& ktxPath, JobSystem& jobSystem, const ofColor& placeholder);
+
+    // Uploads the levels that have been read so far, coarsest first, stopping once about "byteBudget" bytes have been uploaded
+    // (but always uploading at least one level if any are ready).  This should be called from your ofApp::update() function.
+    void update(size_t byteBudget);
+
+    // Returns true once every mip level has been uploaded.
+    bool isComplete() const;
+
+    // Gets the texture, for binding to shaders.
+    const ofTexture& getTexture() const;
+
+    // Gets the number of bytes of texture data uploaded so far.
+    size_t getUploadedBytes() const;
+
+private:
+    // A mip level that has been read from disk but not uploaded yet.
+    struct Level
+    {
+        // The level's index (0 is the full-size level).
+        unsigned int index;
+
+        // The compressed blocks.
+        std::vector<char> data;
+    };
+
+    // The texture.  It's allocated by openFrameworks so that copies of it (e.g. for props) share it safely.
+    ofTexture texture {};
+
+    // The compressed format of the texture (the following fields are only used on the main thread, once the header has been read).
+    GLenum internalFormat { 0 };
+
+    // The size of the full-size level.
+    glm::uvec2 size {};
+
+    // The number of mip levels in the file.
+    unsigned int levelCount { 0 };
+
+    // The finest level uploaded so far (levelCount if none have been).
+    unsigned int finestUploadedLevel { 0 };
+
+    // The number of bytes of texture data uploaded so far.
+    size_t uploadedBytes { 0 };
+
+    // Levels read by the background job, coarsest first, waiting to be uploaded.
+    std::deque<Level> readyLevels {};
+
+    // Guards the header and levels written by the background job.
+    std::mutex readMutex {};
+
+    // The file's header, once the background job has read it.
+    KTXHeader readHeader {};
+
+    // Set by the background job once it has read the header.
+    bool headerRead { false };
+
+    // Set to true if the background job couldn't read the file; it stops reading, but the levels it had already read are still uploaded.
+    std::atomic<bool> readFailed { false };
+
+    // Reads the file (on a background thread), publishing each level as soon as it's read, coarsest first.
+    void readFile(std::filesystem::path ktxPath);
+};
@@ -0,0 +1,222 @@
+#include "TerrainOcclusion.h"
+#include "MappedFile.h"
+#include "hashBytes.h"
+
+using namespace glm;
+
+// Identifies an occlusion map file.
+static const uint32_t OCCLUSION_FILE_MAGIC { 0x4C43434F }; // "OCCL"
+
+// Increment whenever the layout of an occlusion map file or the bake itself changes.
+static const uint32_t OCCLUSION_FILE_VERSION { 1 };
+
+// The header at the start of an occlusion map file.  It's followed by two bytes (sun visibility, ambient occlusion) per texel, row by row.
+struct OcclusionFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint64_t bakeHash;
+    uint32_t width;
+    uint32_t height;
+};
+
+void TerrainOcclusion::loadOrBake(const World& world, const std::filesystem::path& path, const BakeSettings& settings, JobSystem& jobSystem)
+{
+    // The texels are square and cover the heightmap from edge to edge; each one is at least a heightmap pixel.
+    uvec2 heightmapSize { world.getHeightmapSize() };
+    vec2 heightmapExtent { heightmapSize - 1u };
+    float texelsPerPixel { glm::min(1.0f, settings.resolution / glm::min(heightmapExtent.x, heightmapExtent.y)) };
+    uvec2 size { max(uvec2(round(heightmapExtent * texelsPerPixel)), uvec2(2)) };
+
+    // The map depends on the terrain and on every setting.
+    uint64_t bakeHash { world.computeTerrainHash() };
+    bakeHash = hashBytes(&settings.resolution, sizeof(settings.resolution), bakeHash);
+    bakeHash = hashBytes(&settings.azimuthCount, sizeof(settings.azimuthCount), bakeHash);
+    bakeHash = hashBytes(&settings.maxDistance, sizeof(settings.maxDistance), bakeHash);
+    bakeHash = hashBytes(&settings.lightDir, sizeof(settings.lightDir), bakeHash);
+    bakeHash = hashBytes(&settings.penumbraAngle, sizeof(settings.penumbraAngle), bakeHash);
+
+    std::filesystem::path absolutePath { ofToDataPath(path, true) };
+    std::vector<uint8_t> texels {};
+    bakeSeconds = 0;
+
+    if (!load(absolutePath, bakeHash, size, texels))
+    {
+        float startTime { ofGetElapsedTimef() };
+        bake(world, settings, size, jobSystem, texels);
+        bakeSeconds = ofGetElapsedTimef() - startTime;
+
+        save(absolutePath, bakeHash, size, texels);
+    }
+
+    texture.allocate(size.x, size.y, GL_RG8);
+    texture.loadData(texels.data(), size.x, size.y, GL_RG);
+    texture.setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+    texture.setTextureWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+}
+
+const ofTexture& TerrainOcclusion::getTexture() const
+{
+    return texture;
+}
+
+float TerrainOcclusion::getBakeSeconds() const
+{
+    return bakeSeconds;
+}
+
+void TerrainOcclusion::bake(const World& world, const BakeSettings& settings, uvec2 size, JobSystem& jobSystem, std::vector<uint8_t>& texels)
+{
+    // The size of a texel in world space.
+    vec2 texelSize { vec2(world.dimensions.x, world.dimensions.z) / vec2(size) };
+
+    // Rows of texels are independent, so every step splits them across every thread.
+    const size_t ROWS_PER_BATCH { 8 };
+
+    // Sample the terrain at the center of every texel first, so that the horizon search doesn't go through the world's heightmap storage.
+    std::vector<float> heights(size.x * size.y);
+    jobSystem.parallelFor(size.y, ROWS_PER_BATCH, [&](size_t begin, size_t end)
+    {
+        for (size_t y { begin }; y < end; y++)
+        {
+            for (unsigned int x { 0 }; x < size.x; x++)
+            {
+                vec2 position { (vec2(x, y) + 0.5f) * texelSize };
+                heights[y * size.x + x] = world.getTerrainHeightAtPosition(vec3(position.x, 0, position.y));
+            }
+        }
+    });
+
+    // Bilinearly interpolates the heights, in texel coordinates (where texel centers are at whole numbers).
+    auto heightAt { [&](vec2 texel)
+    {
+        ivec2 base { clamp(ivec2(floor(texel)), ivec2(0), ivec2(size) - 2) };
+        vec2 st { clamp(texel - vec2(base), vec2(0), vec2(1)) };
+        const float* row0 { &heights[base.y * size.x + base.x] };
+        const float* row1 { row0 + size.x };
+        return mix(mix(row0[0], row0[1], st.x), mix(row1[0], row1[1], st.x), st.y);
+    } };
+
+    // The directions to trace, evenly spaced around the circle.
+    std::vector<vec2> directions(settings.azimuthCount);
+    for (unsigned int a { 0 }; a < settings.azimuthCount; a++)
+    {
+        float angle { a * 2 * pi<float>() / settings.azimuthCount };
+        directions[a] = vec2(cos(angle), sin(angle));
+    }
+
+    // The sun's elevation, and the two traced directions on either side of it.
+    vec3 lightDir { normalize(settings.lightDir) };
+    float sunElevation { asin(lightDir.y) };
+    float sunIndex { mod(atan(lightDir.z, lightDir.x) / (2 * pi<float>()) * settings.azimuthCount, static_cast<float>(settings.azimuthCount)) };
+    unsigned int sunAzimuth0 { static_cast<unsigned int>(sunIndex) % settings.azimuthCount };
+    unsigned int sunAzimuth1 { (sunAzimuth0 + 1) % settings.azimuthCount };
+    float sunWeight { fract(sunIndex) };
+
+    // Start one texel out and take steps that grow with distance, since far-off hills need to be much taller to matter.
+    float firstStep { glm::min(texelSize.x, texelSize.y) };
+    const float STEP_GROWTH { 0.15f };
+
+    texels.resize(2 * size.x * size.y);
+    jobSystem.parallelFor(size.y, ROWS_PER_BATCH, [&](size_t begin, size_t end)
+    {
+        std::vector<float> horizons(settings.azimuthCount);
+
+        for (size_t y { begin }; y < end; y++)
+        {
+            for (unsigned int x { 0 }; x < size.x; x++)
+            {
+                vec2 start { static_cast<float>(x), static_cast<float>(y) };
+                float height { heights[y * size.x + x] };
+                float sky { 0 };
+
+                for (unsigned int a { 0 }; a < settings.azimuthCount; a++)
+                {
+                    // Find the steepest slope up to the terrain along this direction.
+                    float maxSlope { -std::numeric_limits<float>::max() };
+                    for (float t { firstStep }; t <= settings.maxDistance; t += glm::max(firstStep, t * STEP_GROWTH))
+                    {
+                        vec2 texel { start + directions[a] * t / texelSize };
+                        if (any(lessThan(texel, vec2(0))) || any(greaterThan(texel, vec2(size - 1u))))
+                        {
+                            // Nothing beyond the edge of the terrain.
+                            break;
+                        }
+
+                        maxSlope = glm::max(maxSlope, (heightAt(texel) - height) / t);
+                    }
+
+                    horizons[a] = atan(maxSlope);
+
+                    // The cosine-weighted fraction of the sky above a horizon at angle h is cos^2(h); horizons below level don't occlude.
+                    float skyHorizon { glm::max(horizons[a], 0.0f) };
+                    sky += cos(skyHorizon) * cos(skyHorizon);
+                }
+
+                float ambient { sky / settings.azimuthCount };
+                float sunHorizon { mix(horizons[sunAzimuth0], horizons[sunAzimuth1], sunWeight) };
+                float sun { smoothstep(sunHorizon - settings.penumbraAngle, sunHorizon + settings.penumbraAngle, sunElevation) };
+
+                size_t i { 2 * (y * size.x + x) };
+                texels[i] = static_cast<uint8_t>(round(sun * 255));
+                texels[i + 1] = static_cast<uint8_t>(round(ambient * 255));
+            }
+        }
+    });
+}
+
+bool TerrainOcclusion::load(const std::filesystem::path& path, uint64_t bakeHash, uvec2 size, std::vector<uint8_t>& texels)
+{
+    MappedFile file {};
+    if (!file.open(path) || file.getSize() < sizeof(OcclusionFileHeader))
+    {
+        return false;
+    }
+
+    OcclusionFileHeader header {};
+    std::memcpy(&header, file.getData(), sizeof(header));
+
+    // Reject files that were written by another version or for another terrain, size, or settings.
+    if (header.magic != OCCLUSION_FILE_MAGIC || header.version != OCCLUSION_FILE_VERSION || header.bakeHash != bakeHash
+        || header.width != size.x || header.height != size.y || file.getSize() != sizeof(OcclusionFileHeader) + 2 * size.x * size.y)
+    {
+        return false;
+    }
+
+    texels.assign(file.getData() + sizeof(OcclusionFileHeader), file.getData() + file.getSize());
+    return true;
+}
+
+void TerrainOcclusion::save(const std::filesystem::path& path, uint64_t bakeHash, uvec2 size, const std::vector<uint8_t>& texels)
+{
+    OcclusionFileHeader header {};
+    header.magic = OCCLUSION_FILE_MAGIC;
+    header.version = OCCLUSION_FILE_VERSION;
+    header.bakeHash = bakeHash;
+    header.width = size.x;
+    header.height = size.y;
+
+    // Write to a temporary file and rename it once complete, so that a crash never leaves a partial map behind.
+    std::filesystem::path tempPath { path };
+    tempPath += ".tmp";
+
+    {
+        std::ofstream stream { tempPath, std::ios::binary | std::ios::trunc };
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(texels.data()), texels.size());
+
+        if (!stream)
+        {
+            ofLogWarning("TerrainOcclusion") << "Failed to write " << tempPath;
+            return;
+        }
+    }
+
+    std::error_code error {};
+    std::filesystem::rename(tempPath, path, error);
+    if (error)
+    {
+        ofLogWarning("TerrainOcclusion") << "Failed to write " << path << ": " << error.message();
+        std::filesystem::remove(tempPath, error);
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include "ofMain.h"
+#include "World.h"
+#include "JobSystem.h"
+
+// Self-shadowing and ambient occlusion for the whole terrain, baked once from the heightmap and cached on disk.
+// For every texel of a grid covering the terrain, the bake marches outwards along a set of directions (azimuths) to find how high
+// the horizon rises in each one.  The horizons are then reduced to two numbers that the terrain shader reads with a single fetch:
+// how much of the (fixed) sun is visible above the horizon, and how much of the sky is (the ambient occlusion).
+class TerrainOcclusion
+{
+public:
+    // Controls the resolution and reach of the bake.  Any change causes a re-bake.
+    struct BakeSettings
+    {
+        // The number of texels along the shorter side of the heightmap (never more than the heightmap itself).
+        unsigned int resolution { 2048 };
+
+        // The number of horizon directions traced from each texel.
+        unsigned int azimuthCount { 16 };
+
+        // How far (in world space) to look for a horizon; hills further away than this never occlude.
+        float maxDistance { 1.0f };
+
+        // The direction towards the sun, in world space.
+        glm::vec3 lightDir { 0, 1, 0 };
+
+        // Half the angle (in radians) over which the sun fades in as it rises above the horizon, to soften the shadows' edges.
+        float penumbraAngle { 0.05f };
+    };
+
+    TerrainOcclusion() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    TerrainOcclusion(const TerrainOcclusion& t) = delete;
+    TerrainOcclusion& operator= (const TerrainOcclusion& t) = delete;
+
+    // Loads the occlusion map baked for this terrain and these settings from a file, or bakes it across every thread
+    // (and saves it for next time) if there isn't one.  Must be called with a GL context.
+    void loadOrBake(const World& world, const std::filesystem::path& path, const BakeSettings& settings, JobSystem& jobSystem);
+
+    // Gets the occlusion map: the red channel is the fraction of the sun that is visible, and the green channel is the ambient occlusion.
+    // The texture spans the whole terrain, so a heightmap pixel p is at p / (heightmap size - 1).
+    const ofTexture& getTexture() const;
+
+    // Gets the number of seconds spent baking, or zero if the occlusion map was loaded from disk.
+    float getBakeSeconds() const;
+
+private:
+    // The occlusion map on the GPU.
+    ofTexture texture {};
+
+    // The number of seconds spent baking.
+    float bakeSeconds { 0 };
+
+    // Computes the sun visibility and ambient occlusion of every texel of a grid of a particular size, two bytes per texel.
+    static void bake(const World& world, const BakeSettings& settings, glm::uvec2 size, JobSystem& jobSystem, std::vector<uint8_t>& texels);
+
+    // Reads a baked occlusion map.  Returns false if the file doesn't exist or was baked for another terrain, size, or settings.
+    static bool load(const std::filesystem::path& path, uint64_t bakeHash, glm::uvec2 size, std::vector<uint8_t>& texels);
+
+    // Writes a baked occlusion map.
+    static void save(const std::filesystem::path& path, uint64_t bakeHash, glm::uvec2 size, const std::vector<uint8_t>& texels);
+};
@@ -0,0 +1,278 @@
+#include "TiledHeightmap.h"
+#include "hashBytes.h"
+
+using namespace glm;
+
+// The name of the manifest file describing a tiled heightmap.
+static const std::string MANIFEST_FILENAME { "heightmap.json" };
+
+bool TiledHeightmap::open(const std::filesystem::path& directory, size_t memoryBudget)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+
+    ofJson manifest { ofLoadJson(directory / MANIFEST_FILENAME) };
+    if (manifest.is_null() || !manifest.contains("width") || !manifest.contains("height") || !manifest.contains("tileSize"))
+    {
+        ofLogError("TiledHeightmap") << "Missing or invalid manifest in " << directory;
+        return false;
+    }
+
+    this->directory = directory;
+    this->memoryBudget = memoryBudget;
+    size = uvec2(manifest["width"].get<unsigned int>(), manifest["height"].get<unsigned int>());
+    tileSize = manifest["tileSize"].get<unsigned int>();
+    tileCount = (size + tileSize - 1u) / tileSize;
+
+    tiles.clear();
+    tiles.resize(static_cast<size_t>(tileCount.x) * tileCount.y);
+    residentBytes = 0;
+    useCounter = 0;
+
+    return true;
+}
+
+bool TiledHeightmap::writeTiles(const ofShortPixels& heightmap, const std::filesystem::path& directory, unsigned int tileSize)
+{
+    ofDirectory::createDirectory(directory, true, true);
+
+    uvec2 size { heightmap.getWidth(), heightmap.getHeight() };
+    uvec2 tileCount { (size + tileSize - 1u) / tileSize };
+    size_t channels { heightmap.getNumChannels() };
+
+    for (unsigned int ty { 0 }; ty < tileCount.y; ty++)
+    {
+        for (unsigned int tx { 0 }; tx < tileCount.x; tx++)
+        {
+            uvec2 start { uvec2(tx, ty) * tileSize };
+            uvec2 extent { min(uvec2(tileSize), size - start) };
+
+            // Copy the first channel of each pixel into a single-channel tile.
+            ofShortPixels tile {};
+            tile.allocate(extent.x, extent.y, OF_PIXELS_GRAY);
+            for (unsigned int y { 0 }; y < extent.y; y++)
+            {
+                for (unsigned int x { 0 }; x < extent.x; x++)
+                {
+                    tile.getData()[y * extent.x + x] = heightmap.getData()[((start.y + y) * size.x + start.x + x) * channels];
+                }
+            }
+
+            if (!ofSaveImage(tile, directory / ("tile_" + ofToString(tx) + "_" + ofToString(ty) + ".png")))
+            {
+                ofLogError("TiledHeightmap") << "Failed to write tile " << tx << ", " << ty;
+                return false;
+            }
+        }
+    }
+
+    ofJson manifest {};
+    manifest["width"] = size.x;
+    manifest["height"] = size.y;
+    manifest["tileSize"] = tileSize;
+    return ofSavePrettyJson(directory / MANIFEST_FILENAME, manifest);
+}
+
+bool TiledHeightmap::exists(const std::filesystem::path& directory)
+{
+    return ofFile::doesFileExist(directory / MANIFEST_FILENAME);
+}
+
+uvec2 TiledHeightmap::getSize() const
+{
+    return size;
+}
+
+unsigned short TiledHeightmap::getValue(unsigned int x, unsigned int y)
+{
+    std::unique_lock<std::mutex> lock { mutex };
+
+    std::shared_ptr<const ofShortPixels> tile { acquireTile(uvec2(x, y) / tileSize, lock) };
+    return tile->getData()[(y % tileSize) * tile->getWidth() + (x % tileSize)];
+}
+
+void TiledHeightmap::getQuad(unsigned int x, unsigned int y, unsigned short values[4])
+{
+    std::unique_lock<std::mutex> lock { mutex };
+
+    // Usually all four pixels are in the same tile, so only look a tile up again when the pixel crosses into another.
+    uvec2 currentIndex { UINT_MAX };
+    std::shared_ptr<const ofShortPixels> tile {};
+
+    for (unsigned int i { 0 }; i < 4; i++)
+    {
+        uvec2 pixel { x + i / 2, y + i % 2 };
+        uvec2 tileIndex { pixel / tileSize };
+        if (tileIndex != currentIndex)
+        {
+            tile = acquireTile(tileIndex, lock);
+            currentIndex = tileIndex;
+        }
+
+        values[i] = tile->getData()[(pixel.y % tileSize) * tile->getWidth() + (pixel.x % tileSize)];
+    }
+}
+
+void TiledHeightmap::copyRegion(uvec2 start, uvec2 regionSize, ofShortPixels& region)
+{
+    region.allocate(regionSize.x, regionSize.y, OF_PIXELS_GRAY);
+
+    std::unique_lock<std::mutex> lock { mutex };
+
+    uvec2 end { start + regionSize }; // exclusive
+    uvec2 firstTile { start / tileSize };
+    uvec2 lastTile { (end - 1u) / tileSize };
+
+    for (unsigned int ty { firstTile.y }; ty <= lastTile.y; ty++)
+    {
+        for (unsigned int tx { firstTile.x }; tx <= lastTile.x; tx++)
+        {
+            std::shared_ptr<const ofShortPixels> tilePixels { acquireTile(uvec2(tx, ty), lock) };
+            const ofShortPixels& tile { *tilePixels };
+            uvec2 tileStart { uvec2(tx, ty) * tileSize };
+
+            // The part of the region that overlaps this tile, in heightmap pixel coordinates.
+            uvec2 overlapStart { max(start, tileStart) };
+            uvec2 overlapEnd { min(end, tileStart + uvec2(tile.getWidth(), tile.getHeight())) };
+
+            for (unsigned int y { overlapStart.y }; y < overlapEnd.y; y++)
+            {
+                const unsigned short* src { tile.getData() + (y - tileStart.y) * tile.getWidth() + (overlapStart.x - tileStart.x) };
+                unsigned short* dst { region.getData() + (y - start.y) * regionSize.x + (overlapStart.x - start.x) };
+                std::copy(src, src + (overlapEnd.x - overlapStart.x), dst);
+            }
+        }
+    }
+}
+
+void TiledHeightmap::setWorkingSet(uvec2 minPixel, uvec2 maxPixel)
+{
+    std::lock_guard<std::mutex> lock { mutex };
+
+    uvec2 firstTile { min(minPixel, size - 1u) / tileSize };
+    uvec2 lastTile { min(maxPixel, size - 1u) / tileSize };
+
+    for (unsigned int ty { 0 }; ty < tileCount.y; ty++)
+    {
+        for (unsigned int tx { 0 }; tx < tileCount.x; tx++)
+        {
+            tiles[ty * tileCount.x + tx].pinned =
+                tx >= firstTile.x && tx <= lastTile.x && ty >= firstTile.y && ty <= lastTile.y;
+        }
+    }
+
+    evictTiles();
+}
+
+size_t TiledHeightmap::getResidentBytes() const
+{
+    std::lock_guard<std::mutex> lock { mutex };
+    return residentBytes;
+}
+
+uint64_t TiledHeightmap::computeHash() const
+{
+    uint64_t hash { hashBytes(&size, sizeof(size)) };
+    hash = hashBytes(&tileSize, sizeof(tileSize), hash);
+
+    for (unsigned int ty { 0 }; ty < tileCount.y; ty++)
+    {
+        for (unsigned int tx { 0 }; tx < tileCount.x; tx++)
+        {
+            std::error_code error {};
+            std::filesystem::path tilePath { ofToDataPath(getTilePath(uvec2(tx, ty)), true) };
+            uintmax_t fileSize { std::filesystem::file_size(tilePath, error) };
+            auto writeTime { std::filesystem::last_write_time(tilePath, error).time_since_epoch().count() };
+
+            hash = hashBytes(&fileSize, sizeof(fileSize), hash);
+            hash = hashBytes(&writeTime, sizeof(writeTime), hash);
+        }
+    }
+
+    return hash;
+}
+
+std::filesystem::path TiledHeightmap::getTilePath(uvec2 tileIndex) const
+{
+    return directory / ("tile_" + ofToString(tileIndex.x) + "_" + ofToString(tileIndex.y) + ".png");
+}
+
+std::shared_ptr<const ofShortPixels> TiledHeightmap::acquireTile(uvec2 tileIndex, std::unique_lock<std::mutex>& lock)
+{
+    // The tile list is never resized while tiles are in use, so the reference stays valid while the lock is released below.
+    Tile& tile { tiles[tileIndex.y * tileCount.x + tileIndex.x] };
+
+    // If another thread is already loading the tile, wait for it rather than decoding the image twice.
+    tileLoaded.wait(lock, [&tile]() { return !tile.loading; });
+
+    tile.lastUsed = ++useCounter;
+    if (tile.pixels)
+    {
+        return tile.pixels;
+    }
+
+    // Decode the image without holding the lock, so that a tile miss doesn't stall every other thread reading resident tiles.
+    tile.loading = true;
+    lock.unlock();
+    std::shared_ptr<const ofShortPixels> pixels { loadTile(tileIndex) };
+    lock.lock();
+
+    tile.pixels = pixels;
+    tile.loading = false;
+    tile.lastUsed = ++useCounter;
+    residentBytes += pixels->getTotalBytes();
+
+    // Make room for the new tile (it's been marked as most recently used, so it will be evicted last).
+    evictTiles();
+
+    tileLoaded.notify_all();
+    return pixels;
+}
+
+std::shared_ptr<const ofShortPixels> TiledHeightmap::loadTile(uvec2 tileIndex) const
+{
+    std::shared_ptr<ofShortPixels> pixels { std::make_shared<ofShortPixels>() };
+
+    uvec2 tileStart { tileIndex * tileSize };
+    uvec2 extent { min(uvec2(tileSize), size - tileStart) };
+
+    if (!ofLoadImage(*pixels, getTilePath(tileIndex)) || pixels->getWidth() != extent.x || pixels->getHeight() != extent.y)
+    {
+        // Substitute a flat tile so that a missing file doesn't crash the terrain builder.
+        ofLogError("TiledHeightmap") << "Failed to load tile " << tileIndex.x << ", " << tileIndex.y;
+        pixels->allocate(extent.x, extent.y, OF_PIXELS_GRAY);
+        pixels->set(0);
+    }
+    else if (pixels->getNumChannels() != 1)
+    {
+        pixels->setImageType(OF_IMAGE_GRAYSCALE);
+    }
+
+    return pixels;
+}
+
+void TiledHeightmap::evictTiles()
+{
+    while (residentBytes > memoryBudget)
+    {
+        // Find the least recently used tile that isn't in the working set.
+        Tile* lruTile { nullptr };
+        for (Tile& tile : tiles)
+        {
+            if (tile.pixels && !tile.pinned && tile.lastUsed != useCounter
+                && (!lruTile || tile.lastUsed < lruTile->lastUsed))
+            {
+                lruTile = &tile;
+            }
+        }
+
+        if (!lruTile)
+        {
+            // Everything resident is in use; the working set is larger than the budget.
+            break;
+        }
+
+        // Any thread still reading the tile keeps its own reference, so the pixels are only freed once it's done.
+        residentBytes -= lruTile->pixels->getTotalBytes();
+        lruTile->pixels.reset();
+    }
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "ofMain.h"
+#include <condition_variable>
+
+// A heightmap that is split into a grid of square tiles stored on disk.
+// Tiles are paged in on demand and evicted in least-recently-used order once a memory budget is exceeded,
+// so the heightmap can be much larger than the amount of memory available.
+class TiledHeightmap
+{
+public:
+    TiledHeightmap() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    TiledHeightmap(const TiledHeightmap& t) = delete;
+    TiledHeightmap& operator= (const TiledHeightmap& t) = delete;
+
+    // Opens a tiled heightmap from a directory previously written by writeTiles().
+    // The memory budget is the maximum number of bytes of tile data that should be resident at once.
+    // Returns false if the directory doesn't contain a valid manifest.
+    bool open(const std::filesystem::path& directory, size_t memoryBudget);
+
+    // Splits a heightmap into tiles of the specified size (in pixels) and writes them, along with a manifest, to a directory.
+    static bool writeTiles(const ofShortPixels& heightmap, const std::filesystem::path& directory, unsigned int tileSize);
+
+    // Returns true if a directory contains a tiled heightmap manifest.
+    static bool exists(const std::filesystem::path& directory);
+
+    // Gets the dimensions (in pixels) of the entire heightmap.
+    glm::uvec2 getSize() const;
+
+    // Gets the value of a single heightmap pixel, loading the tile containing it if necessary.
+    unsigned short getValue(unsigned int x, unsigned int y);
+
+    // Gets the values of the four pixels from (x, y) to (x + 1, y + 1), for bilinear interpolation, with a single lock of the cache.
+    // The values are in the order (x, y), (x, y + 1), (x + 1, y), (x + 1, y + 1).  x + 1 and y + 1 must be within the heightmap.
+    void getQuad(unsigned int x, unsigned int y, unsigned short values[4]);
+
+    // Copies a rectangle of the heightmap into a single-channel pixel array,
+    // loading every tile that the rectangle overlaps so that regions straddling tile borders are seamless.
+    void copyRegion(glm::uvec2 start, glm::uvec2 regionSize, ofShortPixels& region);
+
+    // Marks the tiles overlapping a rectangle (in pixels) as the current working set.
+    // Tiles in the working set are never evicted; all other tiles are evicted as needed to stay within the memory budget.
+    void setWorkingSet(glm::uvec2 minPixel, glm::uvec2 maxPixel);
+
+    // Gets the number of bytes of tile data currently resident in memory.
+    size_t getResidentBytes() const;
+
+    // Computes a hash identifying the contents of the heightmap without loading any tiles,
+    // from the manifest and the size and modification time of each tile file.
+    uint64_t computeHash() const;
+
+private:
+    // The state of a single tile.
+    struct Tile
+    {
+        // The pixels of the tile; null when the tile is not resident.  Shared, so that a tile evicted while another thread
+        // is reading it stays alive until that thread is done.
+        std::shared_ptr<const ofShortPixels> pixels {};
+
+        // True while a thread is loading the tile (without holding the mutex).
+        bool loading { false };
+
+        // The value of the usage counter the last time this tile was accessed; used for LRU eviction.
+        uint64_t lastUsed { 0 };
+
+        // Set to true while the tile overlaps the working set.
+        bool pinned { false };
+    };
+
+    // The directory containing the tile images.
+    std::filesystem::path directory {};
+
+    // The dimensions (in pixels) of the entire heightmap.
+    glm::uvec2 size { 0 };
+
+    // The size (in pixels) of each tile; tiles on the right and bottom edges may be smaller.
+    unsigned int tileSize { 0 };
+
+    // The number of tiles in each dimension.
+    glm::uvec2 tileCount { 0 };
+
+    // The maximum number of bytes of tile data that should be resident at once.
+    size_t memoryBudget { 0 };
+
+    // The number of bytes of tile data currently resident.
+    size_t residentBytes { 0 };
+
+    // Incremented every time a tile is accessed.
+    uint64_t useCounter { 0 };
+
+    // Every tile in the grid, stored in row-major order.
+    std::vector<Tile> tiles {};
+
+    // Guards the tile cache; tiles may be requested from several threads.
+    mutable std::mutex mutex {};
+
+    // Signalled whenever a tile finishes loading.
+    std::condition_variable tileLoaded {};
+
+    // Gets the path of the image file for a particular tile.
+    std::filesystem::path getTilePath(glm::uvec2 tileIndex) const;
+
+    // Gets a tile, loading it from disk if necessary.  The mutex must be held by the caller through the lock;
+    // it's released while the tile is decoded, so other threads can use resident tiles in the meantime,
+    // and a thread that wants a tile someone else is already loading waits for it instead of decoding it again.
+    std::shared_ptr<const ofShortPixels> acquireTile(glm::uvec2 tileIndex, std::unique_lock<std::mutex>& lock);
+
+    // Reads and decodes a tile's image.  Doesn't touch the cache, so it doesn't need the mutex.
+    std::shared_ptr<const ofShortPixels> loadTile(glm::uvec2 tileIndex) const;
+
+    // Evicts least recently used tiles outside the working set until the resident size is within the memory budget.
+    // The mutex must be held by the caller.
+    void evictTiles();
+};
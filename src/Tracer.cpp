@@ -0,0 +1,160 @@
+#include "Tracer.h"
+
+std::atomic<bool> Tracer::enabled { false };
+std::atomic<int64_t> Tracer::enabledTime { 0 };
+std::mutex Tracer::registryMutex {};
+std::vector<std::unique_ptr<Tracer::ThreadRing>> Tracer::rings {};
+thread_local Tracer::ThreadRing* Tracer::threadRing { nullptr };
+
+// Converts a time point to nanoseconds of the steady clock.
+static int64_t toNanoseconds(std::chrono::steady_clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+// Writes a string as a JSON string literal.
+static void writeJSONString(std::ostream& stream, const std::string& text)
+{
+    stream << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            stream << '\\';
+        }
+
+        stream << (static_cast<unsigned char>(c) < 0x20 ? ' ' : c);
+    }
+
+    stream << '"';
+}
+
+void Tracer::setEnabled(bool enabled)
+{
+    if (enabled && !Tracer::enabled)
+    {
+        enabledTime = toNanoseconds(std::chrono::steady_clock::now());
+    }
+
+    Tracer::enabled = enabled;
+}
+
+void Tracer::setThreadName(const std::string& name)
+{
+    ThreadRing& ring { getThreadRing() };
+
+    std::lock_guard<std::mutex> lock { registryMutex };
+    ring.name = name;
+}
+
+void Tracer::record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+    const Arg* args, unsigned int argCount)
+{
+    ThreadRing& ring { getThreadRing() };
+
+    // Only this thread ever writes the count, so it can be read without synchronization here.
+    uint64_t eventNumber { ring.eventCount.load(std::memory_order_relaxed) };
+    Event& event { ring.events[eventNumber % RING_SIZE] };
+
+    event.name = name;
+    event.start = toNanoseconds(start);
+    event.duration = toNanoseconds(end) - event.start;
+    event.argCount = argCount < MAX_ARGS ? argCount : MAX_ARGS;
+    for (unsigned int i { 0 }; i < event.argCount; i++)
+    {
+        event.argNames[i] = args[i].name;
+        event.argValues[i] = args[i].value;
+    }
+
+    // Publish the event once it's complete.
+    ring.eventCount.store(eventNumber + 1, std::memory_order_release);
+}
+
+bool Tracer::writeJSON(const std::filesystem::path& path)
+{
+    std::ofstream file { ofToDataPath(path, true), std::ios::trunc };
+    if (!file)
+    {
+        ofLogWarning("Tracer") << "Failed to open " << path;
+        return false;
+    }
+
+    int64_t origin { enabledTime.load() };
+    std::vector<Event> events {};
+    bool firstEvent { true };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+    file << std::fixed << std::setprecision(3);
+
+    std::lock_guard<std::mutex> lock { registryMutex };
+    for (const std::unique_ptr<ThreadRing>& ring : rings)
+    {
+        // Copy the ring, then drop any events that its thread may have overwritten while they were being copied:
+        // the oldest event still intact afterwards is the one after the slot the thread could be writing now.
+        uint64_t end { ring->eventCount.load(std::memory_order_acquire) };
+        uint64_t begin { end > RING_SIZE ? end - RING_SIZE : 0 };
+
+        events.clear();
+        for (uint64_t i { begin }; i < end; i++)
+        {
+            events.push_back(ring->events[i % RING_SIZE]);
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t latestEnd { ring->eventCount.load(std::memory_order_relaxed) };
+        size_t firstIntact { latestEnd >= begin + RING_SIZE ? static_cast<size_t>(latestEnd - RING_SIZE + 1 - begin) : 0 };
+
+        file << (firstEvent ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << ring->threadId << ",\"args\":{\"name\":";
+        writeJSONString(file, ring->name.empty() ? "thread " + std::to_string(ring->threadId) : ring->name);
+        file << "}}";
+        firstEvent = false;
+
+        for (size_t i { firstIntact }; i < events.size(); i++)
+        {
+            const Event& event { events[i] };
+            if (event.start < origin)
+            {
+                continue;
+            }
+
+            // Chrome's trace format measures time in microseconds.
+            file << ",\n{\"name\":";
+            writeJSONString(file, event.name);
+            file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->threadId
+                << ",\"ts\":" << (event.start - origin) / 1000.0 << ",\"dur\":" << event.duration / 1000.0;
+
+            if (event.argCount > 0)
+            {
+                file << ",\"args\":{";
+                for (unsigned int arg { 0 }; arg < event.argCount; arg++)
+                {
+                    file << (arg > 0 ? "," : "");
+                    writeJSONString(file, event.argNames[arg]);
+                    file << ":" << event.argValues[arg];
+                }
+
+                file << "}";
+            }
+
+            file << "}";
+        }
+    }
+
+    file << "\n]}" << endl;
+    return static_cast<bool>(file);
+}
+
+Tracer::ThreadRing& Tracer::getThreadRing()
+{
+    if (!threadRing)
+    {
+        std::unique_ptr<ThreadRing> ring { std::make_unique<ThreadRing>() };
+
+        std::lock_guard<std::mutex> lock { registryMutex };
+        ring->threadId = static_cast<unsigned int>(rings.size() + 1);
+        threadRing = ring.get();
+        rings.push_back(std::move(ring));
+    }
+
+    return *threadRing;
+}
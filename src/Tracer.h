@@ -0,0 +1,159 @@
+#pragma once
+#include "ofMain.h"
+
+// Records a timeline of named scopes from every thread, for finding out where a hitch came from, and writes it out as
+// Chrome trace-event JSON (which Perfetto and chrome://tracing can open).
+// Each thread records into a ring buffer of its own, so recording an event never takes a lock or waits on another thread;
+// once a ring is full, its oldest events are overwritten.  Scopes check a single flag before doing anything else,
+// so they cost almost nothing while tracing is off.  Use the TRACE_SCOPE macro rather than calling record() directly.
+// Event and argument names are kept as pointers, so they must be string literals (or otherwise live as long as the program).
+class Tracer
+{
+public:
+    // A named integer attached to an event, such as a cell coordinate.
+    struct Arg
+    {
+        Arg() = default;
+
+        template<typename T>
+        Arg(const char* name, T value)
+            : name { name }, value { static_cast<int64_t>(value) }
+        {
+        }
+
+        const char* name;
+        int64_t value;
+    };
+
+    // The most arguments an event can carry; any beyond these are dropped.
+    const static unsigned int MAX_ARGS { 4 };
+
+    // The number of events each thread's ring holds.
+    const static size_t RING_SIZE { 16384 };
+
+    // Turns tracing on or off.  Turning it on starts a fresh timeline; anything recorded before is left out of the next file.
+    static void setEnabled(bool enabled);
+
+    // Returns true while tracing is on.
+    static bool isEnabled()
+    {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    // Names the calling thread in the timeline.
+    static void setThreadName(const std::string& name);
+
+    // Records an event on the calling thread's ring.
+    static void record(const char* name, std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end,
+        const Arg* args, unsigned int argCount);
+
+    // Writes the events recorded since tracing was last turned on, from every thread, to a JSON file (relative to the data folder),
+    // replacing the file.  Threads can keep recording while it's written.  Returns false on failure.
+    static bool writeJSON(const std::filesystem::path& path);
+
+private:
+    // A completed scope.
+    struct Event
+    {
+        // The name of the scope.
+        const char* name;
+
+        // When the scope started and how long it took, in nanoseconds of the steady clock.
+        int64_t start;
+        int64_t duration;
+
+        // The arguments attached to the event.
+        unsigned int argCount;
+        const char* argNames[MAX_ARGS];
+        int64_t argValues[MAX_ARGS];
+    };
+
+    // The events recorded by a single thread.  Rings outlive their threads, so that a thread's events can still be written after it ends.
+    struct ThreadRing
+    {
+        // The thread's ID in the timeline.
+        unsigned int threadId { 0 };
+
+        // The thread's name in the timeline; guarded by the registry mutex.
+        std::string name {};
+
+        // The events, indexed by their number modulo RING_SIZE.
+        std::unique_ptr<Event[]> events { std::make_unique<Event[]>(RING_SIZE) };
+
+        // The number of events recorded so far.  Only the owning thread writes it; it's published after each event is complete.
+        std::atomic<uint64_t> eventCount { 0 };
+    };
+
+    // True while tracing is on.
+    static std::atomic<bool> enabled;
+
+    // When tracing was last turned on, in nanoseconds of the steady clock.
+    static std::atomic<int64_t> enabledTime;
+
+    // Guards the list of rings and their names.
+    static std::mutex registryMutex;
+
+    // Every thread's ring, in the order the threads first recorded an event.
+    static std::vector<std::unique_ptr<ThreadRing>> rings;
+
+    // The calling thread's ring, once it has one.
+    static thread_local ThreadRing* threadRing;
+
+    // Gets the calling thread's ring, creating it the first time.
+    static ThreadRing& getThreadRing();
+};
+
+// Records the time from its construction to the end of its scope as an event, if tracing was on when it was constructed.
+class TraceScope
+{
+public:
+    TraceScope(const char* name, std::initializer_list<Tracer::Arg> args = {})
+        : name { name }, active { Tracer::isEnabled() }
+    {
+        if (active)
+        {
+            for (const Tracer::Arg& arg : args)
+            {
+                if (argCount < Tracer::MAX_ARGS)
+                {
+                    this->args[argCount++] = arg;
+                }
+            }
+
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (active)
+        {
+            Tracer::record(name, start, std::chrono::steady_clock::now(), args, argCount);
+        }
+    }
+
+    // Don't support copy constructor or copy assignment operator.
+    TraceScope(const TraceScope& t) = delete;
+    TraceScope& operator= (const TraceScope& t) = delete;
+
+private:
+    // The name of the event.
+    const char* name;
+
+    // True if tracing was on when the scope started.
+    bool active;
+
+    // When the scope started.
+    std::chrono::steady_clock::time_point start {};
+
+    // The arguments attached to the event; only the first argCount are set (the rest are left uninitialized, as they're never read).
+    unsigned int argCount { 0 };
+    Tracer::Arg args[Tracer::MAX_ARGS];
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Traces the rest of the enclosing block as an event with a name and, optionally, integer arguments:
+// TRACE_SCOPE("buildCell") or TRACE_SCOPE("buildCell", { { "x", x }, { "y", y } }).
+#define TRACE_SCOPE(...) TraceScope TRACE_CONCAT(traceScope, __LINE__) { __VA_ARGS__ }
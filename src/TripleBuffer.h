@@ -0,0 +1,69 @@
+#pragma once
+#include "ofMain.h"
+
+// Passes the latest version of some state from one thread to another without locks.
+// There are three copies of the state: the writer fills one, the reader reads another, and the third holds the most recently
+// written copy until the reader takes it.  Publishing and taking a copy are each a single atomic exchange, so neither side
+// ever waits for the other; if the writer is faster, the reader simply skips the copies it never got to.
+// The copies are reused rather than reallocated, so any containers inside them keep their capacity.
+// Only one thread may write and only one thread may read.
+template<typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() = default;
+
+    // Don't support copy constructor or copy assignment operator.
+    TripleBuffer(const TripleBuffer& t) = delete;
+    TripleBuffer& operator= (const TripleBuffer& t) = delete;
+
+    // Gets the copy that the writer is filling.  It still holds whatever was written to it three publishes ago (or a default-constructed T).
+    T& getWriteBuffer()
+    {
+        return buffers[writeIndex];
+    }
+
+    // Publishes the copy that the writer has filled, replacing any published copy that the reader hasn't taken yet.
+    void publish()
+    {
+        writeIndex = middle.exchange(writeIndex | FRESH) & INDEX_MASK;
+    }
+
+    // Takes the most recently published copy, if there's one the reader hasn't seen yet, and returns true if it did.
+    // Either way, getReadBuffer() then returns the newest copy the reader has.
+    bool acquire()
+    {
+        if ((middle.load() & FRESH) == 0)
+        {
+            return false;
+        }
+
+        readIndex = middle.exchange(readIndex) & INDEX_MASK;
+        return true;
+    }
+
+    // Gets the copy that the reader took last.  Stays valid (and unchanged) until the next successful acquire().
+    const T& getReadBuffer() const
+    {
+        return buffers[readIndex];
+    }
+
+private:
+    // Set in the middle index when the copy it refers to has been published but not yet taken.
+    const static unsigned int FRESH { 4 };
+
+    // Masks the buffer index out of the middle index.
+    const static unsigned int INDEX_MASK { 3 };
+
+    // The three copies.
+    T buffers[3] {};
+
+    // The copy the writer is filling.  Only touched by the writer.
+    unsigned int writeIndex { 0 };
+
+    // The copy holding the most recently published state, along with the FRESH flag.
+    std::atomic<unsigned int> middle { 1 };
+
+    // The copy the reader is reading.  Only touched by the reader.
+    unsigned int readIndex { 2 };
+};
@@ -1,51 +1,248 @@
 #include "World.h"
 #include "buildTerrainMesh.h"
 #include "calcTangents.h"
+#include "hashBytes.h"
 
 
 using namespace glm;
 
 void World::buildMeshForTerrainCell(ofMesh& terrainMesh, uvec2 startPos, uvec2 size) const
 {
-    if (startPos.x < heightmap->getWidth() && startPos.y < heightmap->getHeight())
+    uvec2 heightmapSize { getHeightmapSize() };
+
+    if (startPos.x < heightmapSize.x && startPos.y < heightmapSize.y)
     {
         // Clamp the size to the bounds of the heightmap
-        size = min(size, uvec2(heightmap->getWidth(), heightmap->getHeight()) - startPos - 1u);
+        size = min(size, heightmapSize - startPos - 1u);
 
-        // Use buildTerrainMesh() to initialize or re-initialize the mesh.
         // The scale parameter taken by buildTerrainMesh needs to be relative to the dimensions of the heightmap
-        buildTerrainMesh(terrainMesh, *heightmap, startPos.x, startPos.y, startPos.x + size.x, startPos.y + size.y, 
-            dimensions / vec3(heightmap->getWidth() - 1, 1, heightmap->getHeight() - 1));
-        
+        vec3 scale { dimensions / vec3(heightmapSize.x - 1, 1, heightmapSize.y - 1) };
+
+        if (tiledHeightmap || compressedHeightmap)
+        {
+            // Copy the cell out of the tiles, with a one pixel border where available
+            // so that normals along the edges of the cell match the neighboring cells.
+            uvec2 regionStart { max(startPos, uvec2(1)) - 1u };
+            uvec2 regionEnd { min(startPos + size + 2u, heightmapSize) };
+
+            ofShortPixels region {};
+            copyHeightmapRegion(regionStart, regionEnd - regionStart, region);
 
+            // Use buildTerrainMesh() on the copied region, offsetting the vertices back to their position in the full heightmap.
+            uvec2 localStart { startPos - regionStart };
+            buildTerrainMesh(terrainMesh, region, localStart.x, localStart.y, localStart.x + size.x, localStart.y + size.y, scale, regionStart);
+        }
+        else
+        {
+            // Use buildTerrainMesh() to initialize or re-initialize the mesh.
+            buildTerrainMesh(terrainMesh, *heightmap, startPos.x, startPos.y, startPos.x + size.x, startPos.y + size.y, scale);
+        }
     }
 }
 
 float World::getTerrainHeightAtPosition(const glm::vec3& position) const
 {
-    if (!heightmap)
+    if (!heightmap && !tiledHeightmap && !compressedHeightmap)
     {
         return 0.0f;
     }
     else
     {
+        uvec2 heightmapSize { getHeightmapSize() };
+
         // After unscaling, should range between (0, 0, 0) and (1, 1, 1)
         vec3 unscaledPosition { position / dimensions };
 
         // Remap to the resolution of the heightmap
-        vec2 pixelScaledPosition { vec2(unscaledPosition.x, unscaledPosition.z) * vec2(heightmap->getWidth() - 1, heightmap->getHeight() - 1) };
+        vec2 pixelScaledPosition { vec2(unscaledPosition.x, unscaledPosition.z) * vec2(heightmapSize - 1u) };
 
         // Round down and clamp to get pixel indices
-        ivec2 baseIndices { clamp(ivec2(floor(pixelScaledPosition)), ivec2(0), ivec2(heightmap->getWidth() - 2, heightmap->getHeight() - 2)) };
+        ivec2 baseIndices { clamp(ivec2(floor(pixelScaledPosition)), ivec2(0), ivec2(heightmapSize) - 2) };
 
         // Calculate linear interpolation weights
-        float height00 { static_cast<float>(heightmap->getColor(baseIndices[0],     baseIndices[1])[0]) };
-        float height01 { static_cast<float>(heightmap->getColor(baseIndices[0],     baseIndices[1] + 1)[0]) };
-        float height10 { static_cast<float>(heightmap->getColor(baseIndices[0] + 1, baseIndices[1])[0]) };
-        float height11 { static_cast<float>(heightmap->getColor(baseIndices[0] + 1, baseIndices[1] + 1)[0]) };
+        float height00 { 0 };
+        float height01 { 0 };
+        float height10 { 0 };
+        float height11 { 0 };
+        if (tiledHeightmap)
+        {
+            // Fetch all four samples under a single lock of the tile cache.
+            unsigned short quad[4] {};
+            tiledHeightmap->getQuad(baseIndices[0], baseIndices[1], quad);
+            height00 = static_cast<float>(quad[0]);
+            height01 = static_cast<float>(quad[1]);
+            height10 = static_cast<float>(quad[2]);
+            height11 = static_cast<float>(quad[3]);
+        }
+        else
+        {
+            height00 = static_cast<float>(getHeightmapValue(baseIndices[0],     baseIndices[1]));
+            height01 = static_cast<float>(getHeightmapValue(baseIndices[0],     baseIndices[1] + 1));
+            height10 = static_cast<float>(getHeightmapValue(baseIndices[0] + 1, baseIndices[1]));
+            height11 = static_cast<float>(getHeightmapValue(baseIndices[0] + 1, baseIndices[1] + 1));
+        }
+
         vec2 st { pixelScaledPosition - vec2(baseIndices) };
 
         // Linearly interpolate and apply the correct scale to the height being returned.
         return (mix(mix(height00, height01, st[1]), mix(height10, height11, st[1]), st[0]) / USHRT_MAX) * dimensions.y; 
     }
-}
\ No newline at end of file
+}
+
+void World::getTerrainHeightsAtPositions(const float* x, const float* z, float* heights, size_t count) const
+{
+    if (!heightmap || tiledHeightmap || compressedHeightmap)
+    {
+        // Tiles need to be looked up one sample at a time.
+        for (size_t i { 0 }; i < count; i++)
+        {
+            heights[i] = getTerrainHeightAtPosition(vec3(x[i], 0, z[i]));
+        }
+    }
+    else
+    {
+        // Hoist everything that doesn't depend on the position out of the loop, and read the pixels directly.
+        const unsigned short* pixels { heightmap->getData() };
+        size_t channels { heightmap->getNumChannels() };
+        int width { static_cast<int>(heightmap->getWidth()) };
+        int height { static_cast<int>(heightmap->getHeight()) };
+        float pixelScaleX { (width - 1) / dimensions.x };
+        float pixelScaleZ { (height - 1) / dimensions.z };
+        float heightScale { dimensions.y / USHRT_MAX };
+
+        for (size_t i { 0 }; i < count; i++)
+        {
+            // Remap to the resolution of the heightmap.
+            float pixelX { x[i] * pixelScaleX };
+            float pixelZ { z[i] * pixelScaleZ };
+
+            // Round down and clamp to get pixel indices
+            int baseX { std::min(std::max(static_cast<int>(std::floor(pixelX)), 0), width - 2) };
+            int baseZ { std::min(std::max(static_cast<int>(std::floor(pixelZ)), 0), height - 2) };
+            float s { pixelX - baseX };
+            float t { pixelZ - baseZ };
+
+            const unsigned short* row0 { pixels + (static_cast<size_t>(baseZ) * width + baseX) * channels };
+            const unsigned short* row1 { row0 + width * channels };
+            float height00 { static_cast<float>(row0[0]) };
+            float height10 { static_cast<float>(row0[channels]) };
+            float height01 { static_cast<float>(row1[0]) };
+            float height11 { static_cast<float>(row1[channels]) };
+
+            // Bilinearly interpolate, matching getTerrainHeightAtPosition().
+            float height0 { height00 + (height01 - height00) * t };
+            float height1 { height10 + (height11 - height10) * t };
+            heights[i] = (height0 + (height1 - height0) * s) * heightScale;
+        }
+    }
+}
+
+uvec2 World::getHeightmapSize() const
+{
+    if (tiledHeightmap)
+    {
+        return tiledHeightmap->getSize();
+    }
+    else if (compressedHeightmap)
+    {
+        return compressedHeightmap->getSize();
+    }
+    else
+    {
+        return uvec2(heightmap->getWidth(), heightmap->getHeight());
+    }
+}
+
+unsigned short World::getHeightmapValue(unsigned int x, unsigned int y) const
+{
+    if (tiledHeightmap)
+    {
+        return tiledHeightmap->getValue(x, y);
+    }
+    else if (compressedHeightmap)
+    {
+        return compressedHeightmap->getValue(x, y);
+    }
+    else
+    {
+        return heightmap->getColor(x, y)[0];
+    }
+}
+
+void World::copyHeightmapRegion(uvec2 start, uvec2 size, ofShortPixels& region) const
+{
+    if (tiledHeightmap)
+    {
+        tiledHeightmap->copyRegion(start, size, region);
+    }
+    else if (compressedHeightmap)
+    {
+        compressedHeightmap->copyRegion(start, size, region);
+    }
+    else
+    {
+        // Keep only the first channel, so the region is single-channel however the heightmap image was stored (as the other storage modes return it).
+        region.allocate(size.x, size.y, OF_PIXELS_GRAY);
+        size_t channels { heightmap->getNumChannels() };
+        size_t heightmapWidth { heightmap->getWidth() };
+        for (unsigned int y { 0 }; y < size.y; y++)
+        {
+            const unsigned short* src { heightmap->getData() + ((start.y + y) * heightmapWidth + start.x) * channels };
+            unsigned short* dst { region.getData() + static_cast<size_t>(y) * size.x };
+            for (unsigned int x { 0 }; x < size.x; x++)
+            {
+                dst[x] = src[x * channels];
+            }
+        }
+    }
+}
+
+uint64_t World::computeTerrainHash() const
+{
+    uint64_t hash {};
+
+    if (tiledHeightmap)
+    {
+        hash = tiledHeightmap->computeHash();
+    }
+    else if (!heightmapFile.empty())
+    {
+        // Hashing a large heightmap byte by byte would cost much of the startup time the cache saves, so identify the file instead.
+        std::error_code error {};
+        std::filesystem::path path { ofToDataPath(heightmapFile, true) };
+        std::string pathString { path.string() };
+        uintmax_t fileSize { std::filesystem::file_size(path, error) };
+        auto writeTime { std::filesystem::last_write_time(path, error).time_since_epoch().count() };
+        uvec2 size { getHeightmapSize() };
+
+        hash = hashBytes(pathString.data(), pathString.size());
+        hash = hashBytes(&fileSize, sizeof(fileSize), hash);
+        hash = hashBytes(&writeTime, sizeof(writeTime), hash);
+        hash = hashBytes(&size, sizeof(size), hash);
+    }
+    else if (compressedHeightmap)
+    {
+        hash = compressedHeightmap->computeHash();
+    }
+    else
+    {
+        uvec2 size { getHeightmapSize() };
+        hash = hashBytes(&size, sizeof(size));
+        hash = hashBytes(heightmap->getData(), heightmap->getTotalBytes(), hash);
+    }
+
+    // The scale of the terrain affects the mesh as much as the heightmap does.
+    return hashBytes(&dimensions, sizeof(dimensions), hash);
+}
+
+void World::setWorkingSet(vec2 minPos, vec2 maxPos) const
+{
+    if (tiledHeightmap)
+    {
+        // Convert from world space to heightmap pixel indices.
+        vec2 pixelScale { vec2(getHeightmapSize() - 1u) / vec2(dimensions.x, dimensions.z) };
+        uvec2 minPixel { max(floor(minPos * pixelScale), vec2(0)) };
+        uvec2 maxPixel { max(ceil(maxPos * pixelScale), vec2(0)) };
+        tiledHeightmap->setWorkingSet(minPixel, maxPixel);
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 #include "ofMain.h"
+#include "TiledHeightmap.h"
+#include "CompressedHeightmap.h"
 
 struct World
 {
@@ -7,6 +9,18 @@ public:
     // The pixel array containing the world heightmap.
     const ofShortPixels* heightmap { nullptr };
 
+    // A heightmap paged in from tiles on disk, for worlds too large to keep in memory.
+    // If set, this is used instead of the pixel array above.
+    TiledHeightmap* tiledHeightmap { nullptr };
+
+    // A heightmap kept in memory as compressed tiles that are decompressed on demand.
+    // If set, this is used instead of the pixel array above.
+    CompressedHeightmap* compressedHeightmap { nullptr };
+
+    // The image file (relative to the data folder) that the in-memory or compressed heightmap was loaded from, if any.
+    // When set, the terrain hash identifies the heightmap by the file's path, size and modification time instead of reading every pixel.
+    std::filesystem::path heightmapFile {};
+
     // The desired x,y,z scale for the height map. 
     // The terrain will span from (0,0,0) to these dimensions, in world space coordinates
     // In other words, this field represents width, height, and depth of the world's terrain.
@@ -29,4 +43,25 @@ public:
 
     // Gets the height of the terrain at a particular position in world space.
     float getTerrainHeightAtPosition(const glm::vec3& position) const;
+
+    // Gets the height of the terrain at many positions at once, given as separate arrays of x- and z-coordinates in world space.
+    // Equivalent to calling getTerrainHeightAtPosition() for each position, but much faster for an in-memory heightmap.
+    void getTerrainHeightsAtPositions(const float* x, const float* z, float* heights, size_t count) const;
+
+    // Gets the dimensions (in pixels) of the heightmap, regardless of how it's stored.
+    glm::uvec2 getHeightmapSize() const;
+
+    // Gets the raw value (ranging from 0 to USHRT_MAX) of a single heightmap pixel.
+    unsigned short getHeightmapValue(unsigned int x, unsigned int y) const;
+
+    // Copies a rectangle of the heightmap into a single-channel pixel array, regardless of how it's stored.
+    void copyHeightmapRegion(glm::uvec2 start, glm::uvec2 size, ofShortPixels& region) const;
+
+    // Computes a hash identifying the heightmap contents and the world's dimensions;
+    // anything derived from the terrain geometry can be cached under this hash.
+    uint64_t computeTerrainHash() const;
+
+    // Tells the world which rectangle (in world space, on the xz-plane) is currently in use, 
+    // so that heightmap tiles outside of it can be paged out.  Does nothing if the heightmap isn't tiled.
+    void setWorkingSet(glm::vec2 minPos, glm::vec2 maxPos) const;
 };
\ No newline at end of file
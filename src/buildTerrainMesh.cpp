@@ -3,7 +3,7 @@
 using namespace glm;
 
 void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
-    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, vec3 scale)
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, vec3 scale, uvec2 offset)
 {
 
 
@@ -13,10 +13,10 @@ void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
         for (unsigned int y { yStart }; y <= yEnd; y++)
         {
             // Vertex position
-            terrainMesh.addVertex(scale * (vec3(x, static_cast<float>(heightmap.getColor(x, y).r) / static_cast<float>(USHRT_MAX), y)));
+            terrainMesh.addVertex(scale * (vec3(x + offset.x, static_cast<float>(heightmap.getColor(x, y).r) / static_cast<float>(USHRT_MAX), y + offset.y)));
 
             // UV coordinates
-            terrainMesh.addTexCoord(vec2(x, y));
+            terrainMesh.addTexCoord(vec2(x + offset.x, y + offset.y));
 
             // Calculate normal
 
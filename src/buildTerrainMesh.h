@@ -9,6 +9,8 @@
 // If the indices of a pixel are (x, y) -- integers ranging from (xStart, yStart) to (xEnd, yEnd) --
 // and the value stored in the heightmap at that location is h -- an integer ranging from 0 to USHRT_MAX (2^16 - 1)
 // -- then the position of the vertex in object space should be (x, h / USHRT_MAX (using floating-point division), y) * scale.
+// "offset" is added to the pixel indices when computing vertex positions and UVs; it should be set when "heightmap"
+// is a region copied out of a larger heightmap, so that the mesh is still placed at its position in the full heightmap.
 void buildTerrainMesh(ofMesh& terrainMesh, const ofShortPixels& heightmap,
-    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale);
+    unsigned int xStart, unsigned int yStart, unsigned int xEnd, unsigned int yEnd, glm::vec3 scale, glm::uvec2 offset = glm::uvec2(0));
 
@@ -1,8 +1,11 @@
 #include "calcTangents.h"
+#include "Tracer.h"
 
 // Tangent calculation from Halladay text
 void calcTangents(ofMesh& mesh)
 {
+    TRACE_SCOPE("calcTangents", { { "vertices", mesh.getNumVertices() } });
+
     using namespace glm;
     std::vector<vec4> tangents;
     tangents.resize(mesh.getNumVertices());
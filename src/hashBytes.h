@@ -0,0 +1,6 @@
+#pragma once
+#include "ofMain.h"
+
+// Computes a 64-bit non-cryptographic hash (FNV-1a) of a block of memory.
+// "seed" can be the hash of a previous block, to hash several blocks as if they were one.
+uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ull);
@@ -3,6 +3,9 @@
 #include "GLFW/glfw3.h"
 #include "buildTerrainMesh.h"
 #include "calcTangents.h"
+#include "Benchmarks.h"
+
+const std::string ofApp::TRACE_FILE { "trace.json" };
 
 using namespace glm;
 
@@ -41,28 +44,145 @@ void buildPlaneMesh(float width, float depth, float height, ofMesh& planeMesh)
 
 void ofApp::reloadShaders()
 {
-    terrainShader.load("shaders/terrain.vert", "shaders/terrain.frag");
-    waterShader.load("shaders/water.vert", "shaders/water.frag");
-    shader.load("shaders/my.vert", "shaders/my.frag");
-    skyboxShader.load("shaders/skybox.vert", "shaders/skybox.frag");
+    // Build a fresh set of programs in the background; the current ones stay in use until every new one has linked.
+    // If the last set is still being built, try again once it's done.
+    std::shared_ptr<ShaderSet> programs { std::make_shared<ShaderSet>() };
+    if (shaderCompiler.compile([programs]() { return buildShaders(*programs); }))
+    {
+        pendingShaders = programs;
+        needsReload = false;
+    }
+}
 
-    // Setup terrain shader uniform variables
-    terrainShader.begin();
-    terrainShader.setUniform3f("lightDir", normalize(vec3(1, 1, -1)));
-    terrainShader.setUniform3f("lightColor", vec3(1, 1, 0.5));
-    terrainShader.setUniform3f("ambientColor", vec3(0.15, 0.15, 0.3));
-    terrainShader.setUniform1f("gammaInv", 1.0f / 2.2f);
-    terrainShader.setUniform3f("meshColor", vec3(0.25, 0.5, 0.25));
-    terrainShader.setUniformMatrix3f("normalMatrix", mat3());
-    
-    terrainShader.end();
+bool ofApp::buildShaders(ShaderSet& programs)
+{
+    TRACE_SCOPE("buildShaders");
+
+    bool linked { true };
+    linked = programs.terrain.load("shaders/terrain.vert", "shaders/terrain.frag") && linked;
+    linked = programs.terrainGPU.load("shaders/terrain_gpu.vert", "shaders/terrain.frag") && linked;
+    linked = programs.terrainClipmap.load("shaders/terrain_clipmap.vert", "shaders/terrain.frag") && linked;
+    linked = programs.terrainDepth.load("shaders/terrain.vert", "shaders/depth_only.frag") && linked;
+    linked = programs.terrainGPUDepth.load("shaders/terrain_gpu.vert", "shaders/depth_only.frag") && linked;
+
+    // The tessellation shader needs every stage listed; if tessellation is unsupported or the program fails, don't use it
+    // (the rest of the set is still fine without it).
+    programs.tessellationAvailable = GPUTerrain::isTessellationSupported()
+        && programs.terrainTess.load({ { GL_VERTEX_SHADER, "shaders/terrain_tess.vert" },
+            { GL_TESS_CONTROL_SHADER, "shaders/terrain_tess.tesc" },
+            { GL_TESS_EVALUATION_SHADER, "shaders/terrain_tess.tese" },
+            { GL_FRAGMENT_SHADER, "shaders/terrain.frag" } });
+    linked = programs.water.load("shaders/water.vert", "shaders/water.frag") && linked;
+    linked = programs.basic.load("shaders/my.vert", "shaders/my.frag") && linked;
+    linked = programs.instanced.load("shaders/instanced.vert", "shaders/my.frag") && linked;
+    linked = programs.skybox.load("shaders/skybox.vert", "shaders/skybox.frag") && linked;
+    linked = programs.farImpostor.load("shaders/skybox.vert", "shaders/far_impostor.frag") && linked;
+
+    return linked;
+}
+
+void ofApp::applyShaders(ShaderSet& programs)
+{
+    TRACE_SCOPE("applyShaders");
+
+    terrainShader = std::move(programs.terrain);
+    terrainGPUShader = std::move(programs.terrainGPU);
+    terrainClipmapShader = std::move(programs.terrainClipmap);
+    terrainTessShader = std::move(programs.terrainTess);
+    terrainDepthShader = std::move(programs.terrainDepth);
+    terrainGPUDepthShader = std::move(programs.terrainGPUDepth);
+    waterShader = std::move(programs.water);
+    shader = std::move(programs.basic);
+    instancedShader = std::move(programs.instanced);
+    skyboxShader = std::move(programs.skybox);
+    farImpostorShader = std::move(programs.farImpostor);
+    tessellationAvailable = programs.tessellationAvailable;
+
+    // Connect every program to the shared camera, lighting and fade blocks; this only needs to happen once per link.
+    for (ShaderProgram* program : { &terrainShader, &terrainGPUShader, &terrainClipmapShader, &terrainTessShader,
+        &terrainDepthShader, &terrainGPUDepthShader, &waterShader, &shader, &skyboxShader, &farImpostorShader, &instancedShader })
+    {
+        if (program->isLoaded())
+        {
+            shaderUniforms.bindBlocks(*program);
+        }
+    }
+
+    // Resolve the terrain uniforms that are set on every pass, so drawing never looks them up by name.
+    terrainUniforms = getTerrainUniforms(terrainShader);
+    terrainGPUUniforms = getTerrainUniforms(terrainGPUShader);
+    terrainClipmapUniforms = getTerrainUniforms(terrainClipmapShader);
+    terrainTessUniforms = getTerrainUniforms(terrainTessShader);
+
+    // The lighting is the same for every shader and every frame.
+    shaderUniforms.setLighting(lightDirection, vec3(1, 1, 0.5), vec3(0.15, 0.15, 0.3), 1.0f / 2.2f);
+
+    // Setup terrain shader uniform variables (the same for every way of drawing the terrain)
+    for (ShaderProgram* program : { &terrainShader, &terrainGPUShader, &terrainClipmapShader, &terrainTessShader })
+    {
+        if (!program->isLoaded())
+        {
+            continue;
+        }
+
+        program->begin();
+        program->setUniform3f("meshColor", vec3(0.25, 0.5, 0.25));
+        program->end();
+    }
+
+    // The water color never changes either.
+    waterShader.begin();
+    waterShader.setUniform3f("meshColor", vec3(0.64, 0.73, 0.81));
+    waterShader.end();
+
+    // The distant terrain may look different with the new shaders.
+    farImpostor.invalidate();
+}
 
-    needsReload = false;
+ofApp::TerrainUniforms ofApp::getTerrainUniforms(const ShaderProgram& program)
+{
+    TerrainUniforms uniforms {};
+    uniforms.diffuseTex = program.getUniformLocation("diffuseTex");
+    uniforms.normalTex = program.getUniformLocation("normalTex");
+    uniforms.occlusionTex = program.getUniformLocation("occlusionTex");
+    uniforms.occlusionUVScale = program.getUniformLocation("occlusionUVScale");
+    uniforms.pixelsPerUnit = program.getUniformLocation("pixelsPerUnit");
+    return uniforms;
+}
+
+void ofApp::setTerrainMaterial(const ShaderProgram& program, const TerrainUniforms& uniforms, uvec2 heightmapSize)
+{
+    program.setUniformTexture(uniforms.diffuseTex, terrainDiffuse.getTexture(), 0);
+    program.setUniformTexture(uniforms.normalTex, terrainNormal.getTexture(), 1);
+    program.setUniformTexture(uniforms.occlusionTex, terrainOcclusion.getTexture(), 3);
+    program.setUniform2f(uniforms.occlusionUVScale, 1.0f / vec2(heightmapSize - 1u));
+}
+
+void ofApp::collectShaders(bool wait)
+{
+    bool linked { false };
+    if (!pendingShaders || !(wait ? shaderCompiler.wait(linked) : shaderCompiler.poll(linked)))
+    {
+        return;
+    }
+
+    if (linked)
+    {
+        applyShaders(*pendingShaders);
+    }
+    else
+    {
+        cout << "Shaders failed to build; keeping the previous ones." << endl;
+    }
+
+    pendingShaders.reset();
 }
 
 //--------------------------------------------------------------
 void ofApp::setup()
 {
+    Tracer::setThreadName("main");
+
     // Disable legacy "ArbTex"
     ofDisableArbTex();
 
@@ -79,16 +199,52 @@ void ofApp::setup()
     // Uncomment the following line to let GLFW take control of the cursor so we have unlimited cursor space
     // glfwSetInputMode(dynamic_pointer_cast<ofAppGLFWWindow>(window)->getGLFWWindow(), GLFW_CURSOR, GLFW_CURSOR_DISABLED);
     
-    // load terrain normal and diffuse
-    terrainDiffuse.load("textures/aerial_grass_rock_diff_4k.png");
-    terrainDiffuse.getTexture().setTextureWrap(GL_REPEAT, GL_REPEAT);
-    terrainNormal.load("textures/aerial_grass_rock_nor_4k.png");
-    terrainNormal.getTexture().setTextureWrap(GL_REPEAT, GL_REPEAT);
+    // Compress the terrain diffuse and normal textures the first time, then stream them in while the rest of the game loads.
+    const std::filesystem::path diffusePath { "textures/aerial_grass_rock_diff_4k.ktx" };
+    const std::filesystem::path normalPath { "textures/aerial_grass_rock_nor_4k.ktx" };
+
+    if (!std::filesystem::exists(ofToDataPath(diffusePath, true)))
+    {
+        cout << "Compressing terrain diffuse texture..." << endl;
+        StreamedTexture::bake("textures/aerial_grass_rock_diff_4k.png", diffusePath, StreamedTexture::Format::BC1, jobSystem);
+    }
+
+    if (!std::filesystem::exists(ofToDataPath(normalPath, true)))
+    {
+        cout << "Compressing terrain normal map..." << endl;
+        StreamedTexture::bake("textures/aerial_grass_rock_nor_4k.png", normalPath, StreamedTexture::Format::BC5_NORMAL, jobSystem);
+    }
+
+    // Until they arrive, the terrain is a flat grass color with flat normals.
+    terrainDiffuse.loadAsync(diffusePath, jobSystem, ofColor(64, 96, 48));
+    terrainNormal.loadAsync(normalPath, jobSystem, ofColor(128, 128, 255));
+
 
+    // Aim to keep the GPU's share of each frame within the target frame time.
+    DynamicResolution::Settings resolutionSettings {};
+    resolutionSettings.targetMilliseconds = 1000.0f / TARGET_FRAME_RATE;
+    dynamicResolution.setSettings(resolutionSettings);
 
-    // Load the shaders for the first time.
+    // Recapture the far impostor after moving a quarter of a near cell; the parallax correction covers the distance in between.
+    FarImpostor::Settings impostorSettings {};
+    impostorSettings.faceResolution = FAR_IMPOSTOR_RESOLUTION;
+    impostorSettings.updateDistance = 0.25f * NEAR_LOD_SIZE;
+    farImpostor.setSettings(impostorSettings);
+
+    // Start building the shaders in the background while the terrain loads; they're picked up at the end of setup.
+    shaderUniforms.setup();
+    shaderCompiler.setup();
     reloadShaders();
 
+    if (useTessellatedTerrain && !GPUTerrain::isTessellationSupported())
+    {
+        cout << "Tessellation shaders are unavailable; drawing the close terrain as displaced patches instead." << endl;
+        useTessellatedTerrain = false;
+    }
+
+    // Tessellated terrain uses the same heightmap window as the displaced patches.
+    useGPUTerrain = useGPUTerrain || useTessellatedTerrain;
+
     // Initialize the camera.
     headAngle = radians(180.0f);
     fpCamera.fov = radians(90.0f);
@@ -96,45 +252,132 @@ void ofApp::setup()
 
     cout << "Loading heightmap..." << endl;
 
-    // Load heightmap
-    heightmap.setUseTexture(false);
-    heightmap.load("TamrielBeta_10_2016_01.png");
-    assert(heightmap.getWidth() != 0 && heightmap.getHeight() != 0);
+    // The directory containing the heightmap tiles and the low-resolution heightmap for distant land.
+    const std::string tileDirectory { "heightmap_tiles" };
+
+    if (heightmapStorage == HeightmapStorage::TILED && !TiledHeightmap::exists(tileDirectory))
+    {
+        cout << "Splitting heightmap into tiles..." << endl;
+
+        // Load the full heightmap one last time to split it into tiles.
+        heightmap.setUseTexture(false);
+        heightmap.load("TamrielBeta_10_2016_01.png");
+        assert(heightmap.getWidth() != 0 && heightmap.getHeight() != 0);
+        TiledHeightmap::writeTiles(heightmap.getPixels(), tileDirectory, HEIGHTMAP_TILE_SIZE);
+
+        // Save the low-resolution heightmap for distant land alongside the tiles.
+        float heightmapAspect = static_cast<float>(heightmap.getWidth() - 1) / static_cast<float>(heightmap.getHeight() - 1);
+        heightmapFarLOD = heightmap;
+        heightmapFarLOD.resize(static_cast<int>(round(heightmapAspect * FAR_LOD_RESOLUTION)), FAR_LOD_RESOLUTION);
+        heightmapFarLOD.save(tileDirectory + "/farlod.png");
+
+        // The full heightmap is no longer needed in memory.
+        heightmap.clear();
+    }
+
+    if (heightmapStorage == HeightmapStorage::TILED && !tiledHeightmap.open(tileDirectory, HEIGHTMAP_MEMORY_BUDGET))
+    {
+        // Without a usable manifest, the size and every lookup would be garbage; fall back to the heightmap image.
+        cout << "Couldn't open the heightmap tiles; loading the whole heightmap instead." << endl;
+        heightmapStorage = HeightmapStorage::RAW;
+    }
+
+    if (heightmapStorage == HeightmapStorage::TILED)
+    {
+        // Page the heightmap in from tiles.
+        world.tiledHeightmap = &tiledHeightmap;
+    }
+    else
+    {
+        // Load heightmap
+        heightmap.setUseTexture(false);
+        heightmap.load("TamrielBeta_10_2016_01.png");
+        assert(heightmap.getWidth() != 0 && heightmap.getHeight() != 0);
+        world.heightmap = &heightmap.getPixels();
+        world.heightmapFile = "TamrielBeta_10_2016_01.png";
+    }
+
+    uvec2 heightmapSize { world.getHeightmapSize() };
 
     // Set initial camera position.
-    fpCamera.position = vec3((heightmap.getWidth() - 1) * 0.5f, 0, (heightmap.getHeight() - 1) * 0.5f);
+    fpCamera.position = vec3((heightmapSize.x - 1) * 0.5f, 0, (heightmapSize.y - 1) * 0.5f);
 
     // Build a single terrain mesh.  Uncomment the following line if not using a cell manager.
     // buildTerrainMesh(staticTerrain, heightmap, fpCamera.position.x - 384, fpCamera.position.z - 384, fpCamera.position.x + 384, fpCamera.position.z + 384, vec3(1, heightmapScale, 1));
 
     // Setup the world parameters.
-    world.heightmap = &heightmap.getPixels();
-    world.dimensions = vec3((heightmap.getWidth() - 1), heightmapScale, heightmap.getHeight() - 1);
+    world.dimensions = vec3((heightmapSize.x - 1), heightmapScale, heightmapSize.y - 1);
     world.gravity = -world.dimensions.y * 0.05f;
     world.waterHeight = 0.4375f * world.dimensions.y;
 
-    cout << "Downscaling heightmap for far LOD..." << endl;
+    // The clipmap draws distant land from the full heightmap, so it doesn't need a low-resolution copy.
+    if (!useClipmapTerrain)
+    {
+        if (heightmapStorage == HeightmapStorage::TILED)
+        {
+            cout << "Loading far LOD heightmap..." << endl;
+
+            heightmapFarLOD.setUseTexture(false);
+            heightmapFarLOD.load(tileDirectory + "/farlod.png");
+        }
+        else
+        {
+            cout << "Downscaling heightmap for far LOD..." << endl;
+
+            float heightmapAspect = static_cast<float>(heightmapSize.x - 1) / static_cast<float>(heightmapSize.y - 1);
+
+            // Make a copy of the heightmap to resize for distant land.
+            heightmapFarLOD = heightmap;
+            heightmapFarLOD.resize(static_cast<int>(round(heightmapAspect * FAR_LOD_RESOLUTION)), FAR_LOD_RESOLUTION);
+        }
+    }
 
-    float heightmapAspect = static_cast<float>(heightmap.getWidth() - 1) / static_cast<float>(heightmap.getHeight() - 1);
+    if (heightmapStorage == HeightmapStorage::COMPRESSED)
+    {
+        cout << "Compressing heightmap..." << endl;
 
-    // Make a copy of the heightmap to resize for distant land.
-    heightmapFarLOD = heightmap;
-    heightmapFarLOD.resize(static_cast<int>(round(heightmapAspect * FAR_LOD_RESOLUTION)), FAR_LOD_RESOLUTION);
+        // Keep only the compressed copy of the full-resolution heightmap.
+        compressedHeightmap.compress(heightmap.getPixels(), COMPRESSED_TILE_SIZE);
+        world.heightmap = nullptr;
+        world.compressedHeightmap = &compressedHeightmap;
+        heightmap.clear();
+    }
 
-    // Make a copy of the world the uses the low-resolution heightmap.
-    farLODWorld = world;
-    farLODWorld.heightmap = &heightmapFarLOD.getPixels();
+    // Bake the terrain's shadows and ambient occlusion the first time (or whenever the terrain or sun changes), looking for hills
+    // out to the edge of the near terrain.
+    TerrainOcclusion::BakeSettings occlusionSettings {};
+    occlusionSettings.resolution = OCCLUSION_MAP_RESOLUTION;
+    occlusionSettings.azimuthCount = OCCLUSION_AZIMUTHS;
+    occlusionSettings.maxDistance = static_cast<float>(NEAR_LOD_SIZE * NEAR_LOD_RANGE) * world.dimensions.x / (heightmapSize.x - 1);
+    occlusionSettings.lightDir = lightDirection;
+
+    cout << "Loading terrain occlusion..." << endl;
+    terrainOcclusion.loadOrBake(world, "terrain_occlusion.bin", occlusionSettings, jobSystem);
+    if (terrainOcclusion.getBakeSeconds() > 0)
+    {
+        cout << "Baked terrain occlusion (" << terrainOcclusion.getTexture().getWidth() << "x" << terrainOcclusion.getTexture().getHeight()
+            << ") in " << terrainOcclusion.getBakeSeconds() << " seconds on " << jobSystem.getThreadCount() << " threads." << endl;
+    }
 
-    cout << "Building far LOD terrain meshes..." << endl;
-    farLODCellManager.initializeForPosition(fpCamera.position);
+    if (useSceneObjects && !useClipmapTerrain && !useGPUTerrain)
+    {
+        setupSceneObjects();
+    }
 
-    cout << "Building terrain meshes..." << endl;
-    cellManager.initializeForPosition(fpCamera.position);
+    if (useClipmapTerrain)
+    {
+        cout << "Filling terrain clipmap..." << endl;
 
-    cout << "DONE!" << endl;
+        // The clipmap covers both the near and distant terrain; no cell meshes are needed.
+        clipmap.initializeForPosition(fpCamera.position);
+    }
+    else
+    {
+        initializeCellManagers();
+    }
 
     // Create the water plane
-    buildPlaneMesh(heightmap.getWidth() - 1, heightmap.getHeight() - 1, world.waterHeight, waterPlane);
+    buildPlaneMesh(heightmapSize.x - 1, heightmapSize.y - 1, world.waterHeight, waterPlane);
 
 
 
@@ -145,6 +388,7 @@ void ofApp::setup()
 
     // Set initial character position.
     character.setPosition(fpCamera.position);
+    prevCharacterPosition = fpCamera.position;
 
     // Set character movement parameters
     characterWalkSpeed = 10 * charHeight; // much faster than realism for efficiently moving around the map
@@ -168,10 +412,94 @@ void ofApp::setup()
     // load skybox mesh
     cubeMesh.load("models/cube.ply");
 
-    // load cubemap images
-    cubemap.load("textures/skybox_front.png", "textures/skybox_back.png", 
-        "textures/skybox_right.png", "textures/skybox_left.png", 
-        "textures/skybox_top.png", "textures/skybox_bottom.png");
+    // load the cubemap, preferring a precompressed, pre-mipmapped container over decoding the images
+    if (!cubemap.loadKTX("textures/skybox.ktx"))
+    {
+        cubemap.load("textures/skybox_front.png", "textures/skybox_back.png", 
+            "textures/skybox_right.png", "textures/skybox_left.png", 
+            "textures/skybox_top.png", "textures/skybox_bottom.png");
+    }
+
+    // The shaders have had all of the loading above to build; wait for them if they still aren't done.
+    collectShaders(true);
+
+    if (useSimulationThread)
+    {
+        startSimulationThread();
+    }
+}
+
+void ofApp::initializeCellManagers()
+{
+    // Make a copy of the world the uses the low-resolution heightmap.
+    farLODWorld = world;
+    farLODWorld.tiledHeightmap = nullptr;
+    farLODWorld.compressedHeightmap = nullptr;
+    farLODWorld.heightmap = &heightmapFarLOD.getPixels();
+
+    if (useCellMeshCache)
+    {
+        cout << "Opening terrain cell cache..." << endl;
+
+        // The cache is keyed by the terrain, so cells built from a different heightmap or scale are never reused.
+        cellMeshCache.open("cell_cache", world.computeTerrainHash(), 0);
+        cellManager.setMeshCache(&cellMeshCache);
+        farLODCellMeshCache.open("cell_cache", farLODWorld.computeTerrainHash(), 1);
+        farLODCellManager.setMeshCache(&farLODCellMeshCache);
+    }
+
+    // Build the far and near terrain meshes concurrently, reporting their combined progress every 10%.
+    unsigned int totalCells { 4 * (FAR_LOD_RANGE + 1) * (FAR_LOD_RANGE + 1) + (useGPUTerrain ? 0 : 4 * (NEAR_LOD_RANGE + 1) * (NEAR_LOD_RANGE + 1)) };
+    std::atomic<unsigned int> cellsBuilt { 0 };
+    std::atomic<unsigned int> reportedPercent { 0 };
+    auto reportProgress { [&](unsigned int, unsigned int)
+    {
+        unsigned int percent { 100 * ++cellsBuilt / totalCells };
+        unsigned int previousPercent { reportedPercent.load() };
+
+        // Only the thread that advances the reported percentage prints, so lines don't interleave.
+        if (percent / 10 > previousPercent / 10 && reportedPercent.compare_exchange_strong(previousPercent, percent))
+        {
+            cout << "Building terrain meshes... " << percent << "%" << endl;
+        }
+    } };
+
+    float buildStartTime { ofGetElapsedTimef() };
+    JobSystem::Job* buildJob { jobSystem.createJob({}) };
+    jobSystem.run(jobSystem.createJob([&]() { farLODCellManager.initializeForPosition(fpCamera.position, jobSystem, reportProgress); }, buildJob));
+    if (!useGPUTerrain)
+    {
+        jobSystem.run(jobSystem.createJob([&]() { cellManager.initializeForPosition(fpCamera.position, jobSystem, reportProgress); }, buildJob));
+    }
+
+    jobSystem.run(buildJob);
+    jobSystem.wait(buildJob);
+
+    if (useGPUTerrain)
+    {
+        // The near terrain needs no meshes; just upload the heightmap around the player.
+        gpuTerrain.initializeForPosition(fpCamera.position);
+
+        if (useTessellatedTerrain)
+        {
+            cout << "Tessellated terrain: " << gpuTerrain.getTessellationGeometryBytes() / 1024.0 << " KB of patches instead of "
+                << gpuTerrain.getGeometryBytes() / 1024.0 << " KB for the displaced patch." << endl;
+        }
+    }
+
+    cout << "DONE! Built " << totalCells << " terrain cells in " << ofGetElapsedTimef() - buildStartTime << " seconds." << endl;
+
+    if (heightmapStorage == HeightmapStorage::COMPRESSED)
+    {
+        // Compare the compressed heightmap to the raw layout.
+        uint64_t decodedTiles { compressedHeightmap.getDecodedTileCount() };
+        unsigned int cellCount { 4 * (NEAR_LOD_RANGE + 1) * (NEAR_LOD_RANGE + 1) };
+        cout << "Compressed heightmap: " << compressedHeightmap.getResidentBytes() / (1024.0 * 1024.0) << " MB resident vs. "
+            << compressedHeightmap.getRawBytes() / (1024.0 * 1024.0) << " MB raw; "
+            << compressedHeightmap.getConstantTileCount() << " constant tiles; "
+            << decodedTiles << " tiles decoded for the initial cells in " << compressedHeightmap.getDecodeSeconds() * 1000.0 << " ms ("
+            << compressedHeightmap.getDecodeSeconds() * 1.0e6 / cellCount << " us per cell)" << endl;
+    }
 }
 
 void ofApp::updateFPCamera(float dx, float dy)
@@ -200,10 +528,25 @@ void ofApp::updateFPCamera(float dx, float dy)
 //--------------------------------------------------------------
 void ofApp::update()
 {
+    // Collect the timings of an earlier frame and start timing this one.
+    profiler.beginFrame();
+    profiler.beginCPU("update");
+    TRACE_SCOPE("update", { { "frame", ofGetFrameNum() } });
+
     mat3 headRotationMatrix { rotate(headAngle, vec3(0, 1, 0)) };
 
     // Mouse / keyboard controls: set character velocity from WASD
-    character.setDesiredVelocity(headRotationMatrix * vec3(wasdVelocity.x, 0, -wasdVelocity.y));
+    vec3 desiredVelocity { headRotationMatrix * vec3(wasdVelocity.x, 0, -wasdVelocity.y) };
+    if (simulationThread.joinable())
+    {
+        // The simulation thread owns the character.
+        simulationVelocity.getWriteBuffer() = desiredVelocity;
+        simulationVelocity.publish();
+    }
+    else
+    {
+        character.setDesiredVelocity(desiredVelocity);
+    }
 
     if (prevMouseX != 0 && prevMouseY != 0) // Skip if the cursor position was uninitialized previously.
     {
@@ -214,37 +557,266 @@ void ofApp::update()
     prevMouseX = ofGetMouseX();
     prevMouseY = ofGetMouseY();
 
+    // Swap in the shaders once they've finished building in the background.
+    collectShaders(false);
+
     if (needsReload)
     {
         // Reload shaders if the hotkey was pressed.
         reloadShaders();
     }
-    
-    // Advance character physics.
-    character.update(ofGetLastFrameTime());
 
-    // Use new character position as the camera position.
-    fpCamera.position = character.getPosition();
+    // Upload the next mip levels of the terrain textures.
+    terrainDiffuse.update(TEXTURE_UPLOAD_BUDGET);
+    terrainNormal.update(TEXTURE_UPLOAD_BUDGET);
+
+    if (simulationThread.joinable())
+    {
+        // Upload the props the simulation thread has added or removed.
+        sceneObjects.uploadChanges();
+
+        // Draw the newest packet the simulation thread has published.
+        if (framePackets.acquire())
+        {
+            renderFrame = framePackets.getReadBuffer().frame;
+        }
+
+        renderPacket = &framePackets.getReadBuffer();
+
+        // Carry the interpolation between the last two physics steps on from the end of the tick, so the camera moves smoothly
+        // whatever the frame rate, stopping at the newest step.
+        float ticksElapsed { std::chrono::duration<float>(std::chrono::steady_clock::now() - renderPacket->time).count() * PHYSICS_RATE };
+        float alpha { glm::min(renderPacket->interpolationAlpha + ticksElapsed, 1.0f) };
+        fpCamera.position = mix(renderPacket->prevCharacterPosition, renderPacket->characterPosition, alpha);
+    }
+    else
+    {
+        renderPacket = nullptr;
+
+        // Advance character physics in fixed steps, however long the last frame took.
+        stepPhysics(ofGetLastFrameTime());
+
+        // Add and remove the props for cells that were built or evicted since the last frame.
+        sceneObjects.update();
+
+        // Use the character position, interpolated between the last two physics steps, as the camera position.
+        fpCamera.position = mix(prevCharacterPosition, character.getPosition(), physicsTimestep.getInterpolationAlpha());
+    }
+
+    if (useClipmapTerrain)
+    {
+        // Rewrite the strips of each clipmap level that have come into range; there are no cells to stream.
+        clipmap.optimizeForPosition(fpCamera.position);
+        profiler.endCPU();
+        return;
+    }
+
+    // This only times checking which cells are needed and handing them to the job system; the builds themselves are timed below.
+    profiler.beginCPU("cell streaming dispatch");
+
+    if (useGPUTerrain)
+    {
+        // Only the heightmap texture moves; there are no near meshes to build.  The upload needs the GL context, so it's always done here.
+        gpuTerrain.optimizeForPosition(fpCamera.position);
+    }
+
+    if (!simulationThread.joinable())
+    {
+        // Far cells cover much more ground each, so they only need to be checked every few frames.
+        streamCells(fpCamera.position, ofGetFrameNum() % FAR_LOD_UPDATE_INTERVAL == 0);
+    }
+
+    profiler.endCPU();
+
+    // The cells are built on the job threads (and the simulation thread, if it's running), so add up the time they took
+    // since the last frame; this can be more than a frame's worth of time, since several cells are built at once.
+    profiler.addCPU("cell builds (all threads)", cellManager.takeBuildMilliseconds() + farLODCellManager.takeBuildMilliseconds());
+
+    profiler.endCPU();
+}
+
+void ofApp::stepPhysics(float elapsedTime)
+{
+    unsigned int physicsSteps { physicsTimestep.advance(elapsedTime) };
+    for (unsigned int i { 0 }; i < physicsSteps; i++)
+    {
+        if (jumpRequested.exchange(false))
+        {
+            character.jump(characterJumpSpeed);
+        }
+
+        prevCharacterPosition = character.getPosition();
+        character.update(physicsTimestep.getStepDuration());
+        character.resolveCollisions(sceneObjects.getObstacles());
+    }
+}
+
+void ofApp::streamCells(vec3 position, bool includeFarCells, uint64_t frame, uint64_t oldestFrameInUse)
+{
+    // Stream cells in the background.  Near and far cells share a budget of builds in flight, and near cells claim it first,
+    // so far-cell streaming never holds up the near cells.
+    unsigned int cellBuildBudget { MAX_CELL_BUILDS_IN_FLIGHT };
+    cellBuildBudget -= std::min(cellBuildBudget, cellManager.getPendingCellCount() + farLODCellManager.getPendingCellCount());
+
+    if (!useGPUTerrain)
+    {
+        cellManager.optimizeForPosition(position);
+        cellManager.processLoadQueue(jobSystem, cellBuildBudget, frame, oldestFrameInUse);
+    }
+
+    if (includeFarCells)
+    {
+        farLODCellManager.optimizeForPosition(position);
+        farLODCellManager.processLoadQueue(jobSystem, cellBuildBudget, frame, oldestFrameInUse);
+    }
+}
+
+void ofApp::calcLODPlanes(vec3 position, float& midLODPlane, float& farPlaneDistant) const
+{
+    float heightAboveTerrain { position.y - world.getTerrainHeightAtPosition(position) };
+
+    // Calculate an appropriate distance for a plane conceptually dividing the high level-of-detail close terrain and the lower level-of-detail distant terrain (or fog with no distant terrain).
+    midLODPlane = length(vec2(0.5f * NEAR_LOD_SIZE * NEAR_LOD_RANGE, heightAboveTerrain));
+
+    // Calculate an appropriate far plane for the distant terrain (the edge of the clipmap, if using one).
+    farPlaneDistant = length(vec2(
+        useClipmapTerrain ? clipmap.getExtent() : FAR_LOD_SIZE * FAR_LOD_RANGE * world.getHeightmapSize().y / FAR_LOD_RESOLUTION,
+        heightAboveTerrain));
+}
+
+void ofApp::simulationTick(float elapsedTime)
+{
+    TRACE_SCOPE("simulationTick", { { "frame", simulationFrame } });
+
+    simulationVelocity.acquire();
+    character.setDesiredVelocity(simulationVelocity.getReadBuffer());
+
+    stepPhysics(elapsedTime);
+
+    // Add and remove the props for cells that were built or evicted since the last tick; the render thread uploads them.
+    sceneObjects.applyChanges();
+
+    simulationFrame++;
+
+    FramePacket& packet { framePackets.getWriteBuffer() };
+    packet.frame = simulationFrame;
+    packet.prevCharacterPosition = prevCharacterPosition;
+    packet.characterPosition = character.getPosition();
+    packet.interpolationAlpha = physicsTimestep.getInterpolationAlpha();
+    packet.time = std::chrono::steady_clock::now();
+
+    vec3 position { mix(packet.prevCharacterPosition, packet.characterPosition, packet.interpolationAlpha) };
+
+    // Stream and cull the cells around the camera.  Cells are only rebuilt once the render thread has moved past every packet that might contain them.
+    calcLODPlanes(position, packet.midLODPlane, packet.farPlaneDistant);
+    packet.nearVisibleCells.clear();
+    packet.farVisibleCells.clear();
+
+    if (!useClipmapTerrain)
+    {
+        streamCells(position, simulationFrame % FAR_LOD_UPDATE_INTERVAL == 0, simulationFrame, renderFrame);
+        cellManager.gatherVisibleCells(position, packet.midLODPlane, packet.nearVisibleCells);
+        farLODCellManager.gatherVisibleCells(position, packet.farPlaneDistant, packet.farVisibleCells);
+    }
 
-    // Load new cells if necessary:
-    cellManager.optimizeForPosition(fpCamera.position);
-    cellManager.processLoadQueue();
+    framePackets.publish();
+}
+
+void ofApp::startSimulationThread()
+{
+    if (simulationThread.joinable())
+    {
+        return;
+    }
+
+    // Run the first tick here, so that there's a packet to draw straight away.
+    simulationVelocity.getWriteBuffer() = mat3(rotate(headAngle, vec3(0, 1, 0))) * vec3(wasdVelocity.x, 0, -wasdVelocity.y);
+    simulationVelocity.publish();
+    simulationTick(0);
+
+    stopSimulation = false;
+    simulationThread = std::thread { [this]()
+    {
+        // The simulation thread starts cell builds, so it needs a slot in the job system.
+        bool attached { jobSystem.attachThread() };
+        assert(attached);
+        Tracer::setThreadName("simulation");
+
+        std::chrono::microseconds tickDuration { 1000000 / PHYSICS_RATE };
+        std::chrono::steady_clock::time_point lastTickStart { std::chrono::steady_clock::now() };
+
+        while (!stopSimulation)
+        {
+            // Tick once per physics step, sleeping off whatever is left of the step.  A slow tick just runs more physics steps in the next one.
+            std::chrono::steady_clock::time_point tickStart { std::chrono::steady_clock::now() };
+            simulationTick(std::chrono::duration<float>(tickStart - lastTickStart).count());
+            lastTickStart = tickStart;
+
+            simulationMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - tickStart).count();
+            std::this_thread::sleep_until(tickStart + tickDuration);
+        }
+
+        if (attached)
+        {
+            jobSystem.detachThread();
+        }
+    } };
+}
+
+void ofApp::stopSimulationThread()
+{
+    if (simulationThread.joinable())
+    {
+        stopSimulation = true;
+        simulationThread.join();
+        renderPacket = nullptr;
+    }
 }
 
 //--------------------------------------------------------------
 void ofApp::draw()
 {
+    profiler.beginCPU("draw");
+    TRACE_SCOPE("draw", { { "frame", ofGetFrameNum() } });
+
+    // Pick up last frame's overdraw count, if it's ready.
+    readOverdrawQuery();
+
+    // Draw the scene offscreen at a resolution that keeps the GPU within its frame-time target; everything below sees the scaled viewport.
+    if (useDynamicResolution)
+    {
+        dynamicResolution.begin();
+    }
+
     float aspect { static_cast<float>(ofGetViewportWidth()) / static_cast<float>(ofGetViewportHeight()) };
 
-    // Calculate an appropriate distance for a plane conceptually dividing the high level-of-detail close terrain and the lower level-of-detail distant terrain (or fog with no distant terrain).
-    float midLODPlane { length(vec2(
-        0.5f * NEAR_LOD_SIZE * NEAR_LOD_RANGE,
-        fpCamera.position.y - world.getTerrainHeightAtPosition(fpCamera.position))) };
+    float midLODPlane { 0 };
+    float farPlaneDistant { 0 };
+    const std::vector<Cell*>* nearCells { &nearVisibleCells };
+    const std::vector<Cell*>* farCells { &farVisibleCells };
 
-    // Calculate an appropriate far plane for the distant terrain.
-    float farPlaneDistant { length(vec2(
-        FAR_LOD_SIZE * FAR_LOD_RANGE * heightmap.getHeight() / FAR_LOD_RESOLUTION,
-        fpCamera.position.y - world.getTerrainHeightAtPosition(fpCamera.position))) };
+    JobSystem::Job* cullJob { jobSystem.createJob({}) };
+    if (renderPacket)
+    {
+        // The simulation thread has already culled the cells.
+        midLODPlane = renderPacket->midLODPlane;
+        farPlaneDistant = renderPacket->farPlaneDistant;
+        nearCells = &renderPacket->nearVisibleCells;
+        farCells = &renderPacket->farVisibleCells;
+    }
+    else
+    {
+        calcLODPlanes(fpCamera.position, midLODPlane, farPlaneDistant);
+
+        // Find the visible near and far cells in the background while the skybox is drawn.
+        if (!useClipmapTerrain)
+        {
+            jobSystem.run(jobSystem.createJob([&]() { cellManager.gatherVisibleCells(fpCamera.position, midLODPlane, nearVisibleCells); }, cullJob));
+            jobSystem.run(jobSystem.createJob([&]() { farLODCellManager.gatherVisibleCells(fpCamera.position, farPlaneDistant, farVisibleCells); }, cullJob));
+        }
+    }
+
+    jobSystem.run(cullJob);
 
     // Calculate view and projection matrices for the distant terrain.
     // Set the clipping plane to be 25% of the dividing plane to allow for sufficient overlap for a smooth transition.
@@ -253,49 +825,83 @@ void ofApp::draw()
     float nearPlane = -world.gravity * 0.01f;
 
     CameraMatrices camNearMatrices{ fpCamera, aspect, nearPlane, midLODPlane };
-    mat4 modelView{ camNearMatrices.getView() };
-    mat4 mvp{ camNearMatrices.getProj() * camNearMatrices.getView() };
     // Disable depth clamping for distant terrain
     glDisable(GL_DEPTH_CLAMP);
 
-    drawCube(camFarMatrices);
+    // The skybox, distant terrain and distant water all use the far camera and fade.
+    shaderUniforms.setCamera(camFarMatrices);
+    shaderUniforms.setFade(farPlaneDistant * 0.95f, farPlaneDistant * 1.0f);
 
+    profiler.beginGPU("skybox");
+    drawCube(camFarMatrices);
+    profiler.endGPU();
 
-    // Distant terrain
-    terrainShader.begin();
-    terrainShader.setUniform1f("startFade", farPlaneDistant * 0.95f);
-    terrainShader.setUniform1f("endFade", farPlaneDistant * 1.0f);
-    terrainShader.setUniformMatrix4f("modelView", camFarMatrices.getView());
-    terrainShader.setUniformMatrix4f("mvp", camFarMatrices.getProj()* camFarMatrices.getView());
-    terrainShader.setUniformTexture("diffuseTex", terrainDiffuse, 0);
-    terrainShader.setUniformTexture("normalTex", terrainNormal, 1);
-
-    // Draw the distant terrain cells.
-    farLODCellManager.drawActiveCells(fpCamera.position, farPlaneDistant);
-
+    // Draw the distant terrain once culling has finished.
+    jobSystem.wait(cullJob);
 
-    
-    terrainShader.end();
-
-    // Enable depth clamping for water to cover up distant terrain regardless of depth values.
-    // It seems that depth clamping can be left on for near terrain without any undesired effects.
-    glEnable(GL_DEPTH_CLAMP);
+    if (useOcclusionCulling && !useClipmapTerrain && !useGPUTerrain)
+    {
+        // Drop the cells hidden behind the nearest hills.  The planes don't affect the screen position or w, so the far camera will do.
+        profiler.beginCPU("occlusion culling");
+        mat4 viewProjection { camFarMatrices.getProj() * camFarMatrices.getView() };
+        occlusionCuller.renderOccluders(viewProjection, *nearCells, MAX_OCCLUDER_CELLS, jobSystem);
+        occlusionCuller.cullCells(*nearCells, unoccludedNearCells, jobSystem);
+        nearCells = &unoccludedNearCells;
+
+        // The far impostor captures all six directions from the far cells, so it needs every one of them, not just those
+        // visible from the current view.
+        if (!useFarImpostor)
+        {
+            occlusionCuller.cullCells(*farCells, unoccludedFarCells, jobSystem);
+            farCells = &unoccludedFarCells;
+        }
+        profiler.endCPU();
+    }
 
-    // Distant water
-    waterShader.begin();
-    waterShader.setUniform3f("meshColor", vec3(0.64, 0.73, 0.81));
-    waterShader.setUniform1f("startFade", farPlaneDistant * 0.95f);
-    waterShader.setUniform1f("endFade", farPlaneDistant * 1.0f);
-    //waterShader.setUniformMatrix4f("modelView", camFarMatrices.getView());
-    waterShader.setUniformMatrix4f("mvp", camFarMatrices.getProj()* camFarMatrices.getView());
+    // Recapture the far impostor once everything that was streaming in has arrived, so that it doesn't keep any gaps or blurry textures.
+    bool farInputsLoading { farLODCellManager.getPendingCellCount() > 0 || !terrainDiffuse.isComplete() || !terrainNormal.isComplete() };
+    if (farImpostorInputsLoading && !farInputsLoading)
+    {
+        farImpostor.invalidate();
+    }
 
-    // Draw the water plane.
-    waterPlane.draw();
+    farImpostorInputsLoading = farInputsLoading;
 
-    waterShader.end();
+    if (useFarImpostor)
+    {
+        // Render the next faces of the impostor, if it's due for a new capture, then draw it in place of the distant terrain and water.
+        profiler.beginGPU("far impostor");
+        farImpostor.renderFaces(fpCamera.position, midLODPlane * 0.25f, farPlaneDistant, [&](const CameraMatrices& faceMatrices)
+        {
+            shaderUniforms.setCamera(faceMatrices);
+            drawFarTerrain(*farCells, midLODPlane * 0.25f, farPlaneDistant);
+            drawFarWater();
+        });
+
+        shaderUniforms.setCamera(camFarMatrices);
+        farImpostor.draw(farImpostorShader, cubeMesh, fpCamera.position);
+        profiler.endGPU();
+
+        // Leave depth clamping on for the near terrain, as the far water would have.
+        glEnable(GL_DEPTH_CLAMP);
+    }
+    else
+    {
+        // Distant terrain
+        profiler.beginGPU("far terrain");
+        drawFarTerrain(*farCells, midLODPlane * 0.25f, farPlaneDistant);
+        profiler.endGPU();
+
+        // Distant water
+        profiler.beginGPU("far water");
+        drawFarWater();
+        profiler.endGPU();
+    }
 
     // Clear depth buffer as our clipping planes have changed
+    profiler.beginGPU("depth clear");
     glClear(GL_DEPTH_BUFFER_BIT);
+    profiler.endGPU();
 
     ; // Define near plane relative to world gravity (which is also proportional to player character height)
 
@@ -312,53 +918,226 @@ void ofApp::draw()
 
 
     // Near terrain
-    terrainShader.begin();
-    terrainShader.setUniform1f("startFade", midLODPlane * 0.75f);
-    terrainShader.setUniform1f("endFade", midLODPlane);
-    //terrainShader.setUniformMatrix4f("modelView", modelView);
-    terrainShader.setUniformMatrix4f("mvp", mvp);
-    terrainShader.setUniformTexture("diffuseTex", terrainDiffuse, 0);
-    terrainShader.setUniformTexture("normalTex", terrainNormal, 1);
+    bool tessellateNearTerrain { useTessellatedTerrain && tessellationAvailable };
+    ShaderProgram& nearTerrainShader { useClipmapTerrain ? terrainClipmapShader
+        : tessellateNearTerrain ? terrainTessShader : useGPUTerrain ? terrainGPUShader : terrainShader };
+    const TerrainUniforms& nearTerrainUniforms { useClipmapTerrain ? terrainClipmapUniforms
+        : tessellateNearTerrain ? terrainTessUniforms : useGPUTerrain ? terrainGPUUniforms : terrainUniforms };
+    // Everything from here on uses the near camera and fade.
+    shaderUniforms.setCamera(camNearMatrices);
+    shaderUniforms.setFade(midLODPlane * 0.75f, midLODPlane);
+
+    // The near terrain's time includes the depth pre-pass, if any.
+    profiler.beginGPU("near terrain");
+
+    // The pre-pass only covers the cells and the displaced patches, which have depth-only versions of their shaders.
+    bool depthPrePass { useDepthPrePass && !useClipmapTerrain && !tessellateNearTerrain };
+    if (depthPrePass)
+    {
+        // Lay down the near terrain's depth without any color, so that the shaded pass only runs terrain.frag for the visible fragments.
+        ShaderProgram& depthShader { useGPUTerrain ? terrainGPUDepthShader : terrainDepthShader };
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        depthShader.begin();
+
+        if (useGPUTerrain)
+        {
+            gpuTerrain.draw(depthShader, 2);
+        }
+        else
+        {
+            cellManager.drawCells(*nearCells);
+        }
+
+        depthShader.end();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+        // The depth is already final; the shaded pass only needs to match it.
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+    }
 
-    // Draw the high level-of-detail cells.
-    cellManager.drawActiveCells(fpCamera.position, midLODPlane);
+    // Count the near terrain's shaded fragments, unless the last count hasn't come back from the GPU yet.
+    bool countOverdraw { measureOverdraw && !overdrawQueryPending };
+    if (countOverdraw)
+    {
+        if (overdrawQuery == 0)
+        {
+            glGenQueries(1, &overdrawQuery);
+        }
+
+        glBeginQuery(GL_SAMPLES_PASSED, overdrawQuery);
+
+        // Remember the resolution the fragments are counted at, for when the result is read.
+        uvec2 renderSize { useDynamicResolution ? dynamicResolution.getRenderSize() : uvec2(ofGetWidth(), ofGetHeight()) };
+        overdrawQueryPixels = static_cast<uint64_t>(renderSize.x) * renderSize.y;
+    }
+
+    nearTerrainShader.begin();
+    setTerrainMaterial(nearTerrainShader, nearTerrainUniforms, world.getHeightmapSize());
+
+    if (useClipmapTerrain)
+    {
+        // Only the clipmap levels within the near terrain's range.
+        clipmap.draw(terrainClipmapShader, 2, 0, midLODPlane);
+    }
+    else if (tessellateNearTerrain)
+    {
+        // Split the coarse patches for every cell around the player so that triangles are about the same size on screen.
+        nearTerrainShader.setUniform1f(nearTerrainUniforms.pixelsPerUnit, 0.5f * ofGetViewportHeight() * camNearMatrices.getProj()[1][1]);
+        gpuTerrain.drawTessellated(terrainTessShader, 2, TESSELLATION_TRIANGLE_SIZE);
+    }
+    else if (useGPUTerrain)
+    {
+        // Draw the displaced patch for every cell around the player.
+        gpuTerrain.draw(terrainGPUShader, 2);
+    }
+    else
+    {
+        // Draw the high level-of-detail cells.
+        cellManager.drawCells(*nearCells);
+    }
 
     //calcTangents(cellManager.);
 
     // Alternatively, draw the static terrain mesh if not using a cell manager.
     //staticTerrain.draw();
 
-    terrainShader.end();
+    nearTerrainShader.end();
+
+    if (countOverdraw)
+    {
+        glEndQuery(GL_SAMPLES_PASSED);
+        overdrawQueryPending = true;
+    }
+
+    if (depthPrePass)
+    {
+        glDepthFunc(GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+
+    profiler.endGPU();
 
     // Near water
+    profiler.beginGPU("near water");
     waterShader.begin();
-    waterShader.setUniform3f("meshColor", vec3(0.64, 0.73, 0.81));
-    waterShader.setUniform1f("startFade", midLODPlane * 0.75f);
-    waterShader.setUniform1f("endFade", midLODPlane);
-    waterShader.setUniformMatrix4f("modelView", modelView);
-    waterShader.setUniformMatrix4f("mvp", mvp);
 
     // Draw the water plane.
     waterPlane.draw();
 
     waterShader.end();
+    profiler.endGPU();
 
+    profiler.beginGPU("sword");
     shader.begin();
     swordMesh.draw();
     shader.end();
+    profiler.endGPU();
 
-    
+    // Props, one instanced draw per model, using the near camera.
+    profiler.beginGPU("props");
+    if (sceneObjects.getInstanceCount() > 0)
+    {
+        instancedShader.begin();
+        sceneObjects.draw(instancedShader, 0);
+        instancedShader.end();
+    }
+
+    profiler.endGPU();
+
+    if (useDynamicResolution)
+    {
+        // Stretch the scene over the window.
+        dynamicResolution.end();
+    }
+
+    profiler.endCPU();
+
+    if (profiler.isEnabled())
+    {
+        std::ostringstream stats {};
+        stats << std::fixed << std::setprecision(2);
+        if (useDynamicResolution)
+        {
+            uvec2 renderSize { dynamicResolution.getRenderSize() };
+            stats << "Resolution scale: " << dynamicResolution.getScale() << " (" << renderSize.x << "x" << renderSize.y << ", GPU "
+                << dynamicResolution.getGPUMilliseconds() << " ms)" << endl;
+        }
+
+        if (useOcclusionCulling)
+        {
+            const OcclusionCuller::Stats& cullStats { occlusionCuller.getStats() };
+            stats << "Occlusion culling: " << cullStats.occludedCells << " of " << cullStats.testedCells << " cells hidden ("
+                << cullStats.offscreenCells << " offscreen), " << cullStats.occluderTriangles << " occluder triangles, "
+                << cullStats.milliseconds << " ms" << endl;
+        }
+
+        if (simulationThread.joinable())
+        {
+            stats << "Simulation tick: " << simulationMilliseconds.load() << " ms (packet " << renderFrame.load() << ")" << endl;
+        }
+
+        // The overlay is flat text on top of everything, at the window's full resolution.
+        ofDisableDepthTest();
+        glDisable(GL_CULL_FACE);
+        profiler.drawOverlay(10, 20, stats.str());
+        glEnable(GL_CULL_FACE);
+        ofEnableDepthTest();
+    }
+
+    if (!firstFrameDrawn)
+    {
+        // Report how long it took from launching the application to the first frame being drawn.
+        cout << "Time to first frame: " << ofGetElapsedTimef() << " seconds." << endl;
+        firstFrameDrawn = true;
+    }
+}
+
+void ofApp::drawFarTerrain(const std::vector<Cell*>& farCells, float nearPlane, float farPlane)
+{
+    // Disable depth clamping for distant terrain
+    glDisable(GL_DEPTH_CLAMP);
+
+    ShaderProgram& farTerrainShader { useClipmapTerrain ? terrainClipmapShader : terrainShader };
+    farTerrainShader.begin();
+    setTerrainMaterial(farTerrainShader, useClipmapTerrain ? terrainClipmapUniforms : terrainUniforms,
+        (useClipmapTerrain ? world : farLODWorld).getHeightmapSize());
+
+    if (useClipmapTerrain)
+    {
+        // Only the clipmap levels beyond the near clipping plane.
+        clipmap.draw(terrainClipmapShader, 2, nearPlane, farPlane);
+    }
+    else
+    {
+        farLODCellManager.drawCells(farCells);
+    }
+
+    farTerrainShader.end();
+}
+
+void ofApp::drawFarWater()
+{
+    // Enable depth clamping for water to cover up distant terrain regardless of depth values.
+    // It seems that depth clamping can be left on for near terrain without any undesired effects.
+    glEnable(GL_DEPTH_CLAMP);
+
+    waterShader.begin();
+
+    // Draw the water plane.
+    waterPlane.draw();
+
+    waterShader.end();
 }
 
 void ofApp::drawCube(const CameraMatrices& camMatrices)
 {
     mat4 model{ translate(camMatrices.getCamera().position) };
 
+    // The skybox takes its matrices from the camera block, which should already hold these matrices.
     glDisable(GL_CULL_FACE);
     skyboxShader.begin();
     glDepthFunc(GL_LEQUAL);// pass depth cest at far clipping plane
-    skyboxShader.setUniformMatrix4f("mvp", 
-        camMatrices.getProj() * mat4(mat3(camMatrices.getView())));
     skyboxShader.setUniformTexture("cubemap", cubemap.getTexture(), 0);
     cubeMesh.draw();
     skyboxShader.end();
@@ -366,8 +1145,139 @@ void ofApp::drawCube(const CameraMatrices& camMatrices)
     glEnable(GL_CULL_FACE);
 }
 
+void ofApp::setupSceneObjects()
+{
+    cout << "Loading props..." << endl;
+
+    propTex.load("textures/sword_color.png");
+    propTex.getTexture().setTextureWrap(GL_REPEAT, GL_REPEAT);
+    propTex.getTexture().generateMipmap();
+    propTex.getTexture().setTextureMinMagFilter(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+
+    // Size the props relative to the character (whose height is defined relative to gravity).
+    float propScale { -world.gravity * 0.1685f };
+
+    // Swords lying in the grass; too flat to get in the way.
+    ofMesh swordPropMesh {};
+    swordPropMesh.load("models/sword.ply");
+    SceneObjects::ScatterSettings swordSettings {};
+    swordSettings.instancesPerCell = 8;
+    swordSettings.minScale = 0.75f * propScale;
+    swordSettings.maxScale = 1.25f * propScale;
+    sceneObjects.addModel(swordPropMesh, propTex.getTexture(), swordSettings);
+
+    // Rocks (half-buried cubes) that characters walk around.
+    ofMesh rockMesh {};
+    rockMesh.load("models/cube.ply");
+    SceneObjects::ScatterSettings rockSettings {};
+    rockSettings.instancesPerCell = 24;
+    rockSettings.minScale = 0.25f * propScale;
+    rockSettings.maxScale = propScale;
+    rockSettings.obstacleRadius = 1.0f;
+    rockSettings.obstacleHeight = 1.0f;
+    sceneObjects.addModel(rockMesh, terrainDiffuse.getTexture(), rockSettings);
+
+    // Upright rings marking points of interest.
+    ofMesh markerMesh {};
+    markerMesh.load("models/torus.ply");
+    SceneObjects::ScatterSettings markerSettings {};
+    markerSettings.instancesPerCell = 2;
+    markerSettings.minScale = propScale;
+    markerSettings.maxScale = 1.5f * propScale;
+    sceneObjects.addModel(markerMesh, propTex.getTexture(), markerSettings);
+
+    // Props come and go with the near cells.
+    cellManager.setCellCallbacks(
+        [this](vec2 cellStartPos, vec2 cellSize) { sceneObjects.loadCell(cellStartPos, cellSize); },
+        [this](vec2 cellStartPos, vec2 cellSize) { sceneObjects.unloadCell(cellStartPos, cellSize); });
+}
+
+void ofApp::runBenchmarks()
+{
+    // Use terrain cells as broadphase cells.
+    float broadphaseCellSize { cellManager.getScaledCellSize().x };
+    benchmarkAgentSystem(world, jobSystem, character.getCharacterHeight(), broadphaseCellSize);
+    benchmarkBroadphase(character.getCharacterHeight(), broadphaseCellSize);
+    benchmarkJobSystemScaling(world, character.getCharacterHeight(), broadphaseCellSize);
+
+    // Compare CPU-meshed and GPU-displaced terrain for the near cells, using the current view.
+    CameraMatrices camMatrices { fpCamera, static_cast<float>(ofGetViewportWidth()) / static_cast<float>(ofGetViewportHeight()),
+        -world.gravity * 0.01f, world.dimensions.x };
+    shaderUniforms.setCamera(camMatrices);
+    terrainShader.begin();
+    setTerrainMaterial(terrainShader, terrainUniforms, world.getHeightmapSize());
+    terrainShader.end();
+
+    terrainGPUShader.begin();
+    setTerrainMaterial(terrainGPUShader, terrainGPUUniforms, world.getHeightmapSize());
+    terrainGPUShader.end();
+
+    benchmarkTerrainRendering(world, jobSystem, fpCamera.position, NEAR_LOD_SIZE, NEAR_LOD_RANGE + 1, terrainShader, terrainGPUShader);
+}
+
+void ofApp::readOverdrawQuery()
+{
+    if (!overdrawQueryPending)
+    {
+        return;
+    }
+
+    GLuint available { 0 };
+    glGetQueryObjectuiv(overdrawQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        return;
+    }
+
+    GLuint64 samples { 0 };
+    glGetQueryObjectui64v(overdrawQuery, GL_QUERY_RESULT, &samples);
+    overdrawQueryPending = false;
+    overdrawSamples += samples;
+    overdrawPixels += overdrawQueryPixels;
+    overdrawFrames++;
+
+    float now { ofGetElapsedTimef() };
+    if (now - lastOverdrawReportTime >= 1.0f)
+    {
+        // Fragments that passed the depth test per pixel rendered; about 1 with the depth pre-pass (less where there's sky or water).
+        cout << "Near terrain overdraw: " << overdrawSamples / std::max(1.0, static_cast<double>(overdrawPixels))
+            << " shaded fragments per pixel (depth pre-pass " << (useDepthPrePass ? "on" : "off") << ")" << endl;
+
+        overdrawSamples = 0;
+        overdrawPixels = 0;
+        overdrawFrames = 0;
+        lastOverdrawReportTime = now;
+    }
+}
+
+void ofApp::writeTrace()
+{
+    if (Tracer::writeJSON(TRACE_FILE))
+    {
+        cout << "Trace written to " << TRACE_FILE << " (open it in Perfetto or chrome://tracing)" << endl;
+    }
+}
+
 void ofApp::exit()
 {
+    // Stop starting new cells, then let any cells still streaming in finish before the cell managers are destroyed.
+    stopSimulationThread();
+    jobSystem.waitForIdle();
+
+    if (overdrawQuery != 0)
+    {
+        glDeleteQueries(1, &overdrawQuery);
+    }
+
+    if (Tracer::isEnabled())
+    {
+        writeTrace();
+    }
+
+    profiler.clear();
+    dynamicResolution.clear();
+    farImpostor.clear();
+    shaderCompiler.close();
 }
 
 //--------------------------------------------------------------
@@ -392,7 +1302,7 @@ void ofApp::keyPressed(int key)
     }
     else if (key == ' ')
     {
-        character.jump(characterJumpSpeed);
+        jumpRequested = true;
     }
 }
 
@@ -404,6 +1314,82 @@ void ofApp::keyReleased(int key)
         // Reload shaders
         needsReload = true;
     }
+    else if (key == 'b')
+    {
+        // Run benchmarks
+        runBenchmarks();
+    }
+    else if (key == 'p')
+    {
+        // Toggle the near terrain's depth pre-pass
+        useDepthPrePass = !useDepthPrePass;
+        cout << "Depth pre-pass " << (useDepthPrePass ? "on" : "off") << endl;
+    }
+    else if (key == 't')
+    {
+        // Toggle the profiler overlay, logging every frame's timings while it's on
+        profiler.setEnabled(!profiler.isEnabled());
+        if (profiler.isEnabled())
+        {
+            profiler.openCSV("profile.csv");
+        }
+    }
+    else if (key == 'r')
+    {
+        // Toggle dynamic resolution
+        useDynamicResolution = !useDynamicResolution;
+        cout << "Dynamic resolution " << (useDynamicResolution ? "on" : "off") << endl;
+    }
+    else if (key == 'i')
+    {
+        // Toggle drawing the distant terrain as an impostor
+        useFarImpostor = !useFarImpostor;
+        cout << "Far impostor " << (useFarImpostor ? "on" : "off") << endl;
+    }
+    else if (key == 'x')
+    {
+        // Toggle tracing, writing the timeline out when it's turned off
+        if (Tracer::isEnabled())
+        {
+            writeTrace();
+            Tracer::setEnabled(false);
+        }
+        else
+        {
+            Tracer::setEnabled(true);
+            cout << "Tracing on" << endl;
+        }
+    }
+    else if (key == 'c')
+    {
+        // Toggle occlusion culling of the terrain cells
+        useOcclusionCulling = !useOcclusionCulling;
+        cout << "Occlusion culling " << (useOcclusionCulling ? "on" : "off") << endl;
+    }
+    else if (key == 'm')
+    {
+        // Toggle running the simulation on a thread of its own
+        useSimulationThread = !useSimulationThread;
+        if (useSimulationThread)
+        {
+            startSimulationThread();
+        }
+        else
+        {
+            stopSimulationThread();
+        }
+
+        cout << "Simulation thread " << (useSimulationThread ? "on" : "off") << endl;
+    }
+    else if (key == 'o')
+    {
+        // Toggle the overdraw counter, starting a fresh average
+        measureOverdraw = !measureOverdraw;
+        overdrawSamples = 0;
+        overdrawPixels = 0;
+        overdrawFrames = 0;
+        lastOverdrawReportTime = ofGetElapsedTimef();
+    }
     else if (key == 'a') // Update the local character velocity when a WASD key is pressed.
     {
         wasdVelocity.x = 0.0f;
@@ -2,9 +2,28 @@
 
 #include "ofMain.h"
 #include "World.h"
+#include "TiledHeightmap.h"
+#include "CompressedHeightmap.h"
 #include "CellManager.h"
+#include "CellMeshCache.h"
 #include "Camera.h"
 #include "CharacterPhysics.h"
+#include "FixedTimestep.h"
+#include "JobSystem.h"
+#include "GPUTerrain.h"
+#include "GeometryClipmap.h"
+#include "SceneObjects.h"
+#include "ShaderUniforms.h"
+#include "ShaderProgram.h"
+#include "StreamedTexture.h"
+#include "TerrainOcclusion.h"
+#include "Profiler.h"
+#include "ShaderCompiler.h"
+#include "DynamicResolution.h"
+#include "TripleBuffer.h"
+#include "FarImpostor.h"
+#include "OcclusionCuller.h"
+#include "Tracer.h"
 #include "CameraMatrices.h"
 #include "ofxCubemap.h"
 
@@ -35,9 +54,9 @@ private:
 
     ofImage swordTex;
 
-    ofShader shader;
+    ShaderProgram shader;
 
-    ofShader skyboxShader;
+    ShaderProgram skyboxShader;
 
     // mesh for skybox
     ofMesh cubeMesh;
@@ -61,27 +80,196 @@ private:
     // Non-GPU image containing the heightmap.
     ofShortImage heightmap {};
 
+    // The ways the heightmap can be stored.
+    enum class HeightmapStorage
+    {
+        // The whole heightmap image is kept in memory as raw 16-bit samples.
+        RAW,
+
+        // The heightmap is paged in from tiles on disk; the tiles are generated from the heightmap image the first time the application runs.
+        TILED,
+
+        // The whole heightmap is kept in memory as compressed tiles that are decompressed on demand.
+        COMPRESSED
+    };
+
+    // How the heightmap is stored.
+    HeightmapStorage heightmapStorage { HeightmapStorage::TILED };
+
+    // The size (in pixels) of each heightmap tile.
+    const static unsigned int HEIGHTMAP_TILE_SIZE { 512 };
+
+    // The maximum number of bytes of heightmap tiles to keep in memory at once.
+    const static size_t HEIGHTMAP_MEMORY_BUDGET { 64 * 1024 * 1024 };
+
+    // The heightmap paged in from tiles on disk, if using tiled storage.
+    TiledHeightmap tiledHeightmap {};
+
+    // The size (in pixels) of each compressed heightmap tile.
+    const static unsigned int COMPRESSED_TILE_SIZE { 64 };
+
+    // The heightmap compressed in memory, if using compressed storage.
+    CompressedHeightmap compressedHeightmap {};
+
     // Plane mesh for rendering water.
     ofMesh waterPlane {};
 
     // Shader for rendering terrain.
-    ofShader terrainShader {};
+    ShaderProgram terrainShader {};
+
+    // Shader for rendering terrain by displacing a flat patch with the heightmap (see GPUTerrain).
+    ShaderProgram terrainGPUShader {};
+
+    // Shader for rendering terrain as coarse patches subdivided by the GPU's tessellator (see GPUTerrain::drawTessellated()).
+    ShaderProgram terrainTessShader {};
+
+    // True if the tessellation shader loaded and linked; if not, the tessellated terrain falls back to the displaced patches.
+    bool tessellationAvailable { false };
+
+    // A complete set of shader programs, so that a new set can be built in the background and swapped in all at once.
+    struct ShaderSet
+    {
+        ShaderProgram terrain {};
+        ShaderProgram terrainGPU {};
+        ShaderProgram terrainClipmap {};
+        ShaderProgram terrainTess {};
+        ShaderProgram terrainDepth {};
+        ShaderProgram terrainGPUDepth {};
+        ShaderProgram water {};
+        ShaderProgram basic {};
+        ShaderProgram instanced {};
+        ShaderProgram skybox {};
+        ShaderProgram farImpostor {};
+
+        // True if the tessellation shader linked.
+        bool tessellationAvailable { false };
+    };
+
+    // Builds the shaders on a background thread with a shared context, so that loading and reloading them never stalls a frame.
+    ShaderCompiler shaderCompiler {};
+
+    // The set of shaders being built in the background, if any.
+    std::shared_ptr<ShaderSet> pendingShaders {};
+
+    // The locations of the uniforms a terrain program is given on every pass, resolved once each time it's linked.
+    struct TerrainUniforms
+    {
+        GLint diffuseTex { -1 };
+        GLint normalTex { -1 };
+        GLint occlusionTex { -1 };
+        GLint occlusionUVScale { -1 };
+        GLint pixelsPerUnit { -1 };
+    };
+
+    // The uniform locations of the cell, displaced-patch, clipmap and tessellated terrain programs.
+    TerrainUniforms terrainUniforms {};
+    TerrainUniforms terrainGPUUniforms {};
+    TerrainUniforms terrainClipmapUniforms {};
+    TerrainUniforms terrainTessUniforms {};
+
+    // Shader for rendering the terrain clipmap.
+    ShaderProgram terrainClipmapShader {};
+
+    // Depth-only versions of the cell and displaced-patch terrain shaders, for the near terrain's depth pre-pass.
+    ShaderProgram terrainDepthShader {};
+    ShaderProgram terrainGPUDepthShader {};
+
+    // Set to true to draw the near terrain's depth first, so that the normal mapping and lighting only run once per pixel
+    // (not used for the clipmap or tessellated terrain).  Toggled with the 'p' key.
+    bool useDepthPrePass { false };
+
+    // Set to true to count the fragments shaded by the near terrain and print the overdraw about once a second.  Toggled with the 'o' key.
+    bool measureOverdraw { false };
+
+    // The occlusion query counting the near terrain's shaded fragments.
+    GLuint overdrawQuery { 0 };
+
+    // True while the overdraw query is waiting for the GPU; a new one isn't started until its result has been read.
+    bool overdrawQueryPending { false };
+
+    // The number of pixels the scene was rendered at in the frame of the pending overdraw query
+    // (fewer than the window's while the dynamic resolution is scaled down).
+    uint64_t overdrawQueryPixels { 0 };
+
+    // The fragments counted, the pixels they were spread over, and the frames measured since the overdraw was last printed.
+    uint64_t overdrawSamples { 0 };
+    uint64_t overdrawPixels { 0 };
+    unsigned int overdrawFrames { 0 };
+
+    // The time the overdraw was last printed.
+    float lastOverdrawReportTime { 0 };
+
+    // Times the CPU and GPU work of each frame, shown as an overlay and logged to profile.csv.  Toggled with the 't' key.
+    Profiler profiler {};
+
+    // Where the timeline of traced scopes (see Tracer) is written, relative to the data folder, when tracing is turned off with
+    // the 'x' key or the app exits while tracing.
+    const static std::string TRACE_FILE;
+
+    // Set to true to render the scene at a resolution that keeps the GPU time near a target.  Toggled with the 'r' key.
+    bool useDynamicResolution { true };
+
+    // Scales the scene's resolution to follow the GPU frame-time target (see DynamicResolution::Settings).
+    DynamicResolution dynamicResolution {};
+
+    // The frame rate that the dynamic resolution aims to keep the GPU at.
+    const static unsigned int TARGET_FRAME_RATE { 60 };
 
     // Shader for rendering water.
-    ofShader waterShader {};
+    ShaderProgram waterShader {};
+
+    // The camera, lighting and fade uniform blocks shared by every shader.
+    ShaderUniforms shaderUniforms {};
 
-    // terrain texture diffuse
-    ofImage terrainDiffuse;
+    // terrain texture diffuse (BC1, streamed in coarsest mip level first)
+    StreamedTexture terrainDiffuse {};
 
-    // noemal map
-    ofImage terrainNormal;
+    // normal map (BC5, streamed in coarsest mip level first)
+    StreamedTexture terrainNormal {};
+
+    // The most bytes of streamed texture data uploaded per frame.
+    const static size_t TEXTURE_UPLOAD_BUDGET { 4 * 1024 * 1024 };
+
+    // The direction towards the sun, in world space; fixed, so that the terrain's shadows can be baked.
+    glm::vec3 lightDirection { glm::normalize(glm::vec3(1, 1, -1)) };
+
+    // The terrain's baked self-shadowing and ambient occlusion.
+    TerrainOcclusion terrainOcclusion {};
+
+    // The resolution of the terrain occlusion map along the heightmap's shorter side.
+    const static unsigned int OCCLUSION_MAP_RESOLUTION { 2048 };
+
+    // The number of horizon directions traced per texel of the occlusion map.
+    const static unsigned int OCCLUSION_AZIMUTHS { 16 };
 
     // The main game "world" that uses the heightmap.
     World world {};
 
+    // Runs cell builds, culling and other per-frame work across every hardware thread, with room for the simulation thread to attach.
+    JobSystem jobSystem { std::thread::hardware_concurrency(), 1 };
+
+    // Set to true to cache built terrain cell meshes on disk and reuse them on subsequent runs.
+    bool useCellMeshCache { true };
+
+    // The on-disk cache of cell meshes for the high level-of-detail close terrain.
+    CellMeshCache cellMeshCache {};
+
     // A cell manager for the high level-of-detail close terrain.
     CellManager<NEAR_LOD_RANGE + 1> cellManager { world, NEAR_LOD_SIZE };
 
+    // Set to true to draw the close terrain by displacing a shared patch on the GPU instead of building a mesh for each cell.
+    bool useGPUTerrain { false };
+
+    // The close terrain drawn on the GPU, if enabled; covers the same cells as the near cell manager.
+    GPUTerrain gpuTerrain { world, NEAR_LOD_SIZE, NEAR_LOD_RANGE + 1 };
+
+    // Set to true to draw the close terrain on the GPU as coarse patches that are tessellated according to their size on screen
+    // (implies useGPUTerrain).  Falls back to the displaced patches when tessellation shaders are unavailable.
+    bool useTessellatedTerrain { false };
+
+    // The size (in pixels) that tessellated terrain triangles should have on screen.
+    const static unsigned int TESSELLATION_TRIANGLE_SIZE { 8 };
+
     // The height (north-south) of the low-resolution heightmap used for generating the distant terrain.
     const static unsigned int FAR_LOD_RESOLUTION { 1024 };
 
@@ -97,21 +285,165 @@ private:
     // A secondary "world" instance that uses a lower-resolution heightmap for distant land.
     World farLODWorld {};
 
+    // The on-disk cache of cell meshes for the lower level-of-detail distant terrain.
+    CellMeshCache farLODCellMeshCache {};
+
     // A cell manager for the lower level-of-detail distant terrain.
     CellManager<FAR_LOD_RANGE + 1> farLODCellManager { farLODWorld, FAR_LOD_SIZE };
 
+    // Set to true to draw the distant terrain and water as a cubemap captured around the player, only recaptured (a face per frame)
+    // once the player has moved a little way, instead of drawing every far cell every frame.  Toggled with the 'i' key.
+    bool useFarImpostor { false };
+
+    // The captured distant terrain and water, if enabled.
+    FarImpostor farImpostor {};
+
+    // The size (in pixels) of each face of the far impostor.
+    const static unsigned int FAR_IMPOSTOR_RESOLUTION { 1024 };
+
+    // True while far cells or terrain textures are still streaming in; the far impostor is recaptured once they've all arrived.
+    bool farImpostorInputsLoading { true };
+
+    // Shader for drawing the far impostor.
+    ShaderProgram farImpostorShader {};
+
+    // Set to true to skip drawing the near and far cells hidden behind the nearest hills, as found by rasterizing
+    // coarse occluders on the CPU.  Only applies to cell-based terrain, and only to the near cells while the far impostor is on
+    // (the impostor needs the far cells in every direction).  Toggled with the 'c' key.
+    bool useOcclusionCulling { false };
+
+    // Rasterizes the occluders and tests the cells against them.
+    OcclusionCuller occlusionCuller {};
+
+    // The number of the nearest cells rasterized as occluders each frame.
+    const static size_t MAX_OCCLUDER_CELLS { 64 };
+
+    // The visible cells that survived occlusion culling this frame.
+    std::vector<Cell*> unoccludedNearCells {};
+    std::vector<Cell*> unoccludedFarCells {};
+
+    // The near and far cells within draw distance this frame; gathered by culling jobs at the start of draw()
+    // (unless the simulation thread is running, in which case they come from its frame packet).
+    std::vector<Cell*> nearVisibleCells {};
+    std::vector<Cell*> farVisibleCells {};
+
+    // The most terrain cells (near and far combined) that can be building in the background at once.
+    const static unsigned int MAX_CELL_BUILDS_IN_FLIGHT { 8 };
+
+    // The number of frames between checks for far cells to load.
+    const static unsigned int FAR_LOD_UPDATE_INTERVAL { 4 };
+
+    // Set to true to scatter props (swords, rocks and markers) over the close terrain cells.
+    bool useSceneObjects { true };
+
+    // The props scattered over the close terrain; loaded and unloaded along with the near cells, so they only appear
+    // when the near terrain is built from cells (not with GPU-displaced, tessellated or clipmap terrain).
+    SceneObjects sceneObjects { world, NEAR_LOD_SIZE };
+
+    // Shader for rendering instanced props.
+    ShaderProgram instancedShader {};
+
+    // The texture shared by the sword and marker props.
+    ofImage propTex {};
+
+    // Set to true to draw all of the terrain, near and far, as a geometry clipmap instead of using cell managers.
+    bool useClipmapTerrain { false };
+
+    // The number of levels in the terrain clipmap.
+    const static unsigned int CLIPMAP_LEVELS { 8 };
+
+    // The number of quads in each row and column of a clipmap level.
+    const static unsigned int CLIPMAP_LEVEL_SIZE { 256 };
+
+    // The terrain clipmap, if enabled.
+    GeometryClipmap clipmap { world, CLIPMAP_LEVELS, CLIPMAP_LEVEL_SIZE };
+
     // A single terrain mesh. Uncomment the following line if not using a cell manager.
     //ofMesh staticTerrain {};
 
     // Set to true when the shader reload hotkey is pressed.
     bool needsReload { true };
 
+    // Set to true once the first frame has been drawn; used to report the time to first frame.
+    bool firstFrameDrawn { false };
+
     // The first-person camera.
     Camera fpCamera {};
 
     // The helper object for physics calculations related to the first person character.
     CharacterPhysics character { world };
 
+    // The rate (in steps per second) at which physics is simulated, independent of the frame rate.
+    const static unsigned int PHYSICS_RATE { 120 };
+
+    // The most physics steps that will be run in a single frame.
+    const static unsigned int MAX_PHYSICS_SUBSTEPS { 8 };
+
+    // Drives the physics simulation at a fixed rate.
+    FixedTimestep physicsTimestep { 1.0f / PHYSICS_RATE, MAX_PHYSICS_SUBSTEPS };
+
+    // The character's position before the most recent physics step; the camera is interpolated between this and the current position.
+    glm::vec3 prevCharacterPosition {};
+
+    // Set to true when the jump key is pressed; the jump is applied at the start of the next physics step
+    // so that the simulation only depends on the input stream, not on when in the frame the key was pressed.
+    // Atomic, since the physics may be running on the simulation thread.
+    std::atomic<bool> jumpRequested { false };
+
+    // Everything the render thread needs from one tick of the simulation thread to draw a frame.  Once published, a packet is never
+    // changed, so drawing never reads anything the simulation is in the middle of updating.  The camera matrices are built from it
+    // on the render thread, which adds the latest mouse look and the window's aspect ratio.
+    struct FramePacket
+    {
+        // The number of the tick that produced the packet, starting at 1.
+        uint64_t frame { 0 };
+
+        // The character's position before and after the last physics step, and how far between them the tick ended.
+        glm::vec3 prevCharacterPosition {};
+        glm::vec3 characterPosition {};
+        float interpolationAlpha { 0 };
+
+        // When the tick ended; the render thread carries the interpolation on from here by its own clock.
+        std::chrono::steady_clock::time_point time {};
+
+        // The distances to the plane dividing the near and far terrain and to the far plane (see calcLODPlanes()).
+        float midLODPlane { 0 };
+        float farPlaneDistant { 0 };
+
+        // The near and far cells within draw distance, front to back.
+        std::vector<Cell*> nearVisibleCells {};
+        std::vector<Cell*> farVisibleCells {};
+    };
+
+    // Set to true to run the physics, cell streaming, prop updates and culling on a thread of their own, at the physics rate,
+    // while this thread only uploads and draws.  The render thread draws the newest packet the simulation has published,
+    // so it lags the simulation by up to a tick; neither side ever waits for the other.  Toggled with the 'm' key.
+    bool useSimulationThread { false };
+
+    // The simulation thread, while it's running.
+    std::thread simulationThread {};
+
+    // Set to true to stop the simulation thread.
+    std::atomic<bool> stopSimulation { false };
+
+    // Frame packets, from the simulation thread to the render thread.
+    TripleBuffer<FramePacket> framePackets {};
+
+    // The character's desired velocity (from the keyboard and mouse), from the render thread to the simulation thread.
+    TripleBuffer<glm::vec3> simulationVelocity {};
+
+    // The packet being drawn this frame, or nullptr if the simulation thread isn't running.
+    const FramePacket* renderPacket { nullptr };
+
+    // The number of the packet being drawn; the simulation thread won't rebuild a cell that this packet (or a later one) might contain.
+    std::atomic<uint64_t> renderFrame { 0 };
+
+    // The number of ticks the simulation has run.  Only touched by the simulation.
+    uint64_t simulationFrame { 0 };
+
+    // The time taken by the last simulation tick, in milliseconds, for the profiler overlay.
+    std::atomic<float> simulationMilliseconds { 0 };
+
     // The camera's "look" sensitivity when using the mouse.
     float camSensitivity { 0.01f };
 
@@ -139,9 +471,62 @@ private:
     // The Xbox controller handle.
     // ofxXboxController controller;
 
-    // Reloads the shaders while the application is running.
+    // Starts building a new set of shaders in the background; they replace the current ones once they've all linked.
     void reloadShaders();
 
+    // Loads every shader into a set, returning true if they all linked.  Runs on the shader compiler's thread.
+    static bool buildShaders(ShaderSet& programs);
+
+    // Replaces the current shaders with a newly built set and sets up their uniform blocks, constant uniforms and uniform locations.
+    void applyShaders(ShaderSet& programs);
+
+    // Looks up the locations of a terrain program's per-pass uniforms.
+    static TerrainUniforms getTerrainUniforms(const ShaderProgram& program);
+
+    // Binds the terrain textures and sets the occlusion scale (for a heightmap of a particular size) on a terrain program that has been started.
+    void setTerrainMaterial(const ShaderProgram& program, const TerrainUniforms& uniforms, glm::uvec2 heightmapSize);
+
+    // Swaps in the shaders being built in the background once they're done (waiting for them if "wait" is true).
+    void collectShaders(bool wait);
+
+    // Builds the initial near and far terrain cells (when not using a clipmap).
+    void initializeCellManagers();
+
+    // Loads the prop models and hooks the props up to the near cell manager; must be called before the near cells are built.
+    void setupSceneObjects();
+
+    // Runs the performance benchmarks and prints the results (triggered by the benchmark hotkey).
+    void runBenchmarks();
+
+    // Reads the overdraw query if the GPU has finished it (never waits) and prints the average overdraw about once a second.
+    void readOverdrawQuery();
+
+    // Writes the timeline of traced scopes to the trace file.
+    void writeTrace();
+
+    // Advances the character physics by the real time elapsed, in fixed steps.
+    void stepPhysics(float elapsedTime);
+
+    // Moves the near and far cell grids to follow a position and starts building the cells that came into range
+    // (the far cells only if "includeFarCells" is true).  The frame numbers are passed to CellManager::processLoadQueue().
+    void streamCells(glm::vec3 position, bool includeFarCells, uint64_t frame = 0, uint64_t oldestFrameInUse = UINT64_MAX);
+
+    // Calculates the distances to the plane dividing the near and far terrain and to the far plane, for the camera at a particular position.
+    void calcLODPlanes(glm::vec3 position, float& midLODPlane, float& farPlaneDistant) const;
+
+    // Runs one tick of the simulation and publishes a frame packet.  Runs on the simulation thread (or, for the first tick, on this one).
+    void simulationTick(float elapsedTime);
+
+    // Starts and stops the simulation thread.
+    void startSimulationThread();
+    void stopSimulationThread();
+
+    // Draws the distant terrain (the far cells or the clipmap beyond the near terrain) using the camera already in the camera block.
+    void drawFarTerrain(const std::vector<Cell*>& farCells, float nearPlane, float farPlane);
+
+    // Draws the distant water using the camera already in the camera block, with depth clamping so that it covers the terrain whatever its depth.
+    void drawFarWater();
+
     // Updates the first-person camera bsed on some 2D input (from a mouse or Xbox controller).
     void updateFPCamera(float dx, float dy);
 };
@@ -1,5 +1,7 @@
 #include "ofxCubemap.h"
 #include "ofGLUtils.h"
+#include "KTXFile.h"
+#include <future>
 
 ofxCubemap::ofxCubemap()
 {
@@ -17,6 +19,12 @@ ofxCubemap::~ofxCubemap()
 	glDeleteTextures(1, &glTexId);
 }
 
+namespace
+{
+	// The names of the faces, in the order of GL_TEXTURE_CUBE_MAP_POSITIVE_X + i.
+	const char* FACE_NAMES[6] = { "right", "left", "top", "bottom", "front", "back" };
+}
+
 bool ofxCubemap::load(const std::filesystem::path& front,
 							const std::filesystem::path& back,
 							const std::filesystem::path& right,
@@ -24,52 +32,208 @@ bool ofxCubemap::load(const std::filesystem::path& front,
 							const std::filesystem::path& top,
 							const std::filesystem::path& bottom)
 {
-	
-	bool success = images[0].load(right);
-	success |= images[1].load(left);
-	success |= images[2].load(top);
-	success |= images[3].load(bottom);
-	success |= images[4].load(front);
-	success |= images[5].load(back);
+	const std::filesystem::path* paths[6] = { &right, &left, &top, &bottom, &front, &back };
+
+	// The decoded faces only live until they've been uploaded.
+	ofPixels faces[6];
+	bool loaded[6];
+
+	// Decode the first face here so that the image library is initialized on a single thread, then decode the rest in parallel.
+	loaded[0] = ofLoadImage(faces[0], *paths[0]);
+
+	std::future<bool> decodes[6];
+	for (int i = 1; i < 6; ++i)
+	{
+		decodes[i] = std::async(std::launch::async, [&faces, &paths, i]() { return ofLoadImage(faces[i], *paths[i]); });
+	}
+
+	for (int i = 1; i < 6; ++i)
+	{
+		loaded[i] = decodes[i].get();
+	}
+
+	// Report every face that failed, not just the first.
+	bool success = true;
+	for (int i = 0; i < 6; ++i)
+	{
+		if (!loaded[i])
+		{
+			fprintf(stderr, "ERROR: ofxCubemap failed to load the %s face from %s\n", FACE_NAMES[i], paths[i]->string().c_str());
+			success = false;
+		}
+	}
 
 	if (!success)
 	{
-		fprintf(stderr, "ERROR: EasyCubemap failed to load an image");
 		return false;
 	}
 
-	unsigned int faceWidth = images[0].getWidth();
-	unsigned int faceHeight = images[0].getHeight();
+	unsigned int faceWidth = faces[0].getWidth();
+	unsigned int faceHeight = faces[0].getHeight();
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, glTexId);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	for (int i = 0; i < 6; ++i)
+	{
+		if (faces[i].getWidth() != faceWidth || faces[i].getHeight() != faceHeight)
+		{
+			fprintf(stderr, "ERROR: ofxCubemap couldn't load because the %s face is %zux%zu instead of %ux%u\n",
+				FACE_NAMES[i], faces[i].getWidth(), faces[i].getHeight(), faceWidth, faceHeight);
+			return false;
+		}
+	}
 
-	unsigned char* faceData[6];
+	GLint internalFormat = ofGetGLInternalFormat(faces[0]);
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, glTexId);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 
 	for (int i = 0; i < 6; ++i)
 	{
-		if (images[i].getWidth() != faceWidth || images[i].getHeight() != faceHeight)
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, internalFormat, faceWidth, faceHeight, 0, ofGetGLFormat(faces[i]), GL_UNSIGNED_BYTE, faces[i].getData());
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+
+	unsigned int mipLevels = 1;
+	while ((std::max(faceWidth, faceHeight) >> mipLevels) > 0)
+	{
+		mipLevels++;
+	}
+
+	finishUpload(internalFormat, faceWidth, faceHeight, mipLevels);
+
+	return true;
+}
+
+bool ofxCubemap::loadKTX(const std::filesystem::path& path)
+{
+	ofFile file(path);
+	if (!file.exists())
+	{
+		return false;
+	}
+
+	ofBuffer buffer = file.readToBuffer();
+	const char* data = buffer.getData();
+	size_t size = buffer.size();
+
+	KTXHeader header;
+	if (size < sizeof(header))
+	{
+		fprintf(stderr, "ERROR: ofxCubemap couldn't load %s because it's too small to be a KTX file\n", path.string().c_str());
+		return false;
+	}
+
+	memcpy(&header, data, sizeof(header));
+
+	if (!isNativeKTXHeader(header))
+	{
+		fprintf(stderr, "ERROR: ofxCubemap couldn't load %s because it isn't a KTX file in this machine's byte order\n", path.string().c_str());
+		return false;
+	}
+
+	if (header.numberOfFaces != 6 || header.pixelDepth > 1 || header.numberOfArrayElements > 1)
+	{
+		fprintf(stderr, "ERROR: ofxCubemap couldn't load %s because it isn't a single cubemap\n", path.string().c_str());
+		return false;
+	}
+
+	// A type of zero means the faces are compressed.
+	bool compressed = header.glType == 0;
+
+	// KTX files with no mip levels ask for mipmaps to be generated.
+	bool generateMipmaps = header.numberOfMipmapLevels == 0;
+	unsigned int mipLevels = std::max(1u, header.numberOfMipmapLevels);
+
+	size_t offset = sizeof(header) + header.bytesOfKeyValueData;
+
+	glBindTexture(GL_TEXTURE_CUBE_MAP, glTexId);
+
+	// Clear any earlier errors so that an unsupported format can be detected.
+	while (glGetError() != GL_NO_ERROR)
+	{
+	}
+
+	for (unsigned int level = 0; level < mipLevels; ++level)
+	{
+		uint32_t imageSize;
+		if (offset + sizeof(imageSize) > size)
 		{
-			fprintf(stderr, "ERROR: EasyCubemap couldn't load because not all source textures are the same size\n");
+			fprintf(stderr, "ERROR: ofxCubemap couldn't load %s because it ends before mip level %u\n", path.string().c_str(), level);
 			return false;
 		}
 
-		faceData[i] = images[i].getPixels().getData();
+		memcpy(&imageSize, data + offset, sizeof(imageSize));
+		offset += sizeof(imageSize);
+
+		unsigned int levelWidth = std::max(1u, header.pixelWidth >> level);
+		unsigned int levelHeight = std::max(1u, header.pixelHeight >> level);
+
+		for (int i = 0; i < 6; ++i)
+		{
+			if (offset + imageSize > size)
+			{
+				fprintf(stderr, "ERROR: ofxCubemap couldn't load %s because it ends in the %s face of mip level %u\n",
+					path.string().c_str(), FACE_NAMES[i], level);
+				return false;
+			}
+
+			if (compressed)
+			{
+				glCompressedTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, level, header.glInternalFormat, levelWidth, levelHeight, 0, imageSize, data + offset);
+			}
+			else
+			{
+				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, level, header.glInternalFormat, levelWidth, levelHeight, 0, header.glFormat, header.glType, data + offset);
+			}
 
-		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X+i, 0, images[i].getTexture().texData.glInternalFormat, faceWidth, faceHeight, 0, ofGetGLFormat(images[i].getPixels()), GL_UNSIGNED_BYTE, faceData[i]);
+			// Each face is padded to a multiple of four bytes.
+			offset = (offset + imageSize + 3) & ~size_t(3);
+		}
 	}
-	glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
 
-	textureData.texData.textureID = glTexId;
-	textureData.texData.bAllocated = true;
+	if (glGetError() != GL_NO_ERROR)
+	{
+		fprintf(stderr, "ERROR: ofxCubemap couldn't upload %s; its format (0x%x) may not be supported\n", path.string().c_str(), header.glInternalFormat);
+		return false;
+	}
+
+	if (generateMipmaps)
+	{
+		glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+		while ((std::max(header.pixelWidth, header.pixelHeight) >> mipLevels) > 0)
+		{
+			mipLevels++;
+		}
+	}
+
+	finishUpload(header.glInternalFormat, header.pixelWidth, header.pixelHeight, mipLevels);
 
 	return true;
 }
 
+void ofxCubemap::finishUpload(GLint internalFormat, unsigned int faceWidth, unsigned int faceHeight, unsigned int mipLevels)
+{
+	glBindTexture(GL_TEXTURE_CUBE_MAP, glTexId);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mipLevels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+	// Only sample the levels that were actually uploaded.
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+
+	textureData.texData.textureID = glTexId;
+	textureData.texData.glInternalFormat = internalFormat;
+	textureData.texData.width = faceWidth;
+	textureData.texData.height = faceHeight;
+	textureData.texData.tex_w = faceWidth;
+	textureData.texData.tex_h = faceHeight;
+	textureData.texData.bAllocated = true;
+}
+
 const ofTexture& ofxCubemap::getTexture() const
 {
 	return textureData;
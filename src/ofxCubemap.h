@@ -13,6 +13,9 @@ public:
 	ofxCubemap(const ofxCubemap& other) = delete;
 	ofxCubemap& operator=(const ofxCubemap& other) = delete;
 
+	// Loads six image files (decoded in parallel), uploads them and generates mipmaps.
+	// The decoded pixels are released once they've been uploaded.
+	// Returns false, after reporting every face that failed, if any face can't be loaded or the faces aren't all the same size.
 	bool load(const std::filesystem::path& front,
 			  const std::filesystem::path& back,
 			  const std::filesystem::path& right,
@@ -20,12 +23,19 @@ public:
 			  const std::filesystem::path& top,
 			  const std::filesystem::path& bottom);
 
+	// Loads a KTX (version 1) cubemap with six faces, uploading every mip level it contains as-is.
+	// Supports both uncompressed and compressed (e.g. BC1 / BC3 / BC7) faces, so nothing needs to be decoded or generated at runtime.
+	// Returns false if the file is missing, isn't a cubemap, or uses a compressed format the driver doesn't support.
+	bool loadKTX(const std::filesystem::path& path);
+
 	ofTexture& getTexture();
 	const ofTexture& getTexture() const;
 
 private:
 	ofTexture textureData;
 	unsigned int glTexId;
-	ofImage images[6];
+
+	// Sets the filtering for the cubemap and records its size and format once the faces have been uploaded.
+	void finishUpload(GLint internalFormat, unsigned int faceWidth, unsigned int faceHeight, unsigned int mipLevels);
 
 };